@@ -0,0 +1,474 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "generator.hpp"
+#include "parser.hpp"
+#include "program.hpp"
+#include "symbols.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mathex>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counts allocations, so that allocations per evaluation can be reported, also of phases running on several threads
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace bench {
+    struct Options {
+        std::uint64_t seed = 1;
+        double time = 0.2;         // Minimum seconds spent measuring each phase.
+        size_t expressions = 64;   // Expressions generated for each scenario.
+        std::string format = "json";
+        std::string filter;        // Only scenarios or phases containing this string are run.
+        std::string baseline;      // File with earlier results to compare with.
+        double tolerance = 0.10;   // Slowdown against baseline reported as regression.
+        size_t threads = 0;        // Most readers evaluating on one config at once, or one per hardware thread.
+    };
+
+    struct Scenario {
+        const char *name;
+        Shape shape;
+    };
+
+    struct Result {
+        std::string scenario;
+        std::string phase;
+        size_t evals;
+        double ns;
+        double allocs;
+    };
+
+    static const Scenario scenarios[] = {
+        {"arith-shallow", {3, 4, 0.0, "+-*/", 0.5}},
+        {"arith-deep", {8, 4, 0.0, "+-*/", 0.5}},
+        {"mixed", {5, 16, 0.15, "++--**/^%", 0.5}},
+        {"calls", {5, 8, 0.5, "+-*", 0.5}},
+        {"many-ids", {4, 1000, 0.1, "+-*/", 0.5}},
+        {"literals", {6, 4, 0.0, "+-*", 0.95}},
+    };
+
+    // Volatile sink keeps results of measured code alive.
+    static volatile double sink;
+
+    // Runs `pass` until `time` seconds have passed; each pass does `evals` evaluations.
+    static Result measure(const Options &options, const char *scenario, const char *phase, size_t evals, const std::function<void()> &pass) {
+        typedef std::chrono::steady_clock Clock;
+
+        pass(); // Warm up caches and memory of reused buffers
+
+        size_t passes = 0;
+        size_t allocated = allocations;
+        Clock::time_point start = Clock::now();
+        double elapsed = 0;
+
+        while (elapsed < options.time) {
+            pass();
+            passes++;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        allocated = allocations - allocated;
+        size_t total = passes * evals;
+        return Result{scenario, phase, total, elapsed * 1e9 / (double)total, (double)allocated / (double)total};
+    }
+
+    // Runs `pass` on `threads` threads at once until `time` seconds have passed; evaluations of all threads are reported together.
+    static Result measureThreads(const Options &options, const char *scenario, const std::string &phase, size_t threads, size_t evals, const std::function<double()> &pass) {
+        typedef std::chrono::steady_clock Clock;
+
+        sink = pass(); // Warm up caches and memory of reused buffers
+
+        std::atomic<size_t> ready{0};
+        std::atomic<bool> started{false}, stopped{false};
+        std::vector<size_t> passes(threads);
+        std::vector<double> kept(threads);
+        std::vector<std::thread> readers;
+
+        for (size_t i = 0; i < threads; i++) {
+            readers.emplace_back([&, i]() {
+                ready++;
+
+                while (!started) {
+                    std::this_thread::yield();
+                }
+
+                // Counted locally, so that threads do not share cache lines while measured
+                size_t counted = 0;
+                double result = 0;
+
+                while (!stopped) {
+                    result = pass();
+                    counted++;
+                }
+
+                passes[i] = counted;
+                kept[i] = result;
+            });
+        }
+
+        while (ready < threads) {
+            std::this_thread::yield();
+        }
+
+        size_t allocated = allocations;
+        Clock::time_point start = Clock::now();
+        started = true;
+        std::this_thread::sleep_for(std::chrono::duration<double>(options.time));
+        stopped = true;
+
+        for (std::thread &reader : readers) {
+            reader.join();
+        }
+
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        allocated = allocations - allocated;
+        size_t total = 0;
+
+        for (size_t i = 0; i < threads; i++) {
+            total += passes[i] * evals;
+            sink = kept[i];
+        }
+
+        total = std::max<size_t>(total, 1);
+        return Result{scenario, phase, total, elapsed * 1e9 / (double)total, (double)allocated / (double)total};
+    }
+
+    static void print(const Options &options, const Result &result) {
+        if (options.format == "csv") {
+            std::printf("%s,%s,%llu,%zu,%.3f,%.0f,%.3f\n", result.scenario.c_str(), result.phase.c_str(), (unsigned long long)options.seed, result.evals, result.ns, 1e9 / result.ns, result.allocs);
+        } else {
+            std::printf("{\"scenario\":\"%s\",\"phase\":\"%s\",\"seed\":%llu,\"evals\":%zu,\"ns_per_eval\":%.3f,\"evals_per_sec\":%.0f,\"allocs_per_eval\":%.3f}\n", result.scenario.c_str(), result.phase.c_str(), (unsigned long long)options.seed, result.evals, result.ns, 1e9 / result.ns, result.allocs);
+        }
+
+        std::fflush(stdout);
+    }
+
+    // Reads value of `key` from a line printed by `print` in JSON format.
+    static std::string field(const std::string &line, const std::string &key) {
+        size_t start = line.find("\"" + key + "\":");
+
+        if (start == std::string::npos) {
+            return "";
+        }
+
+        start += key.length() + 3;
+        size_t end = line.find_first_of(",}", start);
+        std::string value = line.substr(start, end - start);
+
+        if (!value.empty() && value[0] == '"') {
+            value = value.substr(1, value.length() - 2);
+        }
+
+        return value;
+    }
+
+    static std::map<std::string, double> readBaseline(const std::string &path) {
+        std::map<std::string, double> baseline;
+        std::ifstream file(path);
+        std::string line;
+
+        while (std::getline(file, line)) {
+            std::string ns = field(line, "ns_per_eval");
+
+            if (!ns.empty()) {
+                baseline[field(line, "scenario") + "/" + field(line, "phase")] = std::atof(ns.c_str());
+            }
+        }
+
+        return baseline;
+    }
+
+    static mathex::Error f1(double args[], int argc, double &result) {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] * 0.5 + 1;
+        return mathex::Success;
+    }
+
+    static mathex::Error f2(double args[], int argc, double &result) {
+        if (argc != 2) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] - args[1] * 0.25;
+        return mathex::Success;
+    }
+
+    static void run(const Options &options, const Scenario &scenario, std::vector<Result> &results) {
+        const mathex::Flags flags = mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus;
+        const size_t rows = 4096;
+
+        Generator generator(options.seed, scenario.shape);
+        std::vector<std::string> sources;
+
+        for (size_t i = 0; i < options.expressions; i++) {
+            sources.push_back(generator.next());
+        }
+
+        // Same symbols, both behind the public config and as a table for measuring phases separately
+        std::vector<double> values((size_t)scenario.shape.identifiers);
+        std::vector<std::vector<double>> columns((size_t)scenario.shape.identifiers, std::vector<double>(rows));
+        mathex::Config config(flags);
+        mathex::Tokens tokens;
+        mathex::Columns batch;
+
+        for (size_t i = 0; i < values.size(); i++) {
+            std::string name = "v" + std::to_string(i);
+            values[i] = (double)(i % 7) + 0.5;
+
+            for (size_t row = 0; row < rows; row++) {
+                columns[i][row] = values[i] + (double)row * 0.001;
+            }
+
+            config.addVariable(name, values[i]);
+            tokens[name] = std::make_shared<const mathex::Token>(&values[i]);
+            batch[name] = columns[i].data();
+        }
+
+        config.addFunction("f1", f1);
+        config.addFunction("f2", f2);
+        tokens["f1"] = std::make_shared<const mathex::Token>(mathex::Function(f1));
+        tokens["f2"] = std::make_shared<const mathex::Token>(mathex::Function(f2));
+
+        mathex::SymbolTable symbols(tokens);
+        std::vector<std::vector<mathex::Lexeme>> lexed(sources.size());
+        std::vector<mathex::Expression> compiled(sources.size()), native(sources.size());
+
+        for (size_t i = 0; i < sources.size(); i++) {
+            mathex::lex(sources[i], flags, lexed[i]);
+
+            if (config.compile(sources[i], compiled[i]) != mathex::Success || config.compile(sources[i], native[i]) != mathex::Success) {
+                std::fprintf(stderr, "failed to compile generated expression: %s\n", sources[i].c_str());
+                std::exit(2);
+            }
+
+            native[i].jit();
+        }
+
+        std::vector<mathex::Lexeme> lexemes;
+        std::vector<double> output(rows);
+        mathex::Evaluator evaluator;
+        size_t count = sources.size();
+
+        struct Phase {
+            const char *name;
+            size_t evals;
+            std::function<void()> pass;
+        };
+
+        std::vector<Phase> phases = {
+            {"lex", count, [&]() {
+                 for (const std::string &source : sources) {
+                     lexemes.clear();
+                     mathex::lex(source, flags, lexemes);
+                 }
+
+                 sink = (double)lexemes.size();
+             }},
+            {"parse", count, [&]() {
+                 for (size_t i = 0; i < count; i++) {
+                     mathex::Program program;
+                     mathex::translate(sources[i], lexed[i], symbols, flags, program);
+                     sink = (double)program.code.size();
+                 }
+             }},
+            {"compile", count, [&]() {
+                 mathex::Expression expression;
+
+                 for (const std::string &source : sources) {
+                     config.compile(source, expression);
+                 }
+
+                 sink = (double)expression.size();
+             }},
+            {"execute", count, [&]() {
+                 double result = 0;
+
+                 for (const mathex::Expression &expression : compiled) {
+                     evaluator.evaluate(expression, result);
+                 }
+
+                 sink = result;
+             }},
+            {"execute-jit", count, [&]() {
+                 double result = 0;
+
+                 for (const mathex::Expression &expression : native) {
+                     evaluator.evaluate(expression, result);
+                 }
+
+                 sink = result;
+             }},
+            {"batch", count * rows, [&]() {
+                 for (const mathex::Expression &expression : compiled) {
+                     evaluator.evaluate(expression, batch, output.data(), rows);
+                 }
+
+                 sink = output[0];
+             }},
+            {"evaluate", count, [&]() {
+                 double result = 0;
+
+                 for (const std::string &source : sources) {
+                     config.evaluate(source, result);
+                 }
+
+                 sink = result;
+             }},
+        };
+
+        for (const Phase &phase : phases) {
+            std::string name = std::string(scenario.name) + "/" + phase.name;
+
+            if (name.find(options.filter) == std::string::npos) {
+                continue;
+            }
+
+            results.push_back(measure(options, scenario.name, phase.name, phase.evals, phase.pass));
+            print(options, results.back());
+        }
+
+        // Readers evaluating on one config at once, by doubling numbers of threads up to `threads`; throughput is of all of them
+        for (size_t threads = 1;; threads = std::min(threads * 2, options.threads)) {
+            std::string phase = "readers-" + std::to_string(threads);
+
+            if ((std::string(scenario.name) + "/" + phase).find(options.filter) != std::string::npos) {
+                results.push_back(measureThreads(options, scenario.name, phase, threads, count, [&]() {
+                    double result = 0;
+
+                    for (const std::string &source : sources) {
+                        config.evaluate(source, result);
+                    }
+
+                    return result;
+                }));
+                print(options, results.back());
+            }
+
+            if (threads == options.threads) {
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench::Options options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (value == nullptr) {
+            std::fprintf(stderr, "missing value of %s\n", arg.c_str());
+            return 2;
+        }
+
+        if (arg == "--seed") {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--time") {
+            options.time = std::atof(value);
+        } else if (arg == "--expressions") {
+            options.expressions = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--format") {
+            options.format = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--baseline") {
+            options.baseline = value;
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::atof(value);
+        } else if (arg == "--threads") {
+            options.threads = std::strtoull(value, nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--seed N] [--time SECONDS] [--expressions N] [--format json|csv] [--filter TEXT] [--baseline FILE] [--tolerance FRACTION] [--threads N]\n", argv[0]);
+            return 2;
+        }
+
+        i++;
+    }
+
+    if (options.threads == 0) {
+        options.threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    if (options.format == "csv") {
+        std::printf("scenario,phase,seed,evals,ns_per_eval,evals_per_sec,allocs_per_eval\n");
+    }
+
+    std::vector<bench::Result> results;
+
+    for (const bench::Scenario &scenario : bench::scenarios) {
+        bench::run(options, scenario, results);
+    }
+
+    if (options.baseline.empty()) {
+        return 0;
+    }
+
+    // Regressions go to stderr, so that stdout stays machine-readable
+    std::map<std::string, double> baseline = bench::readBaseline(options.baseline);
+    int regressions = 0;
+
+    for (const bench::Result &result : results) {
+        auto fetched = baseline.find(result.scenario + "/" + result.phase);
+
+        if (fetched != baseline.end() && result.ns > fetched->second * (1 + options.tolerance)) {
+            std::fprintf(stderr, "regression: %s/%s %.3f ns/eval, baseline %.3f ns/eval\n", result.scenario.c_str(), result.phase.c_str(), result.ns, fetched->second);
+            regressions++;
+        }
+    }
+
+    return regressions > 0 ? 1 : 0;
+}
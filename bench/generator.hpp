@@ -0,0 +1,124 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_BENCH_GENERATOR_HEADER
+#define MATHEX_BENCH_GENERATOR_HEADER
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+namespace bench {
+    // Shape of generated expressions.
+    struct Shape {
+        int depth;             // Maximum nesting depth of operators and function calls.
+        int identifiers;       // Number of variables expressions choose from.
+        double calls;          // Probability of a node being a function call.
+        const char *operators; // Binary operators to choose from, repeated to make one more likely than others.
+        double literals;       // Probability of a leaf being a number literal rather than a variable.
+    };
+
+    // Generates random expressions that are valid for config with all operator flags, variables `v0`..`vN`
+    // and functions `f1` and `f2` of one and two arguments. Same seed always gives the same expressions.
+    class Generator {
+    public:
+        Generator(std::uint64_t seed, const Shape &shape) : m_Random(seed), m_Shape(shape) {}
+
+        std::string next() {
+            std::string expression;
+            this->node(expression, this->m_Shape.depth);
+            return expression;
+        }
+
+    private:
+        double uniform() {
+            return std::uniform_real_distribution<double>(0, 1)(this->m_Random);
+        }
+
+        int pick(int count) {
+            return std::uniform_int_distribution<int>(0, count - 1)(this->m_Random);
+        }
+
+        void leaf(std::string &out) {
+            if (this->uniform() >= this->m_Shape.literals) {
+                out += "v" + std::to_string(this->pick(this->m_Shape.identifiers));
+                return;
+            }
+
+            switch (this->pick(3)) {
+            case 0: {
+                out += std::to_string(this->pick(100));
+            } break;
+
+            case 1: {
+                out += std::to_string(this->pick(1000)) + "." + std::to_string(this->pick(1000));
+            } break;
+
+            default: {
+                // Full precision, as printed by serializers
+                char literal[32];
+                std::snprintf(literal, sizeof(literal), "%.17g", std::exp(this->uniform() * 100 - 50));
+                out += literal;
+            } break;
+            }
+        }
+
+        void node(std::string &out, int depth) {
+            // Leaves get more likely deeper in the tree, so sizes of expressions vary
+            if (depth == 0 || this->uniform() < 0.15) {
+                this->leaf(out);
+                return;
+            }
+
+            if (this->uniform() < this->m_Shape.calls) {
+                if (this->pick(2) == 0) {
+                    out += "f1(";
+                    this->node(out, depth - 1);
+                } else {
+                    out += "f2(";
+                    this->node(out, depth - 1);
+                    out += ", ";
+                    this->node(out, depth - 1);
+                }
+
+                out += ")";
+                return;
+            }
+
+            // Unary operators are only allowed at the start of parentheses
+            out += this->uniform() < 0.1 ? "(-" : "(";
+            this->node(out, depth - 1);
+            out += " ";
+            out += this->m_Shape.operators[this->pick((int)std::char_traits<char>::length(this->m_Shape.operators))];
+            out += " ";
+            this->node(out, depth - 1);
+            out += ")";
+        }
+
+        std::mt19937_64 m_Random;
+        Shape m_Shape;
+    };
+}
+
+#endif /* MATHEX_BENCH_GENERATOR_HEADER */
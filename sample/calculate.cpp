@@ -1,4 +1,3 @@
-#include <cmath>
 #include <iostream>
 #include <mathex>
 #include <numeric>
@@ -8,8 +7,8 @@ double y = 5;
 double z = 8;
 
 int main() {
-    // Create a configuration with default flags
-    mathex::Config config;
+    // Create a configuration with default flags and built-in functions, such as `abs`
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Functions);
 
     // Add a constant variable and a function to the configuration
     config.addVariable("x", x);
@@ -28,15 +27,6 @@ int main() {
         return mathex::Success;
     });
 
-    config.addFunction("abs", [](double args[], int num_args, double &result) -> mathex::Error {
-        if (num_args != 1) {
-            return mathex::Error::IncorrectArgsNum;
-        }
-
-        result = fabs(args[0]);
-        return mathex::Success;
-    });
-
     // Evaluate expressions using the configuration
     double result;
     mathex::Error error = config.evaluate("2 * sum(2pi, -abs(x), y + 1, z / 2)", result);
@@ -0,0 +1,422 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "autodiff.hpp"
+#include "builtins.hpp"
+#include "mathex"
+#include "program.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace mathex {
+    // Largest number of variables differentiated in forward mode by `Differentiation::Auto`.
+    constexpr size_t ForwardLimit = 4;
+
+    // Marks variables that are not differentiated.
+    constexpr size_t NoTarget = std::numeric_limits<size_t>::max();
+
+    // Positions of differentiated variables in the gradient, for variables and slots of the program.
+    class Targets {
+    public:
+        Targets(const Program &program, const std::vector<std::string> &variables) : variables(program.variables.size(), NoTarget), slots(program.frame, NoTarget) {
+            for (size_t k = 0; k < variables.size(); k++) {
+                for (size_t i = 0; i < program.variables.size(); i++) {
+                    if (program.variables[i].first == variables[k] && this->variables[i] == NoTarget) {
+                        this->variables[i] = k;
+                    }
+                }
+
+                for (const auto &slot : program.slots) {
+                    if (slot.first == variables[k] && this->slots[slot.second] == NoTarget) {
+                        this->slots[slot.second] = k;
+                    }
+                }
+            }
+        }
+
+        // Returns position of variable read by instruction in the gradient, or `NoTarget`.
+        size_t find(const Instruction &instruction) const {
+            switch (instruction.opcode) {
+            case Opcode::Variable:
+                return this->variables[instruction.index];
+
+            case Opcode::Slot:
+                return this->slots[instruction.index];
+
+            default:
+                return NoTarget;
+            }
+        }
+
+        std::vector<size_t> variables;
+        std::vector<size_t> slots;
+    };
+
+    // Computes value of instruction from its arguments exactly like the interpreter does, and if `needed`, partial
+    // derivatives of the value with respect to each argument. `temp` has to fit arguments of the instruction.
+    static Error step(const Program &program, const Instruction &instruction, const double *frame, const double *args, double *temp, bool needed, double &value,
+                      double *partials) {
+        switch (instruction.opcode) {
+        case Opcode::Constant: {
+            value = instruction.constant;
+        } break;
+
+        case Opcode::Variable: {
+            value = *program.variables[instruction.index].second;
+        } break;
+
+        case Opcode::Slot: {
+            value = frame[instruction.index];
+        } break;
+
+        case Opcode::Function: {
+            // Functions may change their arguments, so they get a copy
+            std::copy(args, args + instruction.args, temp);
+            Error error = program.functions[instruction.index].second(instruction.args > 0 ? temp : nullptr, (int)instruction.args, value);
+
+            if (error != Error::Success || !needed) {
+                return error;
+            }
+
+            const Derivative &derivative = program.derivatives[instruction.index];
+
+            if (!derivative) {
+                return Error::NotDifferentiable;
+            }
+
+            std::copy(args, args + instruction.args, temp);
+            return derivative(temp, (int)instruction.args, partials);
+        }
+
+        case Opcode::Call: {
+            const Callback &callback = program.callbacks[instruction.index].second;
+            value = callback.invoke(callback.state.get(), args);
+
+            if (needed) {
+                return Error::NotDifferentiable;
+            }
+        } break;
+
+        case Opcode::Builtin: {
+            value = call((Builtin)instruction.index, args);
+
+            if (needed) {
+                differentiate((Builtin)instruction.index, args, value, partials);
+            }
+        } break;
+
+        case Opcode::Pos: {
+            value = args[0];
+            partials[0] = 1;
+        } break;
+
+        case Opcode::Neg: {
+            value = -args[0];
+            partials[0] = -1;
+        } break;
+
+        case Opcode::PowInt: {
+            value = powi(args[0], instruction.constant);
+            partials[0] = instruction.constant * std::pow(args[0], instruction.constant - 1);
+        } break;
+
+        case Opcode::Not: {
+            value = args[0] == 0 ? 1 : 0;
+            partials[0] = 0;
+        } break;
+
+        default: {
+            double a = args[0], b = args[1];
+            value = apply(instruction.opcode, a, b);
+
+            switch (instruction.opcode) {
+            case Opcode::Add: {
+                partials[0] = 1;
+                partials[1] = 1;
+            } break;
+
+            case Opcode::Sub: {
+                partials[0] = 1;
+                partials[1] = -1;
+            } break;
+
+            case Opcode::Mul: {
+                partials[0] = b;
+                partials[1] = a;
+            } break;
+
+            case Opcode::Div: {
+                partials[0] = 1 / b;
+                partials[1] = -a / (b * b);
+            } break;
+
+            case Opcode::Pow: {
+                partials[0] = b * std::pow(a, b - 1);
+                partials[1] = value * std::log(a);
+            } break;
+
+            case Opcode::Mod: {
+                partials[0] = 1;
+                partials[1] = -std::trunc(a / b);
+            } break;
+
+            default: {
+                // Comparisons are constant where they are differentiable
+                partials[0] = 0;
+                partials[1] = 0;
+            } break;
+            }
+        } break;
+        }
+
+        return Error::Success;
+    }
+
+    // Largest number of arguments of any instruction in the program.
+    static std::uint32_t maxArgs(const Program &program) {
+        std::uint32_t max_args = 2;
+
+        for (const Instruction &instruction : program.code) {
+            max_args = std::max(max_args, arity(instruction));
+        }
+
+        return max_args;
+    }
+
+    // Moves `i` to the instruction before the next one to run after a jump or end of conditional, given value on top
+    // of the stack, which is the condition of `Condition` and is popped by the caller. Returns false for other instructions.
+    static bool branch(const Instruction &instruction, double top, size_t &i) {
+        switch (instruction.opcode) {
+        case Opcode::Condition: {
+            if (top == 0) {
+                i = instruction.index - 1;
+            }
+        } break;
+
+        case Opcode::Else: {
+            i = instruction.index - 1;
+        } break;
+
+        case Opcode::Select: {
+        } break;
+
+        default: {
+            return false;
+        }
+        }
+
+        return true;
+    }
+
+    // Each value on the stack carries its derivatives with respect to all `n` variables, and whether it depends on them at all.
+    static Error forward(const Program &program, const double *frame, const Targets &targets, size_t n, double &result, double *gradient) {
+        std::vector<double> values(program.depth);
+        std::vector<double> tangents(program.depth * n);
+        std::vector<char> depends(program.depth);
+        std::vector<double> partials(maxArgs(program));
+        std::vector<double> temp(partials.size());
+        size_t top = 0;
+
+        for (size_t i = 0; i < program.code.size(); i++) {
+            const Instruction &instruction = program.code[i];
+
+            // Only the branch taken is differentiated, just like only it is evaluated
+            if (branch(instruction, top > 0 ? values[top - 1] : 0, i)) {
+                top -= instruction.opcode == Opcode::Condition ? 1 : 0;
+                continue;
+            }
+
+            std::uint32_t args = arity(instruction);
+            top -= args;
+
+            bool needed = std::any_of(depends.begin() + (std::ptrdiff_t)top, depends.begin() + (std::ptrdiff_t)(top + args), [](char value) { return value != 0; });
+            double value;
+            Error error = step(program, instruction, frame, values.data() + top, temp.data(), needed, value, partials.data());
+
+            if (error != Error::Success) {
+                return error;
+            }
+
+            // Tangent of the result overwrites tangent of its first argument, so it is summed up first
+            double *tangent = tangents.data() + top * n;
+            size_t target = targets.find(instruction);
+
+            for (size_t k = 0; k < n; k++) {
+                double sum = 0;
+
+                for (std::uint32_t j = 0; j < args && needed; j++) {
+                    // Zero tangent adds nothing, even when partial derivative is infinite
+                    double dot = tangent[j * n + k];
+
+                    if (depends[top + j] && dot != 0) {
+                        sum += partials[j] * dot;
+                    }
+                }
+
+                tangent[k] = k == target ? 1 : sum;
+            }
+
+            values[top] = value;
+            depends[top] = needed || target != NoTarget;
+            top++;
+        }
+
+        // Exactly one value has to be left in results stack
+        if (top != 1) {
+            return Error::SyntaxError;
+        }
+
+        result = values[0];
+        std::copy(tangents.begin(), tangents.begin() + (std::ptrdiff_t)n, gradient);
+        return Error::Success;
+    }
+
+    // Records value of each instruction and partial derivatives with respect to its arguments, then propagates
+    // derivative of the result back from the last instruction to the variables.
+    static Error reverse(const Program &program, const double *frame, const Targets &targets, double &result, double *gradient) {
+        struct Edge {
+            size_t argument; // Instruction that computed the argument.
+            double partial;
+        };
+
+        std::vector<double> values(program.code.size());
+        std::vector<char> depends(program.code.size());
+        std::vector<Edge> edges;
+        std::vector<size_t> first(program.code.size());    // Edges of instruction `i` are from `first[i]` to `last[i]`,
+        std::vector<size_t> last(program.code.size());     // none for instructions skipped by jumps.
+        std::vector<size_t> stack;                         // Instructions whose values are on the stack.
+        std::vector<double> args(maxArgs(program));
+        std::vector<double> partials(args.size());
+        std::vector<double> temp(args.size());
+
+        stack.reserve(program.depth);
+
+        for (size_t i = 0; i < program.code.size(); i++) {
+            const Instruction &instruction = program.code[i];
+
+            // Only the branch taken is recorded
+            if (branch(instruction, stack.empty() ? 0 : values[stack.back()], i)) {
+                if (instruction.opcode == Opcode::Condition) {
+                    stack.pop_back();
+                }
+
+                continue;
+            }
+
+            std::uint32_t count = arity(instruction);
+            size_t *operands = stack.data() + stack.size() - count;
+            bool needed = false;
+
+            for (std::uint32_t j = 0; j < count; j++) {
+                args[j] = values[operands[j]];
+                needed = needed || depends[operands[j]];
+            }
+
+            Error error = step(program, instruction, frame, args.data(), temp.data(), needed, values[i], partials.data());
+
+            if (error != Error::Success) {
+                return error;
+            }
+
+            first[i] = edges.size();
+
+            for (std::uint32_t j = 0; j < count && needed; j++) {
+                if (depends[operands[j]]) {
+                    edges.push_back(Edge{operands[j], partials[j]});
+                }
+            }
+
+            last[i] = edges.size();
+            depends[i] = needed || targets.find(instruction) != NoTarget;
+            stack.resize(stack.size() - count);
+            stack.push_back(i);
+        }
+
+        // Exactly one value has to be left in results stack
+        if (stack.size() != 1) {
+            return Error::SyntaxError;
+        }
+
+        // Result is computed by the last instruction run, which ends the program unless it jumped past its end
+        std::vector<double> adjoints(program.code.size());
+        adjoints[stack[0]] = 1;
+
+        for (size_t i = program.code.size(); i-- > 0;) {
+            // Zero adjoint adds nothing, even when partial derivative is infinite
+            if (adjoints[i] == 0) {
+                continue;
+            }
+
+            for (size_t e = first[i]; e < last[i]; e++) {
+                adjoints[edges[e].argument] += edges[e].partial * adjoints[i];
+            }
+
+            size_t target = targets.find(program.code[i]);
+
+            if (target != NoTarget) {
+                gradient[target] += adjoints[i];
+            }
+        }
+
+        result = values[stack[0]];
+        return Error::Success;
+    }
+
+    Error differentiate(const Program &program, const double *frame, const std::vector<std::string> &variables, Differentiation mode, double &result,
+                        double *gradient) {
+        if (program.code.empty()) {
+            return Error::SyntaxError;
+        }
+
+        // Slot variables have no value without a frame
+        if (program.frame > 0 && frame == nullptr) {
+            return Error::Undefined;
+        }
+
+        Targets targets(program, variables);
+        std::vector<double> computed(variables.size(), 0.0);
+        Error error;
+
+        if (mode == Differentiation::Forward || (mode == Differentiation::Auto && variables.size() <= ForwardLimit)) {
+            error = forward(program, frame, targets, variables.size(), result, computed.data());
+        } else {
+            error = reverse(program, frame, targets, result, computed.data());
+        }
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        // Variables listed more than once are only differentiated at their first position
+        for (size_t k = 0; k < variables.size(); k++) {
+            size_t original = (size_t)(std::find(variables.begin(), variables.end(), variables[k]) - variables.begin());
+            gradient[k] = computed[original];
+        }
+
+        return Error::Success;
+    }
+}
@@ -0,0 +1,38 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_AUTODIFF_HEADER
+#define MATHEX_AUTODIFF_HEADER
+
+#include "mathex"
+#include "program.hpp"
+#include <string>
+#include <vector>
+
+namespace mathex {
+    // Runs compiled program and computes partial derivatives of its result with respect to given variables, writing them
+    // into `gradient`. Slot variables are read from `frame`, which has to hold at least `program.frame` values.
+    Error differentiate(const Program &program, const double *frame, const std::vector<std::string> &variables, Differentiation mode, double &result,
+                        double *gradient);
+}
+
+#endif /* MATHEX_AUTODIFF_HEADER */
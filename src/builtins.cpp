@@ -0,0 +1,423 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "builtins.hpp"
+#include "program.hpp"
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace mathex {
+    static const BuiltinInfo builtins[] = {
+        {"abs", 1, static_cast<double (*)(double)>(std::fabs), nullptr},
+        {"sqrt", 1, static_cast<double (*)(double)>(std::sqrt), nullptr},
+        {"cbrt", 1, static_cast<double (*)(double)>(std::cbrt), nullptr},
+        {"exp", 1, static_cast<double (*)(double)>(std::exp), nullptr},
+        {"log", 1, static_cast<double (*)(double)>(std::log), nullptr},
+        {"log2", 1, static_cast<double (*)(double)>(std::log2), nullptr},
+        {"log10", 1, static_cast<double (*)(double)>(std::log10), nullptr},
+        {"sin", 1, static_cast<double (*)(double)>(std::sin), nullptr},
+        {"cos", 1, static_cast<double (*)(double)>(std::cos), nullptr},
+        {"tan", 1, static_cast<double (*)(double)>(std::tan), nullptr},
+        {"asin", 1, static_cast<double (*)(double)>(std::asin), nullptr},
+        {"acos", 1, static_cast<double (*)(double)>(std::acos), nullptr},
+        {"atan", 1, static_cast<double (*)(double)>(std::atan), nullptr},
+        {"sinh", 1, static_cast<double (*)(double)>(std::sinh), nullptr},
+        {"cosh", 1, static_cast<double (*)(double)>(std::cosh), nullptr},
+        {"tanh", 1, static_cast<double (*)(double)>(std::tanh), nullptr},
+        {"floor", 1, static_cast<double (*)(double)>(std::floor), nullptr},
+        {"ceil", 1, static_cast<double (*)(double)>(std::ceil), nullptr},
+        {"round", 1, static_cast<double (*)(double)>(std::round), nullptr},
+        {"trunc", 1, static_cast<double (*)(double)>(std::trunc), nullptr},
+        {"min", 2, nullptr, static_cast<double (*)(double, double)>(std::fmin)},
+        {"max", 2, nullptr, static_cast<double (*)(double, double)>(std::fmax)},
+        {"atan2", 2, nullptr, static_cast<double (*)(double, double)>(std::atan2)},
+        {"hypot", 2, nullptr, static_cast<double (*)(double, double)>(std::hypot)},
+    };
+
+    // Expressions parsed at compile time number built-in functions by `detail::BuiltinNames`, which follows this table
+    static_assert(sizeof(builtins) / sizeof(*builtins) == detail::Builtins, "every built-in function has a name in detail::BuiltinNames");
+    static_assert((size_t)Builtin::Hypot + 1 == detail::Builtins, "every built-in function has a number");
+    static_assert((size_t)Builtin::Trunc + 1 == detail::BinaryBuiltin && (size_t)Builtin::Min == detail::BinaryBuiltin, "built-in functions from detail::BinaryBuiltin on take two arguments");
+
+    const BuiltinInfo &describe(Builtin builtin) {
+        return builtins[(std::uint32_t)builtin];
+    }
+
+    bool findBuiltin(const char *name, size_t length, Builtin &builtin) {
+        for (std::uint32_t i = 0; i < sizeof(builtins) / sizeof(*builtins); i++) {
+            if (std::strlen(builtins[i].name) == length && std::memcmp(builtins[i].name, name, length) == 0) {
+                builtin = (Builtin)i;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void differentiate(Builtin builtin, const double *args, double result, double *partials) {
+        double a = args[0];
+
+        switch (builtin) {
+        case Builtin::Abs: {
+            partials[0] = a > 0 ? 1 : a < 0 ? -1 : 0;
+        } break;
+
+        case Builtin::Sqrt: {
+            partials[0] = 0.5 / result;
+        } break;
+
+        case Builtin::Cbrt: {
+            partials[0] = 1 / (3 * result * result);
+        } break;
+
+        case Builtin::Exp: {
+            partials[0] = result;
+        } break;
+
+        case Builtin::Log: {
+            partials[0] = 1 / a;
+        } break;
+
+        case Builtin::Log2: {
+            partials[0] = 1 / (a * 0.69314718055994530942);
+        } break;
+
+        case Builtin::Log10: {
+            partials[0] = 1 / (a * 2.30258509299404568402);
+        } break;
+
+        case Builtin::Sin: {
+            partials[0] = std::cos(a);
+        } break;
+
+        case Builtin::Cos: {
+            partials[0] = -std::sin(a);
+        } break;
+
+        case Builtin::Tan: {
+            partials[0] = 1 + result * result;
+        } break;
+
+        case Builtin::Asin: {
+            partials[0] = 1 / std::sqrt(1 - a * a);
+        } break;
+
+        case Builtin::Acos: {
+            partials[0] = -1 / std::sqrt(1 - a * a);
+        } break;
+
+        case Builtin::Atan: {
+            partials[0] = 1 / (1 + a * a);
+        } break;
+
+        case Builtin::Sinh: {
+            partials[0] = std::cosh(a);
+        } break;
+
+        case Builtin::Cosh: {
+            partials[0] = std::sinh(a);
+        } break;
+
+        case Builtin::Tanh: {
+            partials[0] = 1 - result * result;
+        } break;
+
+        case Builtin::Floor:
+        case Builtin::Ceil:
+        case Builtin::Round:
+        case Builtin::Trunc: {
+            partials[0] = 0;
+        } break;
+
+        case Builtin::Min:
+        case Builtin::Max: {
+            // Derivative of the argument that was picked
+            bool first = !std::isnan(a) && result == a;
+            partials[0] = first ? 1 : 0;
+            partials[1] = first ? 0 : 1;
+        } break;
+
+        case Builtin::Atan2: {
+            double b = args[1];
+            double norm = a * a + b * b;
+            partials[0] = b / norm;
+            partials[1] = -a / norm;
+        } break;
+
+        case Builtin::Hypot: {
+            partials[0] = a / result;
+            partials[1] = args[1] / result;
+        } break;
+        }
+    }
+
+    // Adding and subtracting this rounds values below 2^51 to integers, and leaves the integer in low bits of the sum.
+    constexpr double Shifter = 6755399441055744.0;
+
+    // ln(2) split so that its high part multiplied by small integers is exact.
+    constexpr double Ln2Hi = 6.93147180369123816490e-01;
+    constexpr double Ln2Lo = 1.90821492927058770002e-10;
+
+    // pi / 2 split in the same way.
+    constexpr double Pio2_1 = 1.57079632673412561417e+00;
+    constexpr double Pio2_2 = 6.07710050630396597660e-11;
+    constexpr double Pio2_3 = 2.02226624871116645580e-21;
+    constexpr double Pio2_3t = 8.47842766036889956997e-32;
+
+    static inline std::uint64_t bitsOf(double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static inline double fromBits(std::uint64_t bits) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // e^x = 2^n * e^r, where n is x / ln(2) rounded to integer and |r| <= ln(2) / 2.
+    static inline double expKernel(double x) {
+        double t = x * 1.44269504088896338700e+00 + Shifter;
+        double n = t - Shifter;
+        double r = (x - n * Ln2Hi) - n * Ln2Lo;
+
+        // Taylor series up to r^13
+        double p = 1.0 / 6227020800;
+        p = p * r + 1.0 / 479001600;
+        p = p * r + 1.0 / 39916800;
+        p = p * r + 1.0 / 3628800;
+        p = p * r + 1.0 / 362880;
+        p = p * r + 1.0 / 40320;
+        p = p * r + 1.0 / 5040;
+        p = p * r + 1.0 / 720;
+        p = p * r + 1.0 / 120;
+        p = p * r + 1.0 / 24;
+        p = p * r + 1.0 / 6;
+        p = p * r + 1.0 / 2;
+        p = p * r + 1;
+        p = p * r + 1;
+
+        return p * fromBits((bitsOf(t) - bitsOf(Shifter) + 1023) << 52);
+    }
+
+    // Keeps 2^n within normal numbers.
+    static inline bool expSupported(double x) {
+        return std::fabs(x) < 708;
+    }
+
+    // log(x) = k * ln(2) + log(1 + f), where 1 + f is in [sqrt(2) / 2, sqrt(2)).
+    // Only integer and floating point arithmetic is used, without branches, so that the loop can be vectorized.
+    static inline double logKernel(double x) {
+        // Biased exponent of x, increased by one if mantissa is above sqrt(2)
+        std::uint64_t bits = bitsOf(x);
+        std::uint64_t exponent = (bits - 0x3FE6A09E667F3BCDull + 0x3FF0000000000000ull) >> 52;
+
+        double m = fromBits(bits - (exponent << 52) + 0x3FF0000000000000ull);
+        double k = (fromBits(bitsOf(Shifter) + exponent) - Shifter) - 1023;
+
+        // log(1 + f) = 2 atanh(s) = f - s * (f - t), where s = f / (2 + f) and t = 2s^2 / 3 + 2s^4 / 5 + ...
+        double f = m - 1;
+        double s = f / (2 + f);
+        double z = s * s;
+
+        double t = 2.0 / 21;
+        t = t * z + 2.0 / 19;
+        t = t * z + 2.0 / 17;
+        t = t * z + 2.0 / 15;
+        t = t * z + 2.0 / 13;
+        t = t * z + 2.0 / 11;
+        t = t * z + 2.0 / 9;
+        t = t * z + 2.0 / 7;
+        t = t * z + 2.0 / 5;
+        t = t * z + 2.0 / 3;
+        t = t * z;
+
+        return k * Ln2Hi + (k * Ln2Lo + (f - s * (f - t)));
+    }
+
+    // Positive normal numbers.
+    static inline bool logSupported(double x) {
+        return x >= DBL_MIN && x <= DBL_MAX;
+    }
+
+    // Taylor series of sin(r) up to r^17, for |r| <= pi / 4 and z = r^2.
+    static inline double sinPolynomial(double r, double z) {
+        double p = 1.0 / 355687428096000;
+        p = p * z - 1.0 / 1307674368000;
+        p = p * z + 1.0 / 6227020800;
+        p = p * z - 1.0 / 39916800;
+        p = p * z + 1.0 / 362880;
+        p = p * z - 1.0 / 5040;
+        p = p * z + 1.0 / 120;
+        p = p * z - 1.0 / 6;
+
+        return r + r * z * p;
+    }
+
+    // Taylor series of cos(r) up to r^16, for |r| <= pi / 4 and z = r^2.
+    static inline double cosPolynomial(double z) {
+        double p = 1.0 / 20922789888000;
+        p = p * z - 1.0 / 87178291200;
+        p = p * z + 1.0 / 479001600;
+        p = p * z - 1.0 / 3628800;
+        p = p * z + 1.0 / 40320;
+        p = p * z - 1.0 / 720;
+        p = p * z + 1.0 / 24;
+
+        // 1 - z / 2 rounds, so its rounding error is added back
+        double h = 0.5 * z;
+        double w = 1 - h;
+        return w + (((1 - w) - h) + z * z * p);
+    }
+
+    // sin(x + shift * pi / 2), where x = n * pi / 2 + r. Sign and polynomial for quadrant n + shift are picked with bit masks.
+    static inline double sinQuadrant(double x, std::uint64_t shift) {
+        double t = x * 6.36619772367581382433e-01 + Shifter;
+        double n = t - Shifter;
+        double r = (((x - n * Pio2_1) - n * Pio2_2) - n * Pio2_3) - n * Pio2_3t;
+        double z = r * r;
+        std::uint64_t q = bitsOf(t) + shift;
+        std::uint64_t odd = 0 - (q & 1);
+
+        std::uint64_t value = (bitsOf(cosPolynomial(z)) & odd) | (bitsOf(sinPolynomial(r, z)) & ~odd);
+        return fromBits(value ^ ((q & 2) << 62));
+    }
+
+    static inline double sinKernel(double x) {
+        return sinQuadrant(x, 0);
+    }
+
+    // cos(x) = sin(x + pi / 2)
+    static inline double cosKernel(double x) {
+        return sinQuadrant(x, 1);
+    }
+
+    // Keeps n * pi / 2 split into parts exact. Zero is left out, since the polynomial loses its sign.
+    static inline bool sinSupported(double x) {
+        return (std::fabs(x) <= 1048576) & (x != 0);
+    }
+
+    static inline bool cosSupported(double x) {
+        return std::fabs(x) <= 1048576;
+    }
+
+    // Computes `Kernel` for the whole block, falling back to `exact` in rows outside of its range.
+    template <double (*Kernel)(double), bool (*Supported)(double)>
+    static void approximate(double *x, double (*exact)(double)) {
+        size_t unsupported = 0;
+
+        for (size_t i = 0; i < BatchSize; i++) {
+            unsupported += (size_t)!Supported(x[i]);
+        }
+
+        if (unsupported == 0) {
+            for (size_t i = 0; i < BatchSize; i++) {
+                x[i] = Kernel(x[i]);
+            }
+
+            return;
+        }
+
+        for (size_t i = 0; i < BatchSize; i++) {
+            x[i] = Supported(x[i]) ? Kernel(x[i]) : exact(x[i]);
+        }
+    }
+
+    void applyBuiltin(Builtin builtin, double *a, const double *b) {
+        const BuiltinInfo &info = describe(builtin);
+
+        switch (builtin) {
+        case Builtin::Abs: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::fabs(a[i]);
+            }
+        } break;
+
+        case Builtin::Sqrt: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::sqrt(a[i]);
+            }
+        } break;
+
+        case Builtin::Exp: {
+            approximate<expKernel, expSupported>(a, info.unary);
+        } break;
+
+        case Builtin::Log: {
+            approximate<logKernel, logSupported>(a, info.unary);
+        } break;
+
+        case Builtin::Sin: {
+            approximate<sinKernel, sinSupported>(a, info.unary);
+        } break;
+
+        case Builtin::Cos: {
+            approximate<cosKernel, cosSupported>(a, info.unary);
+        } break;
+
+        case Builtin::Floor: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::floor(a[i]);
+            }
+        } break;
+
+        case Builtin::Ceil: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::ceil(a[i]);
+            }
+        } break;
+
+        case Builtin::Trunc: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::trunc(a[i]);
+            }
+        } break;
+
+        case Builtin::Min: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::fmin(a[i], b[i]);
+            }
+        } break;
+
+        case Builtin::Max: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::fmax(a[i], b[i]);
+            }
+        } break;
+
+        default: {
+            if (info.arity == 1) {
+                for (size_t i = 0; i < BatchSize; i++) {
+                    a[i] = info.unary(a[i]);
+                }
+            } else {
+                for (size_t i = 0; i < BatchSize; i++) {
+                    a[i] = info.binary(a[i], b[i]);
+                }
+            }
+        } break;
+        }
+    }
+}
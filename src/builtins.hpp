@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_BUILTINS_HEADER
+#define MATHEX_BUILTINS_HEADER
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mathex {
+    // Math functions available in expressions with `Flags::Functions`.
+    enum class Builtin : std::uint32_t {
+        Abs,
+        Sqrt,
+        Cbrt,
+        Exp,
+        Log,
+        Log2,
+        Log10,
+        Sin,
+        Cos,
+        Tan,
+        Asin,
+        Acos,
+        Atan,
+        Sinh,
+        Cosh,
+        Tanh,
+        Floor,
+        Ceil,
+        Round,
+        Trunc,
+        Min,
+        Max,
+        Atan2,
+        Hypot,
+    };
+
+    // Name and implementation of built-in function from <cmath>.
+    struct BuiltinInfo {
+        const char *name;
+        std::uint32_t arity;
+        double (*unary)(double);          // Function of one argument, or null.
+        double (*binary)(double, double); // Function of two arguments, or null.
+    };
+
+    // Returns description of built-in function.
+    const BuiltinInfo &describe(Builtin builtin);
+
+    // Finds built-in function with given name, returns false if there is none.
+    bool findBuiltin(const char *name, size_t length, Builtin &builtin);
+
+    // Calls built-in function with `arity` arguments from `args`, giving the same result as <cmath>.
+    inline double call(Builtin builtin, const double *args) {
+        const BuiltinInfo &info = describe(builtin);
+        return info.arity == 1 ? info.unary(args[0]) : info.binary(args[0], args[1]);
+    }
+
+    // Writes partial derivatives of built-in function at `args`, where it has value `result`, into `partials`.
+    void differentiate(Builtin builtin, const double *args, double result, double *partials);
+
+    // Applies built-in function to blocks of `BatchSize` rows, writing results into `a`. Second block is only used by
+    // functions of two arguments. `exp`, `log`, `sin` and `cos` are computed by polynomials, which differ from <cmath>
+    // by at most `BuiltinUlps` units in the last place; other functions give the same results as <cmath>.
+    void applyBuiltin(Builtin builtin, double *a, const double *b);
+
+    // Maximum error of polynomial approximations used by `applyBuiltin`, in units in the last place.
+    constexpr double BuiltinUlps = 2;
+}
+
+#endif /* MATHEX_BUILTINS_HEADER */
@@ -0,0 +1,620 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "builtins.hpp"
+#include "mathex"
+#include "program.hpp"
+#include "symbols.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATHEX_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define MATHEX_MMAP 0
+#endif
+
+namespace mathex {
+    // File starts with a header, followed by an entry for each expression. Instructions, references and names of expressions
+    // come after them, at offsets from the start of the file given by the entries. Numbers are in byte order of the machine
+    // that wrote the file, and files written by a machine with different byte order are rejected.
+    static const char Magic[8] = {'m', 'a', 't', 'h', 'e', 'x', 'b', 'c'};
+    constexpr std::uint32_t Version = 1;
+    constexpr std::uint32_t ByteOrder = 0x01020304;
+
+    struct Header {
+        char magic[8];
+        std::uint64_t checksum;    // Hash of everything that follows it.
+        std::uint32_t version;     // Changes whenever layout of the file or meaning of instructions changes.
+        std::uint32_t order;       // `ByteOrder` in byte order of the machine that wrote the file.
+        std::uint32_t instruction; // Size of an instruction.
+        std::uint32_t count;       // Number of expressions.
+        std::uint64_t size;        // Size of the whole file.
+    };
+
+    struct Entry {
+        std::uint64_t code;       // Offset of instructions, aligned to their size.
+        std::uint64_t references; // Offset of references.
+        std::uint32_t length;     // Number of instructions.
+        std::uint32_t count;      // Number of references.
+        std::uint32_t flags;      // Flags of the config the expression was compiled with.
+        std::uint32_t reserved;
+    };
+
+    enum class Kind : std::uint32_t {
+        Variable, // Variable added by `addVariable`, `index` is its index in the program.
+        Slot,     // Variable declared by `declareVariable`, `index` is its slot.
+        Function, // Function added by `addFunction`, `index` is its index in the program.
+        Callback, // Function with fixed number of arguments, `index` is its index in the program.
+        Builtin,  // Built-in function, `index` is its number.
+    };
+
+    // Name that instructions refer to by index.
+    struct Reference {
+        std::uint64_t name;   // Offset of the name.
+        std::uint32_t length; // Length of the name.
+        Kind kind;
+        std::uint32_t index;
+        std::uint32_t arity; // Number of arguments of callbacks and built-in functions.
+    };
+
+    // Instructions are stored exactly as they are laid out in memory, so that they can be executed from the mapped file
+    static_assert(std::is_trivially_copyable<Instruction>::value && sizeof(Instruction) == 16 && alignof(Instruction) <= 8, "layout of instructions changed");
+
+    // https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function, taking 8 bytes at a time.
+    static std::uint64_t checksum(const unsigned char *data, size_t size) {
+        std::uint64_t hash = 14695981039346656037ull;
+        size_t i = 0;
+
+        for (; i + 8 <= size; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+            hash ^= hash >> 32;
+        }
+
+        for (; i < size; i++) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    // Returns whether `count` items of `size` bytes at `offset` lie within a file of `file` bytes.
+    static bool within(std::uint64_t offset, std::uint64_t count, std::uint64_t size, std::uint64_t file) {
+        return offset <= file && count <= (file - offset) / size;
+    }
+
+    // Appends bytes of value to the file, and returns their offset.
+    template <typename T>
+    static std::uint64_t append(std::vector<unsigned char> &file, const T *values, size_t count) {
+        size_t offset = file.size();
+        file.resize(offset + sizeof(T) * count);
+        std::memcpy(file.data() + offset, values, sizeof(T) * count);
+        return offset;
+    }
+
+    static void align(std::vector<unsigned char> &file, size_t alignment) {
+        file.resize((file.size() + alignment - 1) / alignment * alignment);
+    }
+
+    // Copies instruction without bytes that are not part of its value, so that files of the same expressions are the same.
+    static Instruction canonical(const Instruction &instruction) {
+        Instruction copy;
+        std::memset(&copy, 0, sizeof(copy));
+        copy.opcode = instruction.opcode;
+        copy.args = instruction.args;
+
+        if (instruction.opcode == Opcode::Constant || instruction.opcode == Opcode::PowInt) {
+            copy.constant = instruction.constant;
+        } else {
+            copy.index = instruction.index;
+        }
+
+        return copy;
+    }
+
+    // Appends instructions, references and names of the program to the file.
+    static void write(const Program &program, std::vector<unsigned char> &file, Entry &entry) {
+        std::vector<Reference> references;
+        std::vector<const std::string *> names;
+        std::vector<std::string> builtins;
+
+        auto reference = [&](Kind kind, std::uint32_t index, std::uint32_t arity, const std::string &name) {
+            Reference reference;
+            std::memset(&reference, 0, sizeof(reference));
+            reference.kind = kind;
+            reference.index = index;
+            reference.arity = arity;
+            references.push_back(reference);
+            names.push_back(&name);
+        };
+
+        for (size_t i = 0; i < program.variables.size(); i++) {
+            reference(Kind::Variable, (std::uint32_t)i, 0, program.variables[i].first);
+        }
+
+        for (const std::pair<std::string, std::uint32_t> &slot : program.slots) {
+            reference(Kind::Slot, slot.second, 0, slot.first);
+        }
+
+        for (size_t i = 0; i < program.functions.size(); i++) {
+            reference(Kind::Function, (std::uint32_t)i, 0, program.functions[i].first);
+        }
+
+        for (size_t i = 0; i < program.callbacks.size(); i++) {
+            reference(Kind::Callback, (std::uint32_t)i, program.callbacks[i].second.arity, program.callbacks[i].first);
+        }
+
+        // Built-in functions are stored by name as well, so that files stay valid when new ones are added
+        builtins.reserve(program.code.size());
+
+        for (const Instruction &instruction : program.code) {
+            if (instruction.opcode == Opcode::Builtin && std::none_of(references.begin(), references.end(), [&](const Reference &reference) {
+                    return reference.kind == Kind::Builtin && reference.index == instruction.index;
+                })) {
+                const BuiltinInfo &info = describe((Builtin)instruction.index);
+                builtins.push_back(info.name);
+                reference(Kind::Builtin, instruction.index, info.arity, builtins.back());
+            }
+        }
+
+        align(file, sizeof(Instruction));
+        entry.code = file.size();
+        entry.length = (std::uint32_t)program.code.size();
+        entry.count = (std::uint32_t)references.size();
+        entry.flags = (std::uint32_t)program.flags;
+
+        for (const Instruction &instruction : program.code) {
+            Instruction copy = canonical(instruction);
+            append(file, &copy, 1);
+        }
+
+        for (size_t i = 0; i < references.size(); i++) {
+            references[i].name = append(file, names[i]->data(), names[i]->size());
+            references[i].length = (std::uint32_t)names[i]->size();
+        }
+
+        align(file, alignof(Reference));
+        entry.references = append(file, references.data(), references.size());
+    }
+
+    Error Expression::save(const std::string &path, const std::vector<Expression> &expressions) {
+        std::vector<unsigned char> file(sizeof(Header) + sizeof(Entry) * expressions.size());
+        std::vector<Entry> entries(expressions.size());
+
+        for (size_t i = 0; i < expressions.size(); i++) {
+            if (!expressions[i].m_Program || expressions[i].m_Program->code.empty()) {
+                return Error::InvalidArgs;
+            }
+
+            std::memset(&entries[i], 0, sizeof(Entry));
+            write(*expressions[i].m_Program, file, entries[i]);
+        }
+
+        Header header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.order = ByteOrder;
+        header.instruction = sizeof(Instruction);
+        header.count = (std::uint32_t)expressions.size();
+        header.size = file.size();
+        header.checksum = 0;
+
+        std::memcpy(file.data(), &header, sizeof(header));
+        std::memcpy(file.data() + sizeof(Header), entries.data(), sizeof(Entry) * entries.size());
+        header.checksum = checksum(file.data() + offsetof(Header, version), file.size() - offsetof(Header, version));
+        std::memcpy(file.data(), &header, sizeof(header));
+
+        // Replacing the file instead of writing over it keeps mappings of the old file intact
+        std::string temporary = path + ".tmp";
+        std::FILE *stream = std::fopen(temporary.c_str(), "wb");
+
+        if (stream == nullptr) {
+            return Error::InvalidArgs;
+        }
+
+        bool written = std::fwrite(file.data(), 1, file.size(), stream) == file.size();
+        written = std::fclose(stream) == 0 && written;
+
+        if (written && std::rename(temporary.c_str(), path.c_str()) != 0) {
+            // Renaming over an existing file fails on some platforms
+            std::remove(path.c_str());
+            written = std::rename(temporary.c_str(), path.c_str()) == 0;
+        }
+
+        if (!written) {
+            std::remove(temporary.c_str());
+            return Error::InvalidArgs;
+        }
+
+        return Error::Success;
+    }
+
+    // Read-only contents of a file, mapped into memory where supported.
+    class Mapping {
+    public:
+        Mapping(const Mapping &) = delete;
+        Mapping &operator=(const Mapping &) = delete;
+
+        // Returns contents of the file, or null if it could not be read.
+        static std::shared_ptr<const Mapping> open(const std::string &path);
+
+        ~Mapping() {
+#if MATHEX_MMAP
+            munmap(const_cast<unsigned char *>(this->data), this->size);
+#endif
+        }
+
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+
+    private:
+        Mapping() = default;
+
+#if !MATHEX_MMAP
+        std::vector<std::uint64_t> m_Buffer; // Aligned for instructions.
+#endif
+    };
+
+#if MATHEX_MMAP
+    std::shared_ptr<const Mapping> Mapping::open(const std::string &path) {
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+
+        if (descriptor < 0) {
+            return nullptr;
+        }
+
+        struct stat status;
+        void *data = MAP_FAILED;
+
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+        }
+
+        close(descriptor);
+
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+
+        std::shared_ptr<Mapping> mapping(new Mapping());
+        mapping->data = static_cast<const unsigned char *>(data);
+        mapping->size = (size_t)status.st_size;
+        return mapping;
+    }
+#else
+    std::shared_ptr<const Mapping> Mapping::open(const std::string &path) {
+        std::FILE *stream = std::fopen(path.c_str(), "rb");
+
+        if (stream == nullptr) {
+            return nullptr;
+        }
+
+        std::shared_ptr<Mapping> mapping(new Mapping());
+        std::vector<unsigned char> chunk(1 << 16);
+        size_t read;
+
+        while ((read = std::fread(chunk.data(), 1, chunk.size(), stream)) > 0) {
+            mapping->m_Buffer.resize((mapping->size + read + 7) / 8);
+            std::memcpy(reinterpret_cast<unsigned char *>(mapping->m_Buffer.data()) + mapping->size, chunk.data(), read);
+            mapping->size += read;
+        }
+
+        bool failed = std::ferror(stream) != 0;
+        std::fclose(stream);
+
+        if (failed) {
+            return nullptr;
+        }
+
+        mapping->data = reinterpret_cast<const unsigned char *>(mapping->m_Buffer.data());
+        return mapping;
+    }
+#endif
+
+    // Builds program of an entry, looking up its references in the config. Checks every instruction, so that a program
+    // loaded from a damaged file cannot read outside of its stack, frame or tables.
+    static Error load(const Entry &entry, const std::shared_ptr<const Mapping> &mapping, const SymbolTable &symbols, Flags flags, Program &program) {
+        const unsigned char *data = mapping->data;
+        size_t size = mapping->size;
+
+        if (entry.length == 0 || entry.code % sizeof(Instruction) != 0 || !within(entry.code, entry.length, sizeof(Instruction), size) ||
+            !within(entry.references, entry.count, sizeof(Reference), size)) {
+            return Error::InvalidFormat;
+        }
+
+        if ((entry.flags & ~(std::uint32_t)flags) != 0) {
+            return Error::SyntaxError;
+        }
+
+        // Slots and built-in functions may have other numbers than when the program was saved
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> slots;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> builtins;
+        program.symbols.reserve(entry.count);
+
+        for (std::uint32_t i = 0; i < entry.count; i++) {
+            Reference reference;
+            std::memcpy(&reference, data + entry.references + i * sizeof(Reference), sizeof(reference));
+
+            if (reference.length == 0 || !within(reference.name, reference.length, 1, size)) {
+                return Error::InvalidFormat;
+            }
+
+            const char *name = reinterpret_cast<const char *>(data + reference.name);
+            std::string text(name, reference.length);
+
+            if (std::find(program.symbols.begin(), program.symbols.end(), text) == program.symbols.end()) {
+                program.symbols.push_back(text);
+            }
+
+            // Built-in functions are not hidden by config symbols, keeping the meaning the expression was compiled with
+            if (reference.kind == Kind::Builtin) {
+                Builtin builtin;
+
+                if (!findBuiltin(name, reference.length, builtin)) {
+                    return Error::Undefined;
+                }
+
+                if (describe(builtin).arity != reference.arity) {
+                    return Error::InvalidFormat;
+                }
+
+                builtins.push_back(std::make_pair(reference.index, (std::uint32_t)builtin));
+                continue;
+            }
+
+            const Symbol *fetched = symbols.find(name, reference.length);
+
+            if (fetched == nullptr) {
+                return Error::Undefined;
+            }
+
+            const Token &token = *fetched->token;
+
+            switch (reference.kind) {
+            case Kind::Variable: {
+                if (reference.index != program.variables.size()) {
+                    return Error::InvalidFormat;
+                }
+
+                if (token.type != TokenType::Variable) {
+                    return Error::Undefined;
+                }
+
+                program.variables.push_back(std::make_pair(text, token.data.variable));
+            } break;
+
+            case Kind::Slot: {
+                if (token.type != TokenType::Slot) {
+                    return Error::Undefined;
+                }
+
+                slots.push_back(std::make_pair(reference.index, token.data.slot));
+                program.slots.push_back(std::make_pair(text, token.data.slot));
+                program.frame = std::max(program.frame, token.data.slot + 1);
+            } break;
+
+            case Kind::Function: {
+                if (reference.index != program.functions.size()) {
+                    return Error::InvalidFormat;
+                }
+
+                if (token.type != TokenType::Function) {
+                    return Error::Undefined;
+                }
+
+                program.functions.push_back(std::make_pair(text, token.data.function));
+                program.derivatives.push_back(token.derivative);
+                program.memos.push_back(token.memo);
+            } break;
+
+            case Kind::Callback: {
+                if (reference.index != program.callbacks.size()) {
+                    return Error::InvalidFormat;
+                }
+
+                if (token.type != TokenType::Callback) {
+                    return Error::Undefined;
+                }
+
+                if (token.data.callback.arity != reference.arity) {
+                    return Error::IncorrectArgsNum;
+                }
+
+                program.callbacks.push_back(std::make_pair(text, token.data.callback));
+                program.callbackMemos.push_back(token.memo);
+            } break;
+
+            default: {
+                return Error::InvalidFormat;
+            } break;
+            }
+        }
+
+        auto renumber = [](const std::vector<std::pair<std::uint32_t, std::uint32_t>> &numbers, std::uint32_t number, std::uint32_t &result) {
+            auto fetched = std::find_if(numbers.begin(), numbers.end(), [&](const std::pair<std::uint32_t, std::uint32_t> &pair) { return pair.first == number; });
+
+            if (fetched == numbers.end()) {
+                return false;
+            }
+
+            result = fetched->second;
+            return true;
+        };
+
+        const Instruction *code = reinterpret_cast<const Instruction *>(data + entry.code);
+        bool renumbered = false;
+
+        for (std::uint32_t i = 0; i < entry.length; i++) {
+            const Instruction &instruction = code[i];
+            std::uint32_t number = 0;
+
+            switch (instruction.opcode) {
+            case Opcode::Constant:
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Pow:
+            case Opcode::Mod:
+            case Opcode::Pos:
+            case Opcode::Neg:
+            case Opcode::Less:
+            case Opcode::LessEqual:
+            case Opcode::Greater:
+            case Opcode::GreaterEqual:
+            case Opcode::Equal:
+            case Opcode::NotEqual:
+            case Opcode::Not:
+            case Opcode::Condition:
+            case Opcode::Else:
+            case Opcode::Select:
+                break;
+
+            case Opcode::PowInt: {
+                // Same exponents as the optimizer produces, as the number of multiplications depends on it
+                double exponent = instruction.constant;
+
+                if (!(exponent == std::trunc(exponent) && std::fabs(exponent) <= 64 && exponent != 0)) {
+                    return Error::InvalidFormat;
+                }
+            } break;
+
+            case Opcode::Variable: {
+                if (instruction.index >= program.variables.size()) {
+                    return Error::InvalidFormat;
+                }
+            } break;
+
+            case Opcode::Slot: {
+                if (!renumber(slots, instruction.index, number)) {
+                    return Error::InvalidFormat;
+                }
+
+                renumbered = renumbered || number != instruction.index;
+            } break;
+
+            case Opcode::Function: {
+                if (instruction.index >= program.functions.size()) {
+                    return Error::InvalidFormat;
+                }
+            } break;
+
+            case Opcode::Call: {
+                if (instruction.index >= program.callbacks.size() || instruction.args != program.callbacks[instruction.index].second.arity) {
+                    return Error::InvalidFormat;
+                }
+            } break;
+
+            case Opcode::Builtin: {
+                if (!renumber(builtins, instruction.index, number) || instruction.args != describe((Builtin)number).arity) {
+                    return Error::InvalidFormat;
+                }
+
+                renumbered = renumbered || number != instruction.index;
+            } break;
+
+            default: {
+                return Error::InvalidFormat;
+            } break;
+            }
+        }
+
+        // Stack never underflows, and jumps only go to the branches of conditionals they belong to
+        if (!measure(Code(code, entry.length, mapping), program.depth)) {
+            return Error::InvalidFormat;
+        }
+
+        program.flags = (Flags)entry.flags;
+
+        if (!renumbered) {
+            program.code = Code(code, entry.length, mapping);
+            return Error::Success;
+        }
+
+        std::vector<Instruction> copy(code, code + entry.length);
+
+        for (Instruction &instruction : copy) {
+            if (instruction.opcode == Opcode::Slot) {
+                renumber(slots, instruction.index, instruction.index);
+            } else if (instruction.opcode == Opcode::Builtin) {
+                renumber(builtins, instruction.index, instruction.index);
+            }
+        }
+
+        program.code = std::move(copy);
+        return Error::Success;
+    }
+
+    Error Config::load(const std::string &path, std::vector<Expression> &expressions) {
+        std::shared_ptr<const Mapping> mapping = Mapping::open(path);
+
+        if (!mapping || mapping->size < sizeof(Header)) {
+            return Error::InvalidFormat;
+        }
+
+        Header header;
+        std::memcpy(&header, mapping->data, sizeof(header));
+
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.order != ByteOrder ||
+            header.instruction != sizeof(Instruction) || header.size != mapping->size ||
+            !within(sizeof(Header), header.count, sizeof(Entry), mapping->size) ||
+            header.checksum != checksum(mapping->data + offsetof(Header, version), mapping->size - offsetof(Header, version))) {
+            return Error::InvalidFormat;
+        }
+
+        Snapshot snapshot(*this->m_Symbols);
+        std::vector<Expression> loaded(header.count);
+
+        for (std::uint32_t i = 0; i < header.count; i++) {
+            Entry entry;
+            std::memcpy(&entry, mapping->data + sizeof(Header) + i * sizeof(Entry), sizeof(entry));
+
+            std::shared_ptr<Program> program = std::make_shared<Program>();
+            Error error = mathex::load(entry, mapping, snapshot.symbols(), this->m_Flags, *program);
+
+            if (error != Error::Success) {
+                return error;
+            }
+
+            loaded[i].m_Program = std::move(program);
+        }
+
+        expressions = std::move(loaded);
+        return Error::Success;
+    }
+}
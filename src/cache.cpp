@@ -0,0 +1,96 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "cache.hpp"
+#include "mathex"
+#include "program.hpp"
+#include <algorithm>
+
+namespace mathex {
+    Cache::Cache(size_t capacity) : capacity(capacity), hits(0), misses(0), m_Version(0) {}
+
+    std::shared_ptr<const Program> Cache::find(const std::string &expression, Flags flags, Optimization optimization) {
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        auto fetched = this->m_Index.find(expression);
+
+        // Only one program is kept for each expression, since
+        // it is unlikely to be used with different parameters
+        if (fetched == this->m_Index.end() || fetched->second->flags != flags || fetched->second->optimization != optimization) {
+            this->misses++;
+            return nullptr;
+        }
+
+        // Move entry to the front of the list
+        this->m_Entries.splice(this->m_Entries.begin(), this->m_Entries, fetched->second);
+        this->hits++;
+
+        return fetched->second->program;
+    }
+
+    void Cache::insert(const std::string &expression, Flags flags, Optimization optimization, std::shared_ptr<const Program> program, std::uint64_t version) {
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+
+        if (this->capacity == 0 || version != this->m_Version) {
+            return;
+        }
+
+        auto fetched = this->m_Index.find(expression);
+
+        if (fetched != this->m_Index.end()) {
+            this->m_Entries.erase(fetched->second);
+            this->m_Index.erase(fetched);
+        }
+
+        this->m_Entries.push_front({expression, flags, optimization, std::move(program)});
+        this->m_Index[expression] = this->m_Entries.begin();
+        this->evict();
+    }
+
+    void Cache::invalidate(const std::string &name, std::uint64_t version) {
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        this->m_Version = version;
+
+        for (auto entry = this->m_Entries.begin(); entry != this->m_Entries.end();) {
+            const std::vector<std::string> &symbols = entry->program->symbols;
+
+            if (std::find(symbols.begin(), symbols.end(), name) != symbols.end()) {
+                this->m_Index.erase(entry->expression);
+                entry = this->m_Entries.erase(entry);
+            } else {
+                entry++;
+            }
+        }
+    }
+
+    void Cache::resize(size_t capacity) {
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        this->capacity = capacity;
+        this->evict();
+    }
+
+    void Cache::evict() {
+        while (this->m_Entries.size() > capacity) {
+            this->m_Index.erase(this->m_Entries.back().expression);
+            this->m_Entries.pop_back();
+        }
+    }
+}
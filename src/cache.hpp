@@ -0,0 +1,75 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_CACHE_HEADER
+#define MATHEX_CACHE_HEADER
+
+#include "mathex"
+#include "program.hpp"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mathex {
+    // Thread-safe, all methods are guarded by one lock.
+    class Cache {
+    public:
+        Cache(size_t capacity);
+
+        // Returns cached program for given expression, or null if there is none.
+        std::shared_ptr<const Program> find(const std::string &expression, Flags flags, Optimization optimization);
+
+        // Inserts program parsed with symbols of given version into the cache, evicting least recently used programs if it is
+        // full. Program is not inserted if symbols were changed since then, as it could refer to removed identifiers.
+        void insert(const std::string &expression, Flags flags, Optimization optimization, std::shared_ptr<const Program> program, std::uint64_t version);
+
+        // Removes all programs that use identifier with given name, after symbols were changed to given version.
+        void invalidate(const std::string &name, std::uint64_t version);
+
+        void resize(size_t capacity);
+
+        std::atomic<size_t> capacity;
+        std::atomic<size_t> hits;
+        std::atomic<size_t> misses;
+
+    private:
+        struct Entry {
+            std::string expression;
+            Flags flags;
+            Optimization optimization;
+            std::shared_ptr<const Program> program;
+        };
+
+        void evict();
+
+        std::mutex m_Mutex;
+        std::uint64_t m_Version;    // Version of symbols that programs in the cache were parsed with.
+        std::list<Entry> m_Entries; // Most recently used first.
+        std::unordered_map<std::string, std::list<Entry>::iterator> m_Index;
+    };
+}
+
+#endif /* MATHEX_CACHE_HEADER */
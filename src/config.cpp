@@ -20,60 +20,204 @@
   THE SOFTWARE.
 */
 
+#include "cache.hpp"
 #include "mathex"
+#include "memo.hpp"
+#include "stats.hpp"
+#include "symbols.hpp"
 #include "token.hpp"
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
-#include <type_traits>
+#include <utility>
 
 namespace mathex {
-    Config::Config(Flags flags /* = DefaultFlags */) : m_Flags(flags) {}
+    // Throws if name cannot be used in expressions.
+    static void validate(const std::string &name) {
+        if (name.empty() || isdigit(name[0]) || !std::all_of(name.begin(), name.end(), [](const char &c) { return isalnum(c) || c == '_'; })) {
+            throw std::invalid_argument(name);
+        }
+    }
+
+    // Creates memo of pure function, or null for impure function.
+    static std::shared_ptr<Memo> memoize(Purity purity, size_t memo) {
+        if (purity != Purity::Pure) {
+            if (memo > 0) {
+                throw std::invalid_argument("results of impure function cannot be remembered");
+            }
+
+            return nullptr;
+        }
+
+        return std::make_shared<Memo>(memo);
+    }
+
+    // Function with fixed number of arguments whose results are remembered by its memo.
+    struct Memoized {
+        Callback callback;
+        std::shared_ptr<Memo> memo;
+
+        static double invoke(const void *state, const double *args) {
+            const Memoized &memoized = *static_cast<const Memoized *>(state);
+            const Callback &callback = memoized.callback;
+            return memoized.memo->call(callback.invoke, callback.state.get(), callback.arity, args);
+        }
+    };
+
+    // Finds memo of pure function with given name, or null if there is none.
+    static std::shared_ptr<Memo> findMemo(Registry &symbols, const std::string &name) {
+        std::lock_guard<std::mutex> lock(symbols.mutex);
+        auto fetched = symbols.tokens.find(name);
+
+        if (fetched == symbols.tokens.end()) {
+            return nullptr;
+        }
+
+        return fetched->second->memo;
+    }
+
+    Config::Config(Flags flags /* = DefaultFlags */) : m_Flags(flags), m_Symbols(new Registry()), m_Cache(new Cache(0)), m_Stats(new Recorder()) {}
 
     Config::~Config() {}
 
     void Config::addVariable(const std::string &name, const double &value) {
-        if (name.empty() || isdigit(name[0]) || !std::all_of(name.begin(), name.end(), [](const char &c) { return isalnum(c) || c == '_'; })) {
-            throw std::invalid_argument(name);
-        }
+        this->define(name, std::make_shared<const Token>(&value));
+    }
+
+    size_t Config::declareVariable(const std::string &name) {
+        validate(name);
+
+        Tables unused; // Destroyed outside of the lock.
+        std::lock_guard<std::mutex> lock(this->m_Symbols->mutex);
 
-        if (this->m_Tokens.find(name) != this->m_Tokens.end()) {
+        if (this->m_Symbols->tokens.find(name) != this->m_Symbols->tokens.end()) {
             throw AlreadyDefined(name);
         }
 
-        this->m_Tokens[name] = std::unique_ptr<Token>(new Token(&value));
+        // Slots are never reused, so frames laid out for removed variables stay valid
+        std::uint32_t slot = this->m_Symbols->slots++;
+        this->m_Symbols->tokens[name] = std::make_shared<const Token>(slot);
+        this->m_Symbols->publish(unused);
+        this->m_Cache->invalidate(name, this->m_Symbols->version);
+        return slot;
+    }
+
+    size_t Config::frameSize() const {
+        std::lock_guard<std::mutex> lock(this->m_Symbols->mutex);
+        return this->m_Symbols->slots;
     }
 
     void Config::addConstant(const std::string &name, double value) {
-        if (name.empty() || isdigit(name[0]) || !std::all_of(name.begin(), name.end(), [](const char &c) { return isalnum(c) || c == '_'; })) {
-            throw std::invalid_argument(name);
+        this->define(name, std::make_shared<const Token>(value));
+    }
+
+    void Config::addFunction(const std::string &name, Function apply) {
+        this->define(name, std::make_shared<const Token>(apply));
+    }
+
+    void Config::addFunction(const std::string &name, Function apply, Derivative derivative) {
+        this->define(name, std::make_shared<const Token>(apply, derivative));
+    }
+
+    void Config::addFunction(const std::string &name, Function apply, Purity purity, size_t memo /* = 0 */) {
+        this->addFunction(name, std::move(apply), nullptr, purity, memo);
+    }
+
+    void Config::addFunction(const std::string &name, Function apply, Derivative derivative, Purity purity, size_t memo /* = 0 */) {
+        std::shared_ptr<Memo> memoized = memoize(purity, memo);
+
+        if (memo > 0) {
+            Function function = std::move(apply);
+            apply = [memoized, function](double args[], int argc, double &result) { return memoized->call(function, args, argc, result); };
         }
 
-        if (this->m_Tokens.find(name) != this->m_Tokens.end()) {
-            throw AlreadyDefined(name);
+        this->define(name, std::make_shared<const Token>(apply, derivative, memoized));
+    }
+
+    bool Config::remove(const std::string &name) {
+        std::shared_ptr<const Token> removed; // Destroyed outside of the lock.
+        Tables unused;
+        std::lock_guard<std::mutex> lock(this->m_Symbols->mutex);
+        auto fetched = this->m_Symbols->tokens.find(name);
+
+        if (fetched == this->m_Symbols->tokens.end()) {
+            return false;
         }
 
-        this->m_Tokens[name] = std::unique_ptr<Token>(new Token(value));
+        removed = std::move(fetched->second);
+        this->m_Symbols->tokens.erase(fetched);
+        this->m_Symbols->publish(unused);
+        this->m_Cache->invalidate(name, this->m_Symbols->version);
+        return true;
     }
 
-    void Config::addFunction(const std::string &name, Function apply) {
-        if (name.empty() || isdigit(name[0]) || !std::all_of(name.begin(), name.end(), [](const char &c) { return isalnum(c) || c == '_'; })) {
-            throw std::invalid_argument(name);
+    void Config::define(const std::string &name, std::uint32_t arity, detail::Invoke invoke, detail::Address address, std::shared_ptr<const void> state,
+                        Purity purity /* = Purity::Impure */, size_t memo /* = 0 */) {
+        Callback callback{arity, invoke, address, std::move(state)};
+        std::shared_ptr<Memo> memoized = memoize(purity, memo);
+
+        // Remembered results are found before calling the function, so it is never called directly
+        if (memo > 0) {
+            callback.state = std::make_shared<Memoized>(Memoized{callback, memoized});
+            callback.invoke = &Memoized::invoke;
+            callback.address = nullptr;
         }
 
-        if (this->m_Tokens.find(name) != this->m_Tokens.end()) {
+        this->define(name, std::make_shared<const Token>(std::move(callback), std::move(memoized)));
+    }
+
+    void Config::define(const std::string &name, std::shared_ptr<const Token> token) {
+        validate(name);
+
+        Tables unused; // Destroyed outside of the lock.
+        std::lock_guard<std::mutex> lock(this->m_Symbols->mutex);
+
+        if (this->m_Symbols->tokens.find(name) != this->m_Symbols->tokens.end()) {
             throw AlreadyDefined(name);
         }
 
-        this->m_Tokens[name] = std::unique_ptr<Token>(new Token(apply));
+        this->m_Symbols->tokens[name] = std::move(token);
+        this->m_Symbols->publish(unused);
+        this->m_Cache->invalidate(name, this->m_Symbols->version);
     }
 
-    bool Config::remove(const std::string &name) {
-        return this->m_Tokens.erase(name) > 0;
+    void Config::setCacheCapacity(size_t capacity) {
+        this->m_Cache->resize(capacity);
+    }
+
+    size_t Config::cacheHits() const {
+        return this->m_Cache->hits;
+    }
+
+    size_t Config::cacheMisses() const {
+        return this->m_Cache->misses;
+    }
+
+    size_t Config::memoHits(const std::string &name) const {
+        std::shared_ptr<Memo> memo = findMemo(*this->m_Symbols, name);
+        return memo && memo->capacity > 0 ? (size_t)memo->hits : 0;
+    }
+
+    size_t Config::memoMisses(const std::string &name) const {
+        std::shared_ptr<Memo> memo = findMemo(*this->m_Symbols, name);
+        return memo && memo->capacity > 0 ? (size_t)memo->misses : 0;
+    }
+
+    void Config::enableStatistics(bool enabled /* = true */) {
+        this->m_Stats->enable(enabled);
+    }
+
+    Statistics Config::statistics() const {
+        Statistics statistics;
+        this->m_Stats->collect(statistics);
+        statistics.memory = this->m_Symbols->memory();
+        return statistics;
     }
 
-    bool Config::readFlag(Flags flag) {
-        return static_cast<Flags>(static_cast<std::underlying_type<Flags>::type>(this->m_Flags) & static_cast<std::underlying_type<Flags>::type>(flag)) != Flags::None;
+    void Config::resetStatistics() {
+        this->m_Stats->reset();
     }
 }
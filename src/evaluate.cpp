@@ -20,17 +20,26 @@
   THE SOFTWARE.
 */
 
+#include "builtins.hpp"
+#include "cache.hpp"
 #include "mathex"
+#include "number.hpp"
+#include "parser.hpp"
+#include "program.hpp"
+#include "stats.hpp"
+#include "symbols.hpp"
+#include "term.hpp"
 #include "token.hpp"
+#include <algorithm>
 #include <cctype>
 #include <cmath>
-#include <memory>
-#include <queue>
 #include <stack>
+#include <utility>
+#include <vector>
 
 #define OPERAND_EXPECTED (last_token == TokenType::None || last_token == TokenType::LeftParenthesis || last_token == TokenType::Comma || last_token == TokenType::BinaryOperator || last_token == TokenType::UnaryOperator)
 #define UNARY_OPERATOR_EXPECTED (last_token == TokenType::None || last_token == TokenType::LeftParenthesis || last_token == TokenType::Comma || last_token == TokenType::UnaryOperator)
-#define BINARY_OPERATOR_EXPECTED (last_token == TokenType::Constant || last_token == TokenType::Variable || last_token == TokenType::RightParenthesis)
+#define BINARY_OPERATOR_EXPECTED (last_token == TokenType::Constant || last_token == TokenType::Variable || last_token == TokenType::Slot || last_token == TokenType::RightParenthesis)
 
 namespace mathex {
     enum class States {
@@ -41,38 +50,78 @@ namespace mathex {
     };
 
     Error Config::evaluate(const std::string &expression, double &result) {
-        // https://en.wikipedia.org/wiki/Shunting_yard_algorithm#The_algorithm_in_detail
+        Counters *counters = this->m_Stats->counters();
+        Error error;
 
-        TokenType last_token = TokenType::None;
+        if (this->m_Cache->capacity > 0) {
+            Expression compiled;
+            error = this->compile(expression, compiled);
+
+            if (error == Error::Success) {
+                Stopwatch stopwatch(counters);
+                error = compiled.evaluate(result);
+                stopwatch.lap(Phase::Execute);
+            }
+        } else {
+            Snapshot snapshot(*this->m_Symbols);
+            Program program;
+            error = this->parse(expression, snapshot.symbols(), program);
+
+            if (error == Error::Success) {
+                Stopwatch stopwatch(counters);
+                error = execute(program, result);
+                stopwatch.lap(Phase::Execute);
+            }
+        }
+
+        if (counters) {
+            counters->evaluated(error);
+        }
 
-        std::stack<Token> ops_stack;
-        std::queue<Token> out_queue;
-        std::stack<double> res_stack;
+        return error;
+    }
+
+    Error Config::evaluate(const Term &term, double &result) {
+        Counters *counters = this->m_Stats->counters();
+        Error error;
+
+        if (this->m_Cache->capacity > 0) {
+            Expression compiled;
+            error = this->compile(term, compiled);
+
+            if (error == Error::Success) {
+                Stopwatch stopwatch(counters);
+                error = compiled.evaluate(result);
+                stopwatch.lap(Phase::Execute);
+            }
+        } else {
+            Snapshot snapshot(*this->m_Symbols);
+            Program program;
+            error = this->parse(term, snapshot.symbols(), program);
+
+            if (error == Error::Success) {
+                Stopwatch stopwatch(counters);
+                error = execute(program, result);
+                stopwatch.lap(Phase::Execute);
+            }
+        }
 
-        int arg_count = 0;
-        std::stack<int> arg_stack;
-        std::queue<int> arg_queue;
+        if (counters) {
+            counters->evaluated(error);
+        }
 
+        return error;
+    }
+
+    void lex(const std::string &expression, Flags flags, std::vector<Lexeme> &lexemes) {
         for (size_t i = 0; i < expression.length(); i++) {
             if (expression[i] == ' ') {
                 continue;
             }
 
             if (isdigit(expression[i]) || expression[i] == '.') {
-                // Two operands in a row are not allowed
-                // Operand should only either be first in expression or right after operator
-                if (!OPERAND_EXPECTED) {
-                    return Error::SyntaxError;
-                }
-
-                if (arg_count == 0) {
-                    arg_count++;
-                }
-
-                double value = 0;
-                double decimal_place = 10;
-                double exponent = 0;
-                bool exponent_sign = true;
+                Decimal decimal;
+                size_t mantissa_end = expression.length(); // End of the literal before scientific notation separator.
 
                 States state = States::INTEGER_PART;
                 size_t j;
@@ -81,7 +130,7 @@ namespace mathex {
                     switch (state) {
                     case States::INTEGER_PART: {
                         if (isdigit(expression[j])) {
-                            value = (value * 10) + (double)(expression[j] - '0');
+                            decimal.digit(expression[j], false);
                             continue;
                         }
 
@@ -90,42 +139,45 @@ namespace mathex {
                             continue;
                         }
 
-                        if ((expression[j] == 'e' || expression[j] == 'E') && this->readFlag(Flags::ScientificNotation)) {
+                        if ((expression[j] == 'e' || expression[j] == 'E') && readFlag(flags, Flags::ScientificNotation)) {
                             state = States::EXP_START;
+                            mantissa_end = j;
                             continue;
                         }
                     } break;
 
                     case States::FRACTION_PART: {
                         if (expression[j] == '.') {
-                            return Error::SyntaxError;
+                            lexemes.push_back(Lexeme{LexemeType::Invalid, 0, i, j + 1 - i, 0});
+                            return;
                         }
 
                         if (isdigit(expression[j])) {
-                            value += (double)(expression[j] - '0') / decimal_place;
-                            decimal_place *= 10;
+                            decimal.digit(expression[j], true);
                             continue;
                         }
 
-                        if ((expression[j] == 'e' || expression[j] == 'E') && this->readFlag(Flags::ScientificNotation)) {
+                        if ((expression[j] == 'e' || expression[j] == 'E') && readFlag(flags, Flags::ScientificNotation)) {
                             state = States::EXP_START;
+                            mantissa_end = j;
                             continue;
                         }
                     } break;
 
                     case States::EXP_START: {
                         if (expression[j] == '.') {
-                            return Error::SyntaxError;
+                            lexemes.push_back(Lexeme{LexemeType::Invalid, 0, i, j + 1 - i, 0});
+                            return;
                         }
 
                         if (isdigit(expression[j])) {
-                            exponent = (exponent * 10) + (double)(expression[j] - '0');
+                            decimal.exponentDigit(expression[j]);
                             state = States::EXP_VALUE;
                             continue;
                         }
 
                         if (expression[j] == '+' || expression[j] == '-') {
-                            exponent_sign = (expression[j] == '+');
+                            decimal.exponentSign(expression[j] == '-');
                             state = States::EXP_VALUE;
                             continue;
                         }
@@ -133,11 +185,12 @@ namespace mathex {
 
                     case States::EXP_VALUE: {
                         if (expression[j] == '.') {
-                            return Error::SyntaxError;
+                            lexemes.push_back(Lexeme{LexemeType::Invalid, 0, i, j + 1 - i, 0});
+                            return;
                         }
 
                         if (isdigit(expression[j])) {
-                            exponent = (exponent * 10) + (double)(expression[j] - '0');
+                            decimal.exponentDigit(expression[j]);
                             state = States::EXP_VALUE;
                             continue;
                         }
@@ -155,27 +208,252 @@ namespace mathex {
 
                 // ".1" => 0.1 and "1." => 1.0 but "." != 0.0
                 if (j - i == 1 && expression[i] == '.') {
-                    return Error::SyntaxError;
+                    lexemes.push_back(Lexeme{LexemeType::Invalid, 0, i, 1, 0});
+                    return;
+                }
+
+                double value = decimal.value(expression.data() + i, std::min(j, mantissa_end) - i);
+                lexemes.push_back(Lexeme{LexemeType::Number, 0, i, j - i, value});
+                i = j - 1;
+                continue;
+            }
+
+            if (isalpha(expression[i]) || expression[i] == '_') {
+                size_t j;
+
+                for (j = i + 1; j < expression.length(); j++) {
+                    if (!isalnum(expression[j]) && expression[j] != '_') {
+                        break;
+                    }
+                }
+
+                lexemes.push_back(Lexeme{LexemeType::Identifier, 0, i, j - i, 0});
+                i = j - 1;
+                continue;
+            }
+
+            switch (expression[i]) {
+            case '+':
+            case '-':
+            case '*':
+            case '/':
+            case '^':
+            case '%':
+            case '(':
+            case ')':
+            case ',': {
+                lexemes.push_back(Lexeme{LexemeType::Symbol, expression[i], i, 1, 0});
+            } break;
+
+            case '<':
+            case '>':
+            case '!': {
+                // Either alone or followed by `=`
+                size_t length = i + 1 < expression.length() && expression[i + 1] == '=' ? 2 : 1;
+                lexemes.push_back(Lexeme{LexemeType::Symbol, expression[i], i, length, 0});
+                i += length - 1;
+            } break;
+
+            case '=':
+            case '&':
+            case '|': {
+                // Only valid doubled, as `==`, `&&` and `||`
+                if (i + 1 == expression.length() || expression[i + 1] != expression[i]) {
+                    lexemes.push_back(Lexeme{LexemeType::Invalid, 0, i, 1, 0});
+                    return;
                 }
 
-                if (exponent != 0) {
-                    value *= std::pow(exponent_sign ? 10.0 : 0.1, exponent);
+                lexemes.push_back(Lexeme{LexemeType::Symbol, expression[i], i, 2, 0});
+                i++;
+            } break;
+
+            default: {
+                // Any character that was not captured by previous checks is considered invalid
+                lexemes.push_back(Lexeme{LexemeType::Invalid, 0, i, 1, 0});
+                return;
+            }
+            }
+        }
+    }
+
+    double detail::convertNumber(const char *literal, size_t length) {
+        std::vector<Lexeme> lexemes;
+        lex(std::string(literal, length), Flags::ScientificNotation, lexemes);
+        return lexemes.empty() || lexemes[0].type != LexemeType::Number ? std::nan("") : lexemes[0].value;
+    }
+
+    // Entry of the operator stack.
+    struct Pending {
+        Pending(TokenType type, Operator op = Operator(), std::uint32_t function = 0, bool call = false) : type(type), op(op), function(function), call(call) {}
+
+        TokenType type;
+        Operator op;            // Operator, if `type` is binary or unary operator.
+        std::uint32_t function; // Index of function in the program, if `type` is function or callback.
+                                // Nonzero if `type` is left parenthesis of a conditional.
+        bool call;              // Whether `type` is left parenthesis of a function call.
+    };
+
+    // Checks whether pending entry is a function waiting for its arguments.
+    static bool isCall(TokenType type) {
+        return type == TokenType::Function || type == TokenType::Callback || type == TokenType::Builtin || type == TokenType::Conditional;
+    }
+
+    // Emits operator taken from the operator stack.
+    static void emitOperator(const Operator &op, Code &code) {
+        if (op.opcode == Opcode::Select) {
+            // Right operand of logical operator is the last branch, which gives 1 unless it is zero
+            code.push_back(Instruction(0.0));
+            code.push_back(Instruction(Opcode::NotEqual));
+        }
+
+        code.push_back(Instruction(op.opcode));
+    }
+
+    // Emits call of pending function with given number of arguments, checking it for functions with fixed number of arguments.
+    static Error emitCall(const Pending &pending, std::uint32_t args, Program &program) {
+        switch (pending.type) {
+        case TokenType::Callback: {
+            if (args != program.callbacks[pending.function].second.arity) {
+                return Error::IncorrectArgsNum;
+            }
+
+            program.code.push_back(Instruction(Opcode::Call, pending.function, args));
+        } break;
+
+        case TokenType::Builtin: {
+            if (args != describe((Builtin)pending.function).arity) {
+                return Error::IncorrectArgsNum;
+            }
+
+            program.code.push_back(Instruction(Opcode::Builtin, pending.function, args));
+        } break;
+
+        case TokenType::Conditional: {
+            if (args != 3) {
+                return Error::IncorrectArgsNum;
+            }
+
+            program.code.push_back(Instruction(Opcode::Select));
+        } break;
+
+        default: {
+            program.code.push_back(Instruction(Opcode::Function, pending.function, args));
+        } break;
+        }
+
+        return Error::Success;
+    }
+
+    // Records name used by the program, so that defining or removing it invalidates the program in the cache.
+    static void useSymbol(const std::string &name, Program &program) {
+        if (std::find(program.symbols.begin(), program.symbols.end(), name) == program.symbols.end()) {
+            program.symbols.push_back(name);
+        }
+    }
+
+    // Returns index of function in the program, adding it on its first use.
+    static std::uint32_t useFunction(const Symbol &symbol, Program &program) {
+        std::uint32_t index = 0;
+
+        while (index < program.functions.size() && program.functions[index].first != *symbol.name) {
+            index++;
+        }
+
+        if (index == program.functions.size()) {
+            program.functions.push_back(std::make_pair(*symbol.name, symbol.token->data.function));
+            program.derivatives.push_back(symbol.token->derivative);
+            program.memos.push_back(symbol.token->memo);
+        }
+
+        return index;
+    }
+
+    static std::uint32_t useCallback(const Symbol &symbol, Program &program) {
+        std::uint32_t index = 0;
+
+        while (index < program.callbacks.size() && program.callbacks[index].first != *symbol.name) {
+            index++;
+        }
+
+        if (index == program.callbacks.size()) {
+            program.callbacks.push_back(std::make_pair(*symbol.name, symbol.token->data.callback));
+            program.callbackMemos.push_back(symbol.token->memo);
+        }
+
+        return index;
+    }
+
+    // Emits value of variable, declared variable or constant.
+    static void emitValue(const Symbol &symbol, Program &program) {
+        switch (symbol.token->type) {
+        case TokenType::Variable: {
+            std::uint32_t index = 0;
+
+            while (index < program.variables.size() && program.variables[index].first != *symbol.name) {
+                index++;
+            }
+
+            if (index == program.variables.size()) {
+                program.variables.push_back(std::make_pair(*symbol.name, symbol.token->data.variable));
+            }
+
+            program.code.push_back(Instruction(Opcode::Variable, index));
+        } break;
+
+        case TokenType::Slot: {
+            if (std::find_if(program.slots.begin(), program.slots.end(), [&](const std::pair<std::string, std::uint32_t> &slot) { return slot.first == *symbol.name; }) == program.slots.end()) {
+                program.slots.push_back(std::make_pair(*symbol.name, symbol.token->data.slot));
+            }
+
+            program.frame = std::max(program.frame, symbol.token->data.slot + 1);
+            program.code.push_back(Instruction(Opcode::Slot, symbol.token->data.slot));
+        } break;
+
+        case TokenType::Constant: {
+            program.code.push_back(Instruction(symbol.token->data.constant));
+        } break;
+
+        default: {
+            // This clause should not be possible, since you can
+            // only insert variable or function into the config.
+        } break;
+        }
+    }
+
+    Error translate(const std::string &expression, const std::vector<Lexeme> &lexemes, const SymbolTable &symbols, Flags flags, Program &program) {
+        // https://en.wikipedia.org/wiki/Shunting_yard_algorithm#The_algorithm_in_detail
+
+        TokenType last_token = TokenType::None;
+
+        std::stack<Pending, std::vector<Pending>> ops_stack;
+        Code &out_queue = program.code;
+
+        std::uint32_t arg_count = 0;
+        std::stack<std::uint32_t, std::vector<std::uint32_t>> arg_stack;
+
+        for (const Lexeme &lexeme : lexemes) {
+            if (lexeme.type == LexemeType::Number) {
+                // Two operands in a row are not allowed
+                // Operand should only either be first in expression or right after operator
+                if (!OPERAND_EXPECTED) {
+                    return Error::SyntaxError;
                 }
 
-                Token token(value);
-                out_queue.push(token);
+                if (arg_count == 0) {
+                    arg_count++;
+                }
 
+                out_queue.push_back(Instruction(lexeme.value));
                 last_token = TokenType::Constant;
-                i = j - 1;
                 continue;
             }
 
-            if (isalpha(expression[i]) || expression[i] == '_') {
-                if (last_token == TokenType::Constant && this->readFlag(Flags::ImplicitMultiplication)) {
+            if (lexeme.type == LexemeType::Identifier) {
+                if (last_token == TokenType::Constant && readFlag(flags, Flags::ImplicitMultiplication)) {
                     // Implicit multiplication
                     while (!ops_stack.empty()) {
                         if (ops_stack.top().type == TokenType::BinaryOperator) {
-                            if (!(ops_stack.top().data.binaryOperator.precedence > MulToken.data.binaryOperator.precedence || (ops_stack.top().data.binaryOperator.precedence == MulToken.data.binaryOperator.precedence && MulToken.data.binaryOperator.leftAssociative))) {
+                            if (!(ops_stack.top().op.precedence > MulToken.precedence || (ops_stack.top().op.precedence == MulToken.precedence && MulToken.leftAssociative))) {
                                 break;
                             }
                         } else if (ops_stack.top().type != TokenType::UnaryOperator) {
@@ -183,11 +461,11 @@ namespace mathex {
                             break;
                         }
 
-                        out_queue.push(std::move(ops_stack.top()));
+                        emitOperator(ops_stack.top().op, out_queue);
                         ops_stack.pop();
                     }
 
-                    ops_stack.push(MulToken);
+                    ops_stack.push(Pending(MulToken.type, MulToken));
                 } else {
                     // Two operands in a row are not allowed
                     // Operand should only either be first in expression or right after operator
@@ -200,101 +478,156 @@ namespace mathex {
                     arg_count++;
                 }
 
-                size_t j;
+                size_t j = lexeme.start + lexeme.length;
+                const Symbol *fetched = symbols.find(expression.data() + lexeme.start, lexeme.length);
+                Builtin builtin;
 
-                for (j = i + 1; j < expression.length(); j++) {
-                    if (!isalnum(expression[j]) && expression[j] != '_') {
-                        break;
+                if (fetched == nullptr && readFlag(flags, Flags::Conditional) && expression.compare(lexeme.start, lexeme.length, "if") == 0) {
+                    if (expression[j] != '(') {
+                        return Error::SyntaxError;
                     }
+
+                    // Defining the name later hides the conditional, just like a built-in function
+                    useSymbol("if", program);
+
+                    ops_stack.push(Pending(TokenType::Conditional));
+                    last_token = TokenType::Conditional;
+                    continue;
                 }
 
-                auto fetched = this->m_Tokens.find(expression.substr(i, j - i));
+                if (fetched == nullptr && readFlag(flags, Flags::Functions) && findBuiltin(expression.data() + lexeme.start, lexeme.length, builtin)) {
+                    if (expression[j] != '(') {
+                        return Error::SyntaxError;
+                    }
+
+                    // Defining the name later hides the built-in function, so it is a symbol of the program as well
+                    useSymbol(expression.substr(lexeme.start, lexeme.length), program);
 
-                if (fetched == this->m_Tokens.end()) {
+                    ops_stack.push(Pending(TokenType::Builtin, Operator(), (std::uint32_t)builtin));
+                    last_token = TokenType::Builtin;
+                    continue;
+                }
+
+                if (fetched == nullptr) {
                     return Error::Undefined;
                 }
 
-                switch (fetched->second->type) {
+                useSymbol(*fetched->name, program);
+
+                switch (fetched->token->type) {
                 case TokenType::Function: {
                     if (expression[j] != '(') {
                         return Error::SyntaxError;
                     }
-                    ops_stack.push(*fetched->second);
+
+                    ops_stack.push(Pending(TokenType::Function, Operator(), useFunction(*fetched, program)));
                 } break;
 
-                case TokenType::Variable:
-                case TokenType::Constant: {
-                    out_queue.push(*fetched->second);
+                case TokenType::Callback: {
+                    if (expression[j] != '(') {
+                        return Error::SyntaxError;
+                    }
+
+                    ops_stack.push(Pending(TokenType::Callback, Operator(), useCallback(*fetched, program)));
                 } break;
 
                 default: {
-                    // This clause should not be possible, since you can
-                    // only insert variable or function into the config.
+                    emitValue(*fetched, program);
                 } break;
                 }
 
-                last_token = fetched->second->type;
-                i = j - 1;
+                last_token = fetched->token->type;
                 continue;
             }
 
-            const Token *token = nullptr;
+            if (lexeme.type == LexemeType::Invalid) {
+                return Error::SyntaxError;
+            }
+
+            const char symbol = lexeme.symbol;
+            const Operator *token = nullptr;
 
-            if (expression[i] == '+') {
-                if (this->readFlag(Flags::Addition) && BINARY_OPERATOR_EXPECTED) {
+            if (symbol == '+') {
+                if (readFlag(flags, Flags::Addition) && BINARY_OPERATOR_EXPECTED) {
                     // Used as binary operator
                     token = &AddToken;
-                } else if (this->readFlag(Flags::Identity) && UNARY_OPERATOR_EXPECTED) {
+                } else if (readFlag(flags, Flags::Identity) && UNARY_OPERATOR_EXPECTED) {
                     // Used as unary operator
                     token = &PosToken;
                 } else {
                     return Error::SyntaxError;
                 }
-            } else if (expression[i] == '-') {
-                if (this->readFlag(Flags::Substraction) && BINARY_OPERATOR_EXPECTED) {
+            } else if (symbol == '-') {
+                if (readFlag(flags, Flags::Substraction) && BINARY_OPERATOR_EXPECTED) {
                     // Used as binary operator
                     token = &SubToken;
-                } else if (this->readFlag(Flags::Negation) && UNARY_OPERATOR_EXPECTED) {
+                } else if (readFlag(flags, Flags::Negation) && UNARY_OPERATOR_EXPECTED) {
                     // Used as unary operator
                     token = &NegToken;
                 } else {
                     return Error::SyntaxError;
                 }
-            } else if (expression[i] == '*' && this->readFlag(Flags::Multiplication)) {
+            } else if (symbol == '*' && readFlag(flags, Flags::Multiplication)) {
                 // There should always be an operand on the left hand side of the operator
                 if (!BINARY_OPERATOR_EXPECTED) {
                     return Error::SyntaxError;
                 }
 
                 token = &MulToken;
-            } else if (expression[i] == '/' && this->readFlag(Flags::Division)) {
+            } else if (symbol == '/' && readFlag(flags, Flags::Division)) {
                 // There should always be an operand on the left hand side of the operator
                 if (!BINARY_OPERATOR_EXPECTED) {
                     return Error::SyntaxError;
                 }
 
                 token = &DivToken;
-            } else if (expression[i] == '^' && this->readFlag(Flags::Exponentiation)) {
+            } else if (symbol == '^' && readFlag(flags, Flags::Exponentiation)) {
                 // There should always be an operand on the left hand side of the operator
                 if (!BINARY_OPERATOR_EXPECTED) {
                     return Error::SyntaxError;
                 }
 
                 token = &PowToken;
-            } else if (expression[i] == '%' && this->readFlag(Flags::Modulus)) {
+            } else if (symbol == '%' && readFlag(flags, Flags::Modulus)) {
                 // There should always be an operand on the left hand side of the operator
                 if (!BINARY_OPERATOR_EXPECTED) {
                     return Error::SyntaxError;
                 }
 
                 token = &ModToken;
+            } else if ((symbol == '<' || symbol == '>' || symbol == '=' || (symbol == '!' && lexeme.length == 2)) && readFlag(flags, Flags::Comparison)) {
+                // There should always be an operand on the left hand side of the operator
+                if (!BINARY_OPERATOR_EXPECTED) {
+                    return Error::SyntaxError;
+                }
+
+                if (symbol == '<') {
+                    token = lexeme.length == 2 ? &LessEqualToken : &LessToken;
+                } else if (symbol == '>') {
+                    token = lexeme.length == 2 ? &GreaterEqualToken : &GreaterToken;
+                } else {
+                    token = symbol == '=' ? &EqualToken : &NotEqualToken;
+                }
+            } else if ((symbol == '&' || symbol == '|') && readFlag(flags, Flags::Logical)) {
+                // There should always be an operand on the left hand side of the operator
+                if (!BINARY_OPERATOR_EXPECTED) {
+                    return Error::SyntaxError;
+                }
+
+                token = symbol == '&' ? &AndToken : &OrToken;
+            } else if (symbol == '!' && lexeme.length == 1 && readFlag(flags, Flags::Logical)) {
+                if (!UNARY_OPERATOR_EXPECTED) {
+                    return Error::SyntaxError;
+                }
+
+                token = &NotToken;
             }
 
             if (token != nullptr) {
                 if (token->type == TokenType::BinaryOperator) {
                     while (!ops_stack.empty()) {
                         if (ops_stack.top().type == TokenType::BinaryOperator) {
-                            if (!(ops_stack.top().data.binaryOperator.precedence > token->data.binaryOperator.precedence || (ops_stack.top().data.binaryOperator.precedence == token->data.binaryOperator.precedence && token->data.binaryOperator.leftAssociative))) {
+                            if (!(ops_stack.top().op.precedence > token->precedence || (ops_stack.top().op.precedence == token->precedence && token->leftAssociative))) {
                                 break;
                             }
                         } else if (ops_stack.top().type != TokenType::UnaryOperator) {
@@ -302,18 +635,29 @@ namespace mathex {
                             break;
                         }
 
-                        out_queue.push(std::move(ops_stack.top()));
+                        emitOperator(ops_stack.top().op, out_queue);
                         ops_stack.pop();
                     }
                 }
 
-                ops_stack.push(*token);
+                // Left operand of logical operator is the condition, `a && b` => `if(!a, 0, b != 0)` and `a || b` => `if(a, 1, b != 0)`
+                if (token == &AndToken) {
+                    out_queue.push_back(Instruction(Opcode::Not));
+                }
+
+                if (token == &AndToken || token == &OrToken) {
+                    out_queue.push_back(Instruction(Opcode::Condition));
+                    out_queue.push_back(Instruction(token == &AndToken ? 0.0 : 1.0));
+                    out_queue.push_back(Instruction(Opcode::Else));
+                }
+
+                ops_stack.push(Pending(token->type, *token));
                 last_token = token->type;
                 continue;
             }
 
-            if (expression[i] == '(') {
-                if (last_token == TokenType::Function) {
+            if (symbol == '(') {
+                if (isCall(last_token)) {
                     arg_stack.push(arg_count);
                     arg_count = 0;
                 } else {
@@ -328,14 +672,13 @@ namespace mathex {
                     }
                 }
 
-                Token token(TokenType::LeftParenthesis);
-                ops_stack.push(token);
+                ops_stack.push(Pending(TokenType::LeftParenthesis, Operator(), last_token == TokenType::Conditional, isCall(last_token)));
 
                 last_token = TokenType::LeftParenthesis;
                 continue;
             }
 
-            if (expression[i] == ')') {
+            if (symbol == ')') {
                 // Empty expressions are not allowed
                 if (last_token == TokenType::None || last_token == TokenType::Comma) {
                     return Error::SyntaxError;
@@ -344,7 +687,7 @@ namespace mathex {
                 if (last_token != TokenType::LeftParenthesis) {
                     if (ops_stack.empty()) {
                         // Mismatched parenthesis (ignore if implicit parentheses are enabled)
-                        if (!this->readFlag(Flags::ImplicitParentheses)) {
+                        if (!readFlag(flags, Flags::ImplicitParentheses)) {
                             return Error::SyntaxError;
                         }
 
@@ -352,12 +695,12 @@ namespace mathex {
                     }
 
                     while (ops_stack.top().type != TokenType::LeftParenthesis) {
-                        out_queue.push(std::move(ops_stack.top()));
+                        emitOperator(ops_stack.top().op, out_queue);
                         ops_stack.pop();
 
                         if (ops_stack.empty()) {
                             // Mismatched parenthesis (ignore if implicit parentheses are enabled)
-                            if (!this->readFlag(Flags::ImplicitParentheses)) {
+                            if (!readFlag(flags, Flags::ImplicitParentheses)) {
                                 return Error::SyntaxError;
                             }
 
@@ -369,11 +712,15 @@ namespace mathex {
                 if (!ops_stack.empty()) {
                     ops_stack.pop(); // Discard left parenthesis
 
-                    if (!ops_stack.empty() && ops_stack.top().type == TokenType::Function) {
-                        out_queue.push(std::move(ops_stack.top()));
+                    if (!ops_stack.empty() && isCall(ops_stack.top().type)) {
+                        Error error = emitCall(ops_stack.top(), arg_count, program);
+
+                        if (error != Error::Success) {
+                            return error;
+                        }
+
                         ops_stack.pop();
 
-                        arg_queue.push(arg_count);
                         arg_count = arg_stack.top();
                         arg_stack.pop();
                     } else if (last_token == TokenType::LeftParenthesis) {
@@ -386,7 +733,7 @@ namespace mathex {
                 continue;
             }
 
-            if (expression[i] == ',') {
+            if (symbol == ',') {
                 // Previous argument has to be non-empty
                 if (!BINARY_OPERATOR_EXPECTED) {
                     return Error::SyntaxError;
@@ -399,7 +746,7 @@ namespace mathex {
 
                 if (ops_stack.empty()) {
                     // Mismatched parenthesis (ignore if implicit parentheses are enabled)
-                    if (!this->readFlag(Flags::ImplicitParentheses)) {
+                    if (!readFlag(flags, Flags::ImplicitParentheses)) {
                         return Error::SyntaxError;
                     }
 
@@ -407,12 +754,12 @@ namespace mathex {
                 }
 
                 while (ops_stack.top().type != TokenType::LeftParenthesis) {
-                    out_queue.push(std::move(ops_stack.top()));
+                    emitOperator(ops_stack.top().op, out_queue);
                     ops_stack.pop();
 
                     if (ops_stack.empty()) {
                         // Mismatched parenthesis (ignore if implicit parentheses are enabled)
-                        if (!this->readFlag(Flags::ImplicitParentheses)) {
+                        if (!readFlag(flags, Flags::ImplicitParentheses)) {
                             return Error::SyntaxError;
                         }
 
@@ -420,6 +767,20 @@ namespace mathex {
                     }
                 }
 
+                // Comma inside parentheses of a subexpression would be counted as an argument of the enclosing call
+                if (!ops_stack.empty() && !ops_stack.top().call) {
+                    return Error::SyntaxError;
+                }
+
+                // Arguments of conditional are separated by jumps
+                if (!ops_stack.empty() && ops_stack.top().function != 0) {
+                    if (arg_count > 2) {
+                        return Error::IncorrectArgsNum;
+                    }
+
+                    out_queue.push_back(Instruction(arg_count == 1 ? Opcode::Condition : Opcode::Else));
+                }
+
                 arg_count++;
                 last_token = TokenType::Comma;
                 continue;
@@ -437,92 +798,781 @@ namespace mathex {
         while (!ops_stack.empty()) {
             if (ops_stack.top().type == TokenType::LeftParenthesis) {
                 // Mismatched parenthesis (ignore if implicit parentheses are enabled)
-                if (!this->readFlag(Flags::ImplicitParentheses)) {
+                if (!readFlag(flags, Flags::ImplicitParentheses)) {
                     return Error::SyntaxError;
                 }
 
+                ops_stack.pop();
                 continue;
             }
 
-            if (ops_stack.top().type == TokenType::Function) {
+            if (isCall(ops_stack.top().type)) {
                 // Implicit parentheses for zero argument functions are not allowed
                 if (arg_count == 0) {
                     return Error::SyntaxError;
                 }
 
-                arg_queue.push(arg_count);
+                Error error = emitCall(ops_stack.top(), arg_count, program);
+
+                if (error != Error::Success) {
+                    return error;
+                }
+
+                ops_stack.pop();
+
                 arg_count = arg_stack.top();
                 arg_stack.pop();
+                continue;
             }
 
-            out_queue.push(std::move(ops_stack.top()));
+            emitOperator(ops_stack.top().op, out_queue);
             ops_stack.pop();
         }
 
-        while (!out_queue.empty()) {
-            switch (out_queue.front().type) {
-            case TokenType::Constant: {
-                res_stack.push(out_queue.front().data.constant);
+        if (!link(program.code) || !measure(program.code, program.depth)) {
+            return Error::SyntaxError;
+        }
+
+        return Error::Success;
+    }
+
+    // Returns flag that enables operator.
+    static Flags enabling(const Operator &op) {
+        switch (op.opcode) {
+        case Opcode::Add:
+            return Flags::Addition;
+
+        case Opcode::Sub:
+            return Flags::Substraction;
+
+        case Opcode::Mul:
+            return Flags::Multiplication;
+
+        case Opcode::Div:
+            return Flags::Division;
+
+        case Opcode::Pow:
+            return Flags::Exponentiation;
+
+        case Opcode::Mod:
+            return Flags::Modulus;
+
+        case Opcode::Pos:
+            return Flags::Identity;
+
+        case Opcode::Neg:
+            return Flags::Negation;
+
+        case Opcode::Not:
+        case Opcode::Select:
+            return Flags::Logical;
+
+        default:
+            return Flags::Comparison;
+        }
+    }
+
+    // Emits instructions of term in the order `translate` emits them for the same expression written as text.
+    static Error emitTerm(const Term &term, const SymbolTable &symbols, Flags flags, Program &program) {
+        const Term::Node &node = Term::Node::of(term);
+        Code &code = program.code;
+        Builtin builtin;
+
+        switch (node.kind) {
+        case Term::Node::Kind::Constant: {
+            code.push_back(Instruction(node.value));
+        } break;
+
+        case Term::Node::Kind::Name: {
+            const Symbol *fetched = symbols.find(node.name.data(), node.name.size());
+
+            if (fetched == nullptr) {
+                // Built-in functions and the conditional have to be called
+                bool function = (readFlag(flags, Flags::Conditional) && node.name == "if") ||
+                                (readFlag(flags, Flags::Functions) && findBuiltin(node.name.data(), node.name.size(), builtin));
+
+                return function ? Error::SyntaxError : Error::Undefined;
+            }
+
+            useSymbol(*fetched->name, program);
+
+            if (fetched->token->type == TokenType::Function || fetched->token->type == TokenType::Callback) {
+                return Error::SyntaxError;
+            }
+
+            emitValue(*fetched, program);
+        } break;
+
+        case Term::Node::Kind::Operator: {
+            const Operator &op = *node.op;
+
+            if (!readFlag(flags, enabling(op))) {
+                return Error::SyntaxError;
+            }
+
+            Error error = emitTerm(node.operands[0], symbols, flags, program);
+
+            if (error != Error::Success) {
+                return error;
+            }
+
+            if (op.type == TokenType::BinaryOperator) {
+                // Left operand of logical operator is the condition, see `translate`
+                if (op.opcode == Opcode::Select) {
+                    bool conjunction = op.precedence == AndToken.precedence;
+
+                    if (conjunction) {
+                        code.push_back(Instruction(Opcode::Not));
+                    }
+
+                    code.push_back(Instruction(Opcode::Condition));
+                    code.push_back(Instruction(conjunction ? 0.0 : 1.0));
+                    code.push_back(Instruction(Opcode::Else));
+                }
+
+                error = emitTerm(node.operands[1], symbols, flags, program);
+
+                if (error != Error::Success) {
+                    return error;
+                }
+            }
+
+            emitOperator(op, code);
+        } break;
+
+        case Term::Node::Kind::Call: {
+            const Symbol *fetched = symbols.find(node.name.data(), node.name.size());
+            std::uint32_t args = (std::uint32_t)node.operands.size();
+
+            if (fetched == nullptr && readFlag(flags, Flags::Conditional) && node.name == "if") {
+                useSymbol("if", program);
+
+                // Arguments of conditional are separated by jumps
+                for (std::uint32_t i = 0; i < args; i++) {
+                    if (i == 3) {
+                        return Error::IncorrectArgsNum;
+                    }
+
+                    Error error = emitTerm(node.operands[i], symbols, flags, program);
+
+                    if (error != Error::Success) {
+                        return error;
+                    }
+
+                    if (i + 1 < args) {
+                        code.push_back(Instruction(i == 0 ? Opcode::Condition : Opcode::Else));
+                    }
+                }
+
+                return args == 3 ? emitCall(Pending(TokenType::Conditional), args, program) : Error::IncorrectArgsNum;
+            }
+
+            Pending pending(TokenType::None);
+
+            if (fetched == nullptr && readFlag(flags, Flags::Functions) && findBuiltin(node.name.data(), node.name.size(), builtin)) {
+                useSymbol(node.name, program);
+                pending = Pending(TokenType::Builtin, Operator(), (std::uint32_t)builtin);
+            } else if (fetched == nullptr) {
+                return Error::Undefined;
+            } else {
+                useSymbol(*fetched->name, program);
+
+                if (fetched->token->type == TokenType::Function) {
+                    pending = Pending(TokenType::Function, Operator(), useFunction(*fetched, program));
+                } else if (fetched->token->type == TokenType::Callback) {
+                    pending = Pending(TokenType::Callback, Operator(), useCallback(*fetched, program));
+                } else {
+                    // Only functions can be called
+                    return Error::SyntaxError;
+                }
+            }
+
+            for (const Term &arg : node.operands) {
+                Error error = emitTerm(arg, symbols, flags, program);
+
+                if (error != Error::Success) {
+                    return error;
+                }
+            }
+
+            return emitCall(pending, args, program);
+        }
+        }
+
+        return Error::Success;
+    }
+
+    Error translate(const Term &term, const SymbolTable &symbols, Flags flags, Program &program) {
+        Error error = emitTerm(term, symbols, flags, program);
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        if (!link(program.code) || !measure(program.code, program.depth)) {
+            return Error::SyntaxError;
+        }
+
+        return Error::Success;
+    }
+
+    bool link(Code &code) {
+        std::vector<size_t> branches; // Jump ending the last branch seen of each open conditional.
+
+        for (size_t i = 0; i < code.size(); i++) {
+            switch (code[i].opcode) {
+            case Opcode::Condition: {
+                branches.push_back(i);
             } break;
 
-            case TokenType::Variable: {
-                res_stack.push(*out_queue.front().data.variable);
+            case Opcode::Else: {
+                if (branches.empty() || code[branches.back()].opcode != Opcode::Condition) {
+                    return false;
+                }
+
+                code.at(branches.back()).index = (std::uint32_t)i + 1;
+                branches.back() = i;
             } break;
 
-            case TokenType::BinaryOperator: {
-                double b = res_stack.top();
-                res_stack.pop();
-                double a = res_stack.top();
-                res_stack.pop();
+            case Opcode::Select: {
+                if (branches.empty() || code[branches.back()].opcode != Opcode::Else) {
+                    return false;
+                }
 
-                res_stack.push(out_queue.front().data.binaryOperator(a, b));
+                code.at(branches.back()).index = (std::uint32_t)i + 1;
+                branches.pop_back();
             } break;
 
-            case TokenType::UnaryOperator: {
-                double x = res_stack.top();
-                res_stack.pop();
+            default: {
+            } break;
+            }
+        }
+
+        return branches.empty();
+    }
 
-                res_stack.push(out_queue.front().data.unaryOperator(x));
+    bool measure(const Code &code, size_t &depth) {
+        // Open conditional, with its last jump and depth below the branch being read
+        struct Branch {
+            size_t jump;
+            size_t floor;
+        };
+
+        std::vector<Branch> branches;
+        size_t current = 0;
+        depth = 0;
+
+        for (size_t i = 0; i < code.size(); i++) {
+            const Instruction &instruction = code[i];
+            size_t floor = branches.empty() ? 0 : branches.back().floor;
+
+            switch (instruction.opcode) {
+            case Opcode::Condition: {
+                if (current < floor + 1) {
+                    return false;
+                }
+
+                branches.push_back(Branch{i, current});
             } break;
 
-            case TokenType::Function: {
-                int args_num = arg_queue.front();
-                arg_queue.pop();
+            case Opcode::Else: {
+                // Then branch is right after the condition, and leaves one value
+                if (branches.empty() || code[branches.back().jump].opcode != Opcode::Condition || current != floor + 1 ||
+                    code[branches.back().jump].index != i + 1) {
+                    return false;
+                }
 
-                double func_result;
-                Error error;
+                branches.back() = Branch{i, current};
+            } break;
 
-                if (args_num > 0) {
-                    std::unique_ptr<double[]> args(new double[args_num]);
+            case Opcode::Select: {
+                if (branches.empty() || code[branches.back().jump].opcode != Opcode::Else || current != floor + 1 ||
+                    code[branches.back().jump].index != i + 1) {
+                    return false;
+                }
 
-                    for (int i = 0; i < args_num; i++) {
-                        args[(size_t)args_num - (size_t)i - 1] = res_stack.top();
-                        res_stack.pop();
-                    }
+                branches.pop_back();
+                current -= 2;
+            } break;
 
-                    error = out_queue.front().data.function(args.get(), args_num, func_result);
-                } else {
-                    error = out_queue.front().data.function(nullptr, 0, func_result);
+            default: {
+                if (current < floor + arity(instruction)) {
+                    return false;
                 }
 
+                current = current - arity(instruction) + 1;
+            } break;
+            }
+
+            depth = std::max(depth, current);
+        }
+
+        return branches.empty() && current == 1;
+    }
+
+    Error Config::parse(const std::string &expression, const SymbolTable &symbols, Program &program) const {
+        Counters *counters = this->m_Stats->counters();
+        Stopwatch stopwatch(counters);
+        std::vector<Lexeme> lexemes;
+
+        program.flags = this->m_Flags;
+        lex(expression, this->m_Flags, lexemes);
+        stopwatch.lap(Phase::Tokenize);
+
+        if (counters) {
+            counters->lookedUp((size_t)std::count_if(lexemes.begin(), lexemes.end(), [](const Lexeme &lexeme) { return lexeme.type == LexemeType::Identifier; }));
+        }
+
+        Error error = translate(expression, lexemes, symbols, this->m_Flags, program);
+        stopwatch.lap(Phase::Parse);
+        return error;
+    }
+
+    Error Config::parse(const Term &term, const SymbolTable &symbols, Program &program) const {
+        Stopwatch stopwatch(this->m_Stats->counters());
+
+        program.flags = this->m_Flags;
+        Error error = translate(term, symbols, this->m_Flags, program);
+        stopwatch.lap(Phase::Parse);
+        return error;
+    }
+
+    Error execute(const Program &program, double &result, const double *frame /* = nullptr */) {
+        // Most expressions are shallow enough to fit on the stack
+        double buffer[32];
+
+        if (program.depth <= sizeof(buffer) / sizeof(*buffer)) {
+            return execute(program, buffer, result, frame);
+        }
+
+        std::vector<double> stack(program.depth);
+        return execute(program, stack.data(), result, frame);
+    }
+
+    Error execute(const Program &program, double *stack, double &result, const double *frame /* = nullptr */) {
+        // Slot variables have no value without a frame
+        if (program.frame > 0 && frame == nullptr) {
+            return Error::Undefined;
+        }
+
+        double *top = stack;
+        const Instruction *code = program.code.data();
+        size_t size = program.code.size();
+
+        for (size_t i = 0; i < size; i++) {
+            const Instruction &instruction = code[i];
+
+            switch (instruction.opcode) {
+            case Opcode::Constant: {
+                *top++ = instruction.constant;
+            } break;
+
+            case Opcode::Variable: {
+                *top++ = *program.variables[instruction.index].second;
+            } break;
+
+            case Opcode::Slot: {
+                *top++ = frame[instruction.index];
+            } break;
+
+            case Opcode::Function: {
+                // Arguments are already laid out in order on top of the stack
+                top -= instruction.args;
+
+                double func_result;
+                Error error = program.functions[instruction.index].second(instruction.args > 0 ? top : nullptr, (int)instruction.args, func_result);
+
                 if (error != Error::Success) {
                     return error;
                 }
 
-                res_stack.push(func_result);
+                *top++ = func_result;
+            } break;
+
+            case Opcode::Call: {
+                const Callback &callback = program.callbacks[instruction.index].second;
+                top -= instruction.args;
+                *top = callback.invoke(callback.state.get(), top);
+                top++;
+            } break;
+
+            case Opcode::Builtin: {
+                top -= instruction.args;
+                *top = call((Builtin)instruction.index, top);
+                top++;
+            } break;
+
+            case Opcode::Pos: {
+            } break;
+
+            case Opcode::Neg: {
+                top[-1] = -top[-1];
+            } break;
+
+            case Opcode::PowInt: {
+                top[-1] = powi(top[-1], instruction.constant);
+            } break;
+
+            case Opcode::Not: {
+                top[-1] = top[-1] == 0 ? 1 : 0;
+            } break;
+
+            case Opcode::Condition: {
+                // Loop increment lands on the target
+                if (*--top == 0) {
+                    i = instruction.index - 1;
+                }
+            } break;
+
+            case Opcode::Else: {
+                i = instruction.index - 1;
+            } break;
+
+            case Opcode::Select: {
+                // Only reached from the else branch, whose value is already on top
             } break;
 
             default: {
+                double b = *--top;
+                top[-1] = apply(instruction.opcode, top[-1], b);
             } break;
             }
+        }
 
-            out_queue.pop();
+        // Exactly one value has to be left in results stack
+        // (empty program, e.g. default constructed expression, has none)
+        if (top != stack + 1) {
+            return Error::SyntaxError;
         }
 
-        result = res_stack.top();
-        res_stack.pop();
+        result = stack[0];
+        return Error::Success;
+    }
 
-        // Exactly one value has to be left in results stack
-        return res_stack.empty() ? Error::Success : Error::SyntaxError;
+// Blocks of a batch never overlap, which lets the compiler vectorize loops over them without runtime checks
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define RESTRICT __restrict
+#else
+#define RESTRICT
+#endif
+
+    // Loops always run over the whole block, since constant trip count lets
+    // the compiler vectorize them. Rows past the end of the last block are junk.
+    static void applyBinary(Opcode opcode, double *RESTRICT a, const double *RESTRICT b) {
+        switch (opcode) {
+        case Opcode::Add: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] + b[i];
+            }
+        } break;
+
+        case Opcode::Sub: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] - b[i];
+            }
+        } break;
+
+        case Opcode::Mul: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] * b[i];
+            }
+        } break;
+
+        case Opcode::Div: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] / b[i];
+            }
+        } break;
+
+        case Opcode::Pow: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::pow(a[i], b[i]);
+            }
+        } break;
+
+        case Opcode::Mod: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = std::fmod(a[i], b[i]);
+            }
+        } break;
+
+        case Opcode::Less: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] < b[i] ? 1.0 : 0.0;
+            }
+        } break;
+
+        case Opcode::LessEqual: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] <= b[i] ? 1.0 : 0.0;
+            }
+        } break;
+
+        case Opcode::Greater: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] > b[i] ? 1.0 : 0.0;
+            }
+        } break;
+
+        case Opcode::GreaterEqual: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] >= b[i] ? 1.0 : 0.0;
+            }
+        } break;
+
+        case Opcode::Equal: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] == b[i] ? 1.0 : 0.0;
+            }
+        } break;
+
+        case Opcode::NotEqual: {
+            for (size_t i = 0; i < BatchSize; i++) {
+                a[i] = a[i] != b[i] ? 1.0 : 0.0;
+            }
+        } break;
+
+        default: {
+        } break;
+        }
+    }
+
+    // Checks whether row is in the branches being evaluated, given conditions of the enclosing conditionals and whether
+    // each of them is in its then branch.
+    static bool active(const std::vector<std::pair<const double *, bool>> &branches, size_t row) {
+        for (const auto &branch : branches) {
+            if ((branch.first[row] != 0) != branch.second) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Error execute(const Program &program, const Columns &columns, double *results, size_t count) {
+        Scratch scratch;
+        return execute(program, columns, results, count, scratch);
+    }
+
+    Error execute(const Program &program, const Columns &columns, double *results, size_t count, Scratch &scratch) {
+        resolve(program, columns, scratch.sources);
+        return execute(program, scratch.sources.data(), results, 0, count, scratch);
+    }
+
+    Error execute(const Program &program, const double *frames, size_t stride, double *results, size_t count, Scratch &scratch) {
+        // Variables bound by pointer keep their current value for every record
+        scratch.sources.assign(program.variables.size(), nullptr);
+        return execute(program, scratch.sources.data(), results, 0, count, scratch, frames, stride);
+    }
+
+    void resolve(const Program &program, const Columns &columns, std::vector<const double *> &sources) {
+        sources.assign(program.variables.size(), nullptr);
+
+        for (size_t i = 0; i < program.variables.size(); i++) {
+            auto column = columns.find(program.variables[i].first);
+
+            if (column != columns.end()) {
+                sources[i] = column->second;
+            }
+        }
+    }
+
+    Error execute(const Program &program, const double *const *sources, double *results, size_t begin, size_t end, Scratch &scratch,
+                  const double *frames /* = nullptr */, size_t stride /* = 0 */) {
+        // Each value of the stack is a block of `BatchSize` rows, so
+        // every step of the program is a tight loop over the block
+        if (program.code.empty()) {
+            return Error::SyntaxError;
+        }
+
+        if (program.frame > 0 && frames == nullptr) {
+            return Error::Undefined;
+        }
+
+        if (program.frame > stride && frames != nullptr) {
+            return Error::InvalidArgs;
+        }
+
+        std::uint32_t max_args = 0;
+
+        for (const Instruction &instruction : program.code) {
+            if (instruction.opcode == Opcode::Function || instruction.opcode == Opcode::Call) {
+                max_args = std::max(max_args, instruction.args);
+            }
+        }
+
+        // Blocks of the stack are followed by a temporary block
+        // and arguments of function calls gathered for a single row
+        if (scratch.stack.size() < (program.depth + 1) * BatchSize + max_args) {
+            scratch.stack.resize((program.depth + 1) * BatchSize + max_args);
+        }
+
+        double *stack = scratch.stack.data();
+        double *temp = stack + program.depth * BatchSize;
+        double *args = temp + BatchSize;
+
+        // Both branches of conditionals are evaluated for every row and one of them is selected, except for
+        // functions, which are only called for rows in the branches they are in
+        std::vector<std::pair<const double *, bool>> &branches = scratch.branches;
+        branches.clear();
+
+        for (size_t offset = begin; offset < end; offset += BatchSize) {
+            size_t rows = std::min(BatchSize, end - offset);
+            double *top = stack;
+
+            for (const Instruction &instruction : program.code) {
+                switch (instruction.opcode) {
+                case Opcode::Constant: {
+                    std::fill(top, top + BatchSize, instruction.constant);
+                    top += BatchSize;
+                } break;
+
+                case Opcode::Variable: {
+                    const double *source = sources[instruction.index];
+
+                    if (source != nullptr) {
+                        std::copy(source + offset, source + offset + rows, top);
+                    } else {
+                        std::fill(top, top + BatchSize, *program.variables[instruction.index].second);
+                    }
+
+                    top += BatchSize;
+                } break;
+
+                case Opcode::Slot: {
+                    const double *value = frames + offset * stride + instruction.index;
+
+                    for (size_t row = 0; row < rows; row++) {
+                        top[row] = value[row * stride];
+                    }
+
+                    top += BatchSize;
+                } break;
+
+                case Opcode::Function: {
+                    const Function &function = program.functions[instruction.index].second;
+                    top -= instruction.args * BatchSize;
+
+                    for (size_t row = 0; row < rows; row++) {
+                        if (!branches.empty() && !active(branches, row)) {
+                            top[row] = 0;
+                            continue;
+                        }
+
+                        for (size_t j = 0; j < instruction.args; j++) {
+                            args[j] = top[j * BatchSize + row];
+                        }
+
+                        double func_result;
+                        Error error = function(instruction.args > 0 ? args : nullptr, (int)instruction.args, func_result);
+
+                        if (error != Error::Success) {
+                            return error;
+                        }
+
+                        top[row] = func_result;
+                    }
+
+                    top += BatchSize;
+                } break;
+
+                case Opcode::Call: {
+                    const Callback &callback = program.callbacks[instruction.index].second;
+                    const void *state = callback.state.get();
+                    top -= instruction.args * BatchSize;
+
+                    for (size_t row = 0; row < rows; row++) {
+                        if (!branches.empty() && !active(branches, row)) {
+                            top[row] = 0;
+                            continue;
+                        }
+
+                        for (size_t j = 0; j < instruction.args; j++) {
+                            args[j] = top[j * BatchSize + row];
+                        }
+
+                        top[row] = callback.invoke(state, args);
+                    }
+
+                    top += BatchSize;
+                } break;
+
+                case Opcode::Builtin: {
+                    top -= (instruction.args - 1) * BatchSize;
+                    applyBuiltin((Builtin)instruction.index, top - BatchSize, top);
+                } break;
+
+                case Opcode::Pos: {
+                } break;
+
+                case Opcode::Neg: {
+                    double *RESTRICT x = top - BatchSize;
+
+                    for (size_t i = 0; i < BatchSize; i++) {
+                        x[i] = -x[i];
+                    }
+                } break;
+
+                case Opcode::PowInt: {
+                    double *RESTRICT x = top - BatchSize;
+                    double *RESTRICT power = temp;
+                    std::copy(x, x + BatchSize, power);
+
+                    for (double k = std::fabs(instruction.constant); k > 1; k--) {
+                        for (size_t i = 0; i < BatchSize; i++) {
+                            power[i] = power[i] * x[i];
+                        }
+                    }
+
+                    if (instruction.constant < 0) {
+                        for (size_t i = 0; i < BatchSize; i++) {
+                            power[i] = 1 / power[i];
+                        }
+                    }
+
+                    std::copy(power, power + BatchSize, x);
+                } break;
+
+                case Opcode::Not: {
+                    double *RESTRICT x = top - BatchSize;
+
+                    for (size_t i = 0; i < BatchSize; i++) {
+                        x[i] = x[i] == 0 ? 1.0 : 0.0;
+                    }
+                } break;
+
+                case Opcode::Condition: {
+                    branches.push_back(std::make_pair(top - BatchSize, true));
+                } break;
+
+                case Opcode::Else: {
+                    branches.back().second = false;
+                } break;
+
+                case Opcode::Select: {
+                    top -= 2 * BatchSize;
+
+                    double *RESTRICT x = top - BatchSize;
+                    const double *RESTRICT a = top;
+                    const double *RESTRICT b = top + BatchSize;
+
+                    for (size_t i = 0; i < BatchSize; i++) {
+                        x[i] = x[i] != 0 ? a[i] : b[i];
+                    }
+
+                    branches.pop_back();
+                } break;
+
+                default: {
+                    top -= BatchSize;
+                    applyBinary(instruction.opcode, top - BatchSize, top);
+                } break;
+                }
+            }
+
+            std::copy(stack, stack + rows, results + offset);
+        }
+
+        return Error::Success;
     }
 }
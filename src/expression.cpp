@@ -0,0 +1,288 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "autodiff.hpp"
+#include "cache.hpp"
+#include "jit.hpp"
+#include "mathex"
+#include "pool.hpp"
+#include "program.hpp"
+#include "set.hpp"
+#include "symbols.hpp"
+#include "term.hpp"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mathex {
+    Expression::Expression() {}
+
+    Expression::~Expression() {}
+
+    Error Expression::evaluate(double &result) const {
+        return this->evaluate(nullptr, result);
+    }
+
+    Error Expression::evaluate(const double *frame, double &result) const {
+        if (!this->m_Program) {
+            return Error::SyntaxError;
+        }
+
+        if (this->m_Program->frame > 0 && frame == nullptr) {
+            return Error::Undefined;
+        }
+
+        if (this->m_Native) {
+            double buffer[32];
+            std::vector<double> memory;
+            double *stack = buffer;
+
+            if (this->m_Program->depth + 1 > 32) {
+                memory.resize(this->m_Program->depth + 1);
+                stack = memory.data();
+            }
+
+            Error error = this->m_Native->run(stack, frame);
+
+            if (error == Error::Success) {
+                result = stack[0];
+            }
+
+            return error;
+        }
+
+        return execute(*this->m_Program, result, frame);
+    }
+
+    Error Expression::evaluate(const double *frames, size_t stride, double *results, size_t count) const {
+        if (!this->m_Program) {
+            return Error::SyntaxError;
+        }
+
+        Scratch scratch;
+        return execute(*this->m_Program, frames, stride, results, count, scratch);
+    }
+
+    Error Expression::evaluate(const Columns &columns, double *results, size_t count) const {
+        if (!this->m_Program) {
+            return Error::SyntaxError;
+        }
+
+        return execute(*this->m_Program, columns, results, count);
+    }
+
+    Error Expression::evaluate(const Columns &columns, double *results, size_t count, ThreadPool &pool, size_t chunk /* = 0 */) const {
+        if (!this->m_Program || this->m_Program->code.empty()) {
+            return Error::SyntaxError;
+        }
+
+        const Program &program = *this->m_Program;
+
+        // Few chunks per thread leave room for stealing when threads run at different speeds
+        if (chunk == 0) {
+            chunk = std::max<size_t>(count / (pool.size() * 8), 16 * BatchSize);
+        }
+
+        // Chunks made of whole blocks are evaluated exactly like in a single thread,
+        // so the first failed chunk fails the same way as the whole evaluation would
+        chunk = (chunk + BatchSize - 1) / BatchSize * BatchSize;
+        size_t chunks = (count + chunk - 1) / chunk;
+
+        std::vector<const double *> sources;
+        resolve(program, columns, sources);
+
+        std::vector<Error> errors(chunks, Error::Success);
+        std::vector<std::exception_ptr> exceptions(chunks);
+
+        pool.m_Workers->run(chunks, [&](size_t i, Scratch &scratch) {
+            try {
+                errors[i] = execute(program, sources.data(), results, i * chunk, std::min(count, (i + 1) * chunk), scratch);
+            } catch (...) {
+                exceptions[i] = std::current_exception();
+            }
+        });
+
+        for (size_t i = 0; i < chunks; i++) {
+            if (exceptions[i]) {
+                std::rethrow_exception(exceptions[i]);
+            }
+
+            if (errors[i] != Error::Success) {
+                return errors[i];
+            }
+        }
+
+        return Error::Success;
+    }
+
+    Error Expression::differentiate(const std::vector<std::string> &variables, double &result, double *gradient,
+                                    Differentiation mode /* = Differentiation::Auto */) const {
+        return this->differentiate(nullptr, variables, result, gradient, mode);
+    }
+
+    Error Expression::differentiate(const double *frame, const std::vector<std::string> &variables, double &result, double *gradient,
+                                    Differentiation mode /* = Differentiation::Auto */) const {
+        if (!this->m_Program) {
+            return Error::SyntaxError;
+        }
+
+        return mathex::differentiate(*this->m_Program, frame, variables, mode, result, gradient);
+    }
+
+    size_t Expression::size() const {
+        return this->m_Program ? this->m_Program->code.size() : 0;
+    }
+
+    bool Expression::jit() {
+        if (!this->m_Native) {
+            this->m_Native = Native::compile(this->m_Program);
+        }
+
+        return this->m_Native != nullptr;
+    }
+
+    Evaluator::Evaluator(size_t depth /* = 64 */) : m_Scratch(new Scratch()) {
+        this->m_Scratch->stack.reserve(depth);
+    }
+
+    Evaluator::~Evaluator() {}
+
+    Error Evaluator::evaluate(const Expression &expression, double &result) {
+        return this->evaluate(expression, nullptr, result);
+    }
+
+    Error Evaluator::evaluate(const Expression &expression, const double *frame, double &result) {
+        if (!expression.m_Program) {
+            return Error::SyntaxError;
+        }
+
+        const Program &program = *expression.m_Program;
+
+        if (program.frame > 0 && frame == nullptr) {
+            return Error::Undefined;
+        }
+
+        if (this->m_Scratch->stack.size() < program.depth + 1) {
+            this->m_Scratch->stack.resize(program.depth + 1);
+        }
+
+        if (expression.m_Native) {
+            Error error = expression.m_Native->run(this->m_Scratch->stack.data(), frame);
+
+            if (error == Error::Success) {
+                result = this->m_Scratch->stack[0];
+            }
+
+            return error;
+        }
+
+        return execute(program, this->m_Scratch->stack.data(), result, frame);
+    }
+
+    Error Evaluator::evaluate(const Expression &expression, const double *frames, size_t stride, double *results, size_t count) {
+        if (!expression.m_Program) {
+            return Error::SyntaxError;
+        }
+
+        return execute(*expression.m_Program, frames, stride, results, count, *this->m_Scratch);
+    }
+
+    Error Evaluator::evaluate(const Expression &expression, const Columns &columns, double *results, size_t count) {
+        if (!expression.m_Program) {
+            return Error::SyntaxError;
+        }
+
+        return execute(*expression.m_Program, columns, results, count, *this->m_Scratch);
+    }
+
+    Error Evaluator::evaluate(const ExpressionSet &set, double *results, const double *frame /* = nullptr */) {
+        const Dag &dag = *set.m_Dag;
+
+        if (this->m_Scratch->stack.size() < dag.steps.size() + dag.arity) {
+            this->m_Scratch->stack.resize(dag.steps.size() + dag.arity);
+        }
+
+        return execute(dag, this->m_Scratch->stack.data(), this->m_Scratch->stack.data() + dag.steps.size(), results, frame);
+    }
+
+    Error Config::compile(const std::string &expression, Expression &result, Optimization optimization /* = Optimization::Exact */) {
+        if (this->m_Cache->capacity > 0) {
+            std::shared_ptr<const Program> cached = this->m_Cache->find(expression, this->m_Flags, optimization);
+
+            if (cached) {
+                result.m_Program = std::move(cached);
+                result.m_Native = nullptr;
+                return Error::Success;
+            }
+        }
+
+        Snapshot snapshot(*this->m_Symbols);
+        std::shared_ptr<Program> program = std::make_shared<Program>();
+        Error error = this->parse(expression, snapshot.symbols(), *program);
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        optimize(*program, optimization);
+
+        this->m_Cache->insert(expression, this->m_Flags, optimization, program, snapshot.version());
+        result.m_Program = std::move(program);
+        result.m_Native = nullptr;
+        return Error::Success;
+    }
+
+    Error Config::compile(const Term &term, Expression &result, Optimization optimization /* = Optimization::Exact */) {
+        std::string key;
+
+        if (this->m_Cache->capacity > 0) {
+            key = Term::Node::key(term);
+            std::shared_ptr<const Program> cached = this->m_Cache->find(key, this->m_Flags, optimization);
+
+            if (cached) {
+                result.m_Program = std::move(cached);
+                result.m_Native = nullptr;
+                return Error::Success;
+            }
+        }
+
+        Snapshot snapshot(*this->m_Symbols);
+        std::shared_ptr<Program> program = std::make_shared<Program>();
+        Error error = this->parse(term, snapshot.symbols(), *program);
+
+        if (error != Error::Success) {
+            return error;
+        }
+
+        optimize(*program, optimization);
+
+        if (!key.empty()) {
+            this->m_Cache->insert(key, this->m_Flags, optimization, program, snapshot.version());
+        }
+
+        result.m_Program = std::move(program);
+        result.m_Native = nullptr;
+        return Error::Success;
+    }
+}
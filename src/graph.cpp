@@ -0,0 +1,297 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "mathex"
+#include "program.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    class Formula {
+    public:
+        std::string name;
+        Expression expression;
+        double value = std::numeric_limits<double>::quiet_NaN(); // Read by expressions through variable of the config.
+        Error error = Error::Success;                            // Error of the last evaluation.
+        bool dirty = true;                                       // Has to be recomputed by the next update.
+        size_t pending = 0;                                      // Formulas it uses that are not sorted yet.
+
+        std::vector<Formula *> uses;     // Formulas it reads.
+        std::vector<Formula *> users;    // Formulas that read it.
+        std::vector<std::string> inputs; // Variables it reads that are not formulas.
+    };
+
+    // Returns whether any of `targets` is `formula` or uses it, directly or through other formulas.
+    static bool reaches(Formula *formula, const std::vector<Formula *> &targets) {
+        std::vector<Formula *> stack = {formula};
+        std::set<Formula *> visited;
+
+        while (!stack.empty()) {
+            Formula *current = stack.back();
+            stack.pop_back();
+
+            if (std::find(targets.begin(), targets.end(), current) != targets.end()) {
+                return true;
+            }
+
+            if (visited.insert(current).second) {
+                stack.insert(stack.end(), current->users.begin(), current->users.end());
+            }
+        }
+
+        return false;
+    }
+
+    template <typename T>
+    static void erase(std::vector<T> &vector, const T &value) {
+        vector.erase(std::remove(vector.begin(), vector.end(), value), vector.end());
+    }
+
+    FormulaGraph::FormulaGraph(Config &config) : m_Config(config), m_Recomputed(0) {}
+
+    FormulaGraph::~FormulaGraph() {
+        for (const auto &formula : this->m_Formulas) {
+            this->m_Config.remove(formula.first);
+        }
+    }
+
+    Error FormulaGraph::define(const std::string &name, const std::string &formula, Optimization optimization /* = Optimization::Exact */) {
+        auto fetched = this->m_Formulas.find(name);
+        std::unique_ptr<Formula> created;
+        Formula *target;
+
+        if (fetched == this->m_Formulas.end()) {
+            created.reset(new Formula());
+            created->name = name;
+            this->m_Config.addVariable(name, created->value);
+            target = created.get();
+        } else {
+            target = fetched->second.get();
+        }
+
+        Expression expression;
+        Error error = this->m_Config.compile(formula, expression, optimization);
+        std::vector<Formula *> uses;
+        std::vector<std::string> inputs;
+
+        if (error == Error::Success) {
+            // Variables found by the parser are either formulas of the graph, or inputs
+            auto read = [&](const std::string &variable) {
+                auto used = this->m_Formulas.find(variable);
+
+                if (variable == name) {
+                    uses.push_back(target);
+                } else if (used != this->m_Formulas.end()) {
+                    uses.push_back(used->second.get());
+                } else {
+                    inputs.push_back(variable);
+                }
+            };
+
+            for (const auto &variable : expression.m_Program->variables) {
+                read(variable.first);
+            }
+
+            for (const auto &slot : expression.m_Program->slots) {
+                read(slot.first);
+            }
+
+            if (reaches(target, uses)) {
+                error = Error::CircularDependency;
+            }
+        }
+
+        if (error != Error::Success) {
+            if (created) {
+                this->m_Config.remove(name);
+            }
+
+            return error;
+        }
+
+        for (Formula *used : target->uses) {
+            erase(used->users, target);
+        }
+
+        for (const std::string &input : target->inputs) {
+            std::vector<Formula *> &readers = this->m_Readers[input];
+            erase(readers, target);
+
+            if (readers.empty()) {
+                this->m_Readers.erase(input);
+            }
+        }
+
+        for (Formula *used : uses) {
+            used->users.push_back(target);
+        }
+
+        for (const std::string &input : inputs) {
+            this->m_Readers[input].push_back(target);
+        }
+
+        target->expression = std::move(expression);
+        target->uses = std::move(uses);
+        target->inputs = std::move(inputs);
+        target->dirty = true;
+
+        if (created) {
+            this->m_Formulas[name] = std::move(created);
+        }
+
+        this->sort();
+        return Error::Success;
+    }
+
+    bool FormulaGraph::remove(const std::string &name) {
+        auto fetched = this->m_Formulas.find(name);
+
+        if (fetched == this->m_Formulas.end() || !fetched->second->users.empty()) {
+            return false;
+        }
+
+        Formula *formula = fetched->second.get();
+
+        for (Formula *used : formula->uses) {
+            erase(used->users, formula);
+        }
+
+        for (const std::string &input : formula->inputs) {
+            std::vector<Formula *> &readers = this->m_Readers[input];
+            erase(readers, formula);
+
+            if (readers.empty()) {
+                this->m_Readers.erase(input);
+            }
+        }
+
+        // Config refers to value of the formula until the variable is removed
+        this->m_Config.remove(name);
+        this->m_Formulas.erase(fetched);
+        this->sort();
+        return true;
+    }
+
+    void FormulaGraph::changed(const std::string &variable) {
+        auto fetched = this->m_Readers.find(variable);
+
+        if (fetched != this->m_Readers.end()) {
+            for (Formula *formula : fetched->second) {
+                formula->dirty = true;
+            }
+        }
+    }
+
+    Error FormulaGraph::update(const double *frame /* = nullptr */) {
+        Error first = Error::Success;
+        this->m_Recomputed = 0;
+
+        for (Formula *formula : this->m_Order) {
+            if (!formula->dirty) {
+                continue;
+            }
+
+            double value;
+            formula->dirty = false;
+            formula->error = formula->expression.evaluate(frame, value);
+            this->m_Recomputed++;
+
+            if (formula->error != Error::Success) {
+                value = std::numeric_limits<double>::quiet_NaN();
+
+                if (first == Error::Success) {
+                    first = formula->error;
+                }
+            }
+
+            // Formulas that use this one are sorted after it, so marking them is enough to recompute them in this pass
+            if (std::memcmp(&value, &formula->value, sizeof(value)) != 0) {
+                formula->value = value;
+
+                for (Formula *user : formula->users) {
+                    user->dirty = true;
+                }
+            }
+        }
+
+        return first;
+    }
+
+    Error FormulaGraph::value(const std::string &name, double &result) const {
+        auto fetched = this->m_Formulas.find(name);
+
+        if (fetched == this->m_Formulas.end()) {
+            return Error::Undefined;
+        }
+
+        if (fetched->second->error != Error::Success) {
+            return fetched->second->error;
+        }
+
+        result = fetched->second->value;
+        return Error::Success;
+    }
+
+    std::vector<std::string> FormulaGraph::order() const {
+        std::vector<std::string> names;
+        names.reserve(this->m_Order.size());
+
+        for (const Formula *formula : this->m_Order) {
+            names.push_back(formula->name);
+        }
+
+        return names;
+    }
+
+    size_t FormulaGraph::recomputed() const {
+        return this->m_Recomputed;
+    }
+
+    // https://en.wikipedia.org/wiki/Topological_sorting#Kahn's_algorithm
+    void FormulaGraph::sort() {
+        this->m_Order.clear();
+        this->m_Order.reserve(this->m_Formulas.size());
+
+        for (const auto &formula : this->m_Formulas) {
+            formula.second->pending = formula.second->uses.size();
+
+            if (formula.second->pending == 0) {
+                this->m_Order.push_back(formula.second.get());
+            }
+        }
+
+        for (size_t i = 0; i < this->m_Order.size(); i++) {
+            for (Formula *user : this->m_Order[i]->users) {
+                if (--user->pending == 0) {
+                    this->m_Order.push_back(user);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,507 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "builtins.hpp"
+#include "jit.hpp"
+#include "mathex"
+#include "program.hpp"
+#include "token.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <vector>
+
+#if MATHEX_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace mathex {
+#if MATHEX_JIT
+    // Native code returns this instead of error code when user function threw an exception.
+    constexpr int ExceptionThrown = -1;
+
+    // Exceptions cannot unwind through native code, so they are carried over it.
+    static thread_local std::exception_ptr thrown;
+
+    static int callFunction(const Function *function, double *args, int argc, double *result) {
+        try {
+            return (int)(*function)(args, argc, *result);
+        } catch (...) {
+            thrown = std::current_exception();
+            return ExceptionThrown;
+        }
+    }
+
+    static int callCallback(const Callback *callback, double *args, double *result) {
+        try {
+            *result = callback->invoke(callback->state.get(), args);
+            return (int)Error::Success;
+        } catch (...) {
+            thrown = std::current_exception();
+            return ExceptionThrown;
+        }
+    }
+
+    // Arguments of functions called directly are passed in xmm0 to xmm7.
+    constexpr std::uint32_t DirectArgs = 8;
+
+    // Machine code for x86-64 with System V calling convention, using only SSE2 instructions.
+    // Value on top of the stack is kept in xmm0, all values below it are kept in memory pointed to by rbx.
+    // Frame of slot variables is pointed to by r12.
+    class Assembler {
+    public:
+        std::vector<unsigned char> code;
+
+        void emit(std::initializer_list<unsigned char> bytes) {
+            this->code.insert(this->code.end(), bytes);
+        }
+
+        void imm32(std::uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                this->code.push_back((unsigned char)(value >> (8 * i)));
+            }
+        }
+
+        void imm64(std::uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                this->code.push_back((unsigned char)(value >> (8 * i)));
+            }
+        }
+
+        // mov rax, imm64
+        void movRax(std::uint64_t value) {
+            this->emit({0x48, 0xB8});
+            this->imm64(value);
+        }
+
+        // movsd xmm, [rbx + 8 * slot]
+        void load(int xmm, size_t slot) {
+            this->emit({0xF2, 0x0F, 0x10, (unsigned char)(0x83 | xmm << 3)});
+            this->imm32((std::uint32_t)(8 * slot));
+        }
+
+        // movsd [rbx + 8 * slot], xmm
+        void store(int xmm, size_t slot) {
+            this->emit({0xF2, 0x0F, 0x11, (unsigned char)(0x83 | xmm << 3)});
+            this->imm32((std::uint32_t)(8 * slot));
+        }
+
+        // mov rax, imm64; movq xmm, rax
+        void constant(int xmm, double value) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+
+            this->movRax(bits);
+            this->emit({0x66, 0x48, 0x0F, 0x6E, (unsigned char)(0xC0 | xmm << 3)});
+        }
+
+        // mov rax, imm64; call rax
+        void call(std::uintptr_t address) {
+            this->movRax(address);
+            this->emit({0xFF, 0xD0});
+        }
+
+        // movapd xmm1, xmm0; mov rax, imm64; movq xmm0, rax; andpd xmm0, xmm1
+        // Turns all ones or all zeros mask in xmm0 made by comparison into 1 or 0.
+        void truth() {
+            this->emit({0x66, 0x0F, 0x28, 0xC8});
+            this->constant(0, 1.0);
+            this->emit({0x66, 0x0F, 0x54, 0xC1});
+        }
+
+        // Emits 32-bit offset of a jump to be set later by `land`, returning its position.
+        size_t label() {
+            size_t position = this->code.size();
+            this->imm32(0);
+            return position;
+        }
+
+        // Points jump at `position` to the end of code.
+        void land(size_t position) {
+            std::uint32_t offset = (std::uint32_t)(this->code.size() - (position + 4));
+            std::memcpy(&this->code[position], &offset, sizeof(offset));
+        }
+    };
+
+    // Conditional being translated, with its pending jump and depth of the stack below its branches.
+    struct Branch {
+        size_t jump;
+        size_t depth;
+    };
+
+    static std::vector<unsigned char> translate(const Program &program) {
+        Assembler a;
+        std::vector<size_t> failures; // Positions of jumps to error exit.
+        std::vector<Branch> branches;
+        size_t depth = 0;
+        size_t result_slot = program.depth; // Slot for results of user functions.
+
+        // push rbx; push r12; sub rsp, 8; mov rbx, rdi; mov r12, rsi
+        a.emit({0x53, 0x41, 0x54, 0x48, 0x83, 0xEC, 0x08, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});
+
+        for (const Instruction &instruction : program.code) {
+            switch (instruction.opcode) {
+            case Opcode::Constant: {
+                if (depth > 0) {
+                    a.store(0, depth - 1);
+                }
+
+                a.constant(0, instruction.constant);
+                depth++;
+            } break;
+
+            case Opcode::Variable: {
+                if (depth > 0) {
+                    a.store(0, depth - 1);
+                }
+
+                // movsd xmm0, [rax]
+                a.movRax((std::uintptr_t)program.variables[instruction.index].second);
+                a.emit({0xF2, 0x0F, 0x10, 0x00});
+                depth++;
+            } break;
+
+            case Opcode::Slot: {
+                if (depth > 0) {
+                    a.store(0, depth - 1);
+                }
+
+                // movsd xmm0, [r12 + 8 * index]
+                a.emit({0xF2, 0x41, 0x0F, 0x10, 0x84, 0x24});
+                a.imm32(8 * instruction.index);
+                depth++;
+            } break;
+
+            case Opcode::Function: {
+                if (depth > 0) {
+                    a.store(0, depth - 1);
+                }
+
+                // mov rdi, imm64
+                a.emit({0x48, 0xBF});
+                a.imm64((std::uintptr_t)&program.functions[instruction.index].second);
+
+                if (instruction.args > 0) {
+                    // lea rsi, [rbx + 8 * slot]
+                    a.emit({0x48, 0x8D, 0xB3});
+                    a.imm32((std::uint32_t)(8 * (depth - instruction.args)));
+                } else {
+                    // xor esi, esi
+                    a.emit({0x31, 0xF6});
+                }
+
+                // mov edx, imm32; lea rcx, [rbx + 8 * slot]
+                a.emit({0xBA});
+                a.imm32(instruction.args);
+                a.emit({0x48, 0x8D, 0x8B});
+                a.imm32((std::uint32_t)(8 * result_slot));
+
+                a.call((std::uintptr_t)&callFunction);
+
+                // test eax, eax; jnz failure
+                a.emit({0x85, 0xC0, 0x0F, 0x85});
+                failures.push_back(a.code.size());
+                a.imm32(0);
+
+                a.load(0, result_slot);
+                depth = depth - instruction.args + 1;
+            } break;
+
+            case Opcode::Builtin: {
+                const BuiltinInfo &info = describe((Builtin)instruction.index);
+
+                // Argument is already in xmm0
+                if (instruction.args == 2) {
+                    // movapd xmm1, xmm0
+                    a.emit({0x66, 0x0F, 0x28, 0xC8});
+                    a.load(0, depth - 2);
+                }
+
+                if (info.arity == 1) {
+                    a.call((std::uintptr_t)info.unary);
+                } else {
+                    a.call((std::uintptr_t)info.binary);
+                }
+
+                depth = depth - instruction.args + 1;
+            } break;
+
+            case Opcode::Call: {
+                const Callback &callback = program.callbacks[instruction.index].second;
+
+                if (depth > 0) {
+                    a.store(0, depth - 1);
+                }
+
+                if (callback.address != nullptr && instruction.args <= DirectArgs) {
+                    for (std::uint32_t j = 0; j < instruction.args; j++) {
+                        a.load((int)j, depth - instruction.args + j);
+                    }
+
+                    a.call((std::uintptr_t)callback.address);
+                    depth = depth - instruction.args + 1;
+                    break;
+                }
+
+                // mov rdi, imm64
+                a.emit({0x48, 0xBF});
+                a.imm64((std::uintptr_t)&callback);
+
+                // lea rsi, [rbx + 8 * slot]; lea rdx, [rbx + 8 * slot]
+                a.emit({0x48, 0x8D, 0xB3});
+                a.imm32((std::uint32_t)(8 * (depth - instruction.args)));
+                a.emit({0x48, 0x8D, 0x93});
+                a.imm32((std::uint32_t)(8 * result_slot));
+
+                a.call((std::uintptr_t)&callCallback);
+
+                // test eax, eax; jnz failure
+                a.emit({0x85, 0xC0, 0x0F, 0x85});
+                failures.push_back(a.code.size());
+                a.imm32(0);
+
+                a.load(0, result_slot);
+                depth = depth - instruction.args + 1;
+            } break;
+
+            case Opcode::Pos: {
+            } break;
+
+            case Opcode::Neg: {
+                // xorpd xmm0, xmm1
+                a.constant(1, -0.0);
+                a.emit({0x66, 0x0F, 0x57, 0xC1});
+            } break;
+
+            case Opcode::PowInt: {
+                // movapd xmm1, xmm0
+                a.emit({0x66, 0x0F, 0x28, 0xC8});
+
+                for (double i = std::fabs(instruction.constant); i > 1; i--) {
+                    // mulsd xmm0, xmm1
+                    a.emit({0xF2, 0x0F, 0x59, 0xC1});
+                }
+
+                if (instruction.constant < 0) {
+                    // divsd xmm1, xmm0; movapd xmm0, xmm1
+                    a.constant(1, 1.0);
+                    a.emit({0xF2, 0x0F, 0x5E, 0xC8, 0x66, 0x0F, 0x28, 0xC1});
+                }
+            } break;
+
+            case Opcode::Less:
+            case Opcode::LessEqual:
+            case Opcode::Greater:
+            case Opcode::GreaterEqual:
+            case Opcode::Equal:
+            case Opcode::NotEqual: {
+                // Predicates of cmpsd, NaN compares as not equal
+                unsigned char predicate;
+
+                switch (instruction.opcode) {
+                case Opcode::Less:
+                case Opcode::Greater:
+                    predicate = 1;
+                    break;
+
+                case Opcode::LessEqual:
+                case Opcode::GreaterEqual:
+                    predicate = 2;
+                    break;
+
+                case Opcode::Equal:
+                    predicate = 0;
+                    break;
+
+                default:
+                    predicate = 4;
+                    break;
+                }
+
+                a.load(1, depth - 2);
+
+                if (instruction.opcode == Opcode::Greater || instruction.opcode == Opcode::GreaterEqual) {
+                    // cmpsd xmm0, xmm1, predicate (b < a or b <= a)
+                    a.emit({0xF2, 0x0F, 0xC2, 0xC1, predicate});
+                } else {
+                    // cmpsd xmm1, xmm0, predicate; movapd xmm0, xmm1
+                    a.emit({0xF2, 0x0F, 0xC2, 0xC8, predicate, 0x66, 0x0F, 0x28, 0xC1});
+                }
+
+                a.truth();
+                depth--;
+            } break;
+
+            case Opcode::Not: {
+                // xorpd xmm1, xmm1; cmpeqsd xmm0, xmm1
+                a.emit({0x66, 0x0F, 0x57, 0xC9, 0xF2, 0x0F, 0xC2, 0xC1, 0x00});
+                a.truth();
+            } break;
+
+            case Opcode::Condition: {
+                // xorpd xmm1, xmm1; ucomisd xmm0, xmm1
+                a.emit({0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1});
+                depth--;
+
+                // Value below the condition becomes top of the stack, whichever way the jump goes
+                if (depth > 0) {
+                    a.load(0, depth - 1);
+                }
+
+                // jp over (NaN is not zero); je else
+                a.emit({0x7A, 0x06, 0x0F, 0x84});
+                branches.push_back(Branch{a.label(), depth});
+            } break;
+
+            case Opcode::Else: {
+                // jmp end
+                a.emit({0xE9});
+                size_t jump = a.label();
+
+                a.land(branches.back().jump);
+                branches.back().jump = jump;
+                depth = branches.back().depth;
+            } break;
+
+            case Opcode::Select: {
+                a.land(branches.back().jump);
+                branches.pop_back();
+            } break;
+
+            case Opcode::Pow:
+            case Opcode::Mod: {
+                // movapd xmm1, xmm0
+                a.emit({0x66, 0x0F, 0x28, 0xC8});
+                a.load(0, depth - 2);
+
+                if (instruction.opcode == Opcode::Pow) {
+                    a.call((std::uintptr_t) static_cast<double (*)(double, double)>(std::pow));
+                } else {
+                    a.call((std::uintptr_t) static_cast<double (*)(double, double)>(std::fmod));
+                }
+
+                depth--;
+            } break;
+
+            default: {
+                unsigned char operation;
+
+                switch (instruction.opcode) {
+                case Opcode::Add:
+                    operation = 0x58;
+                    break;
+
+                case Opcode::Sub:
+                    operation = 0x5C;
+                    break;
+
+                case Opcode::Mul:
+                    operation = 0x59;
+                    break;
+
+                default:
+                    operation = 0x5E;
+                    break;
+                }
+
+                // <op>sd xmm1, xmm0; movapd xmm0, xmm1
+                a.load(1, depth - 2);
+                a.emit({0xF2, 0x0F, operation, 0xC8, 0x66, 0x0F, 0x28, 0xC1});
+                depth--;
+            } break;
+            }
+        }
+
+        // Write the result and return Error::Success
+        a.store(0, 0);
+        a.emit({0x31, 0xC0});
+
+        for (size_t failure : failures) {
+            a.land(failure);
+        }
+
+        // add rsp, 8; pop r12; pop rbx; ret
+        a.emit({0x48, 0x83, 0xC4, 0x08, 0x41, 0x5C, 0x5B, 0xC3});
+
+        return a.code;
+    }
+
+    std::shared_ptr<const Native> Native::compile(std::shared_ptr<const Program> program) {
+        if (!program || program->code.empty()) {
+            return nullptr;
+        }
+
+        std::vector<unsigned char> code = translate(*program);
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t size = (code.size() + page - 1) / page * page;
+
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+
+        std::memcpy(memory, code.data(), code.size());
+
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return nullptr;
+        }
+
+        return std::shared_ptr<const Native>(new Native(std::move(program), memory, size));
+    }
+
+    Error Native::run(double *stack, const double *frame) const {
+        int (*function)(double *, const double *);
+        std::memcpy(&function, &this->m_Code, sizeof(function));
+
+        int error = function(stack, frame);
+
+        if (error == ExceptionThrown) {
+            std::exception_ptr exception = thrown;
+            thrown = nullptr;
+            std::rethrow_exception(exception);
+        }
+
+        return (Error)error;
+    }
+
+    Native::~Native() {
+        munmap(this->m_Code, this->m_Size);
+    }
+#else
+    std::shared_ptr<const Native> Native::compile(std::shared_ptr<const Program>) {
+        return nullptr;
+    }
+
+    Error Native::run(double *, const double *) const {
+        return Error::SyntaxError;
+    }
+
+    Native::~Native() {}
+#endif
+
+    Native::Native(std::shared_ptr<const Program> program, void *code, size_t size) : m_Program(std::move(program)), m_Code(code), m_Size(size) {}
+}
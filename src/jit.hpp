@@ -0,0 +1,58 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_JIT_HEADER
+#define MATHEX_JIT_HEADER
+
+#include "mathex"
+#include "program.hpp"
+#include <memory>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define MATHEX_JIT 1
+#else
+#define MATHEX_JIT 0
+#endif
+
+namespace mathex {
+    // Program translated into native machine code.
+    class Native {
+    public:
+        ~Native();
+
+        // Translates program, or returns null if it is not supported on this platform.
+        static std::shared_ptr<const Native> compile(std::shared_ptr<const Program> program);
+
+        // Runs native code and writes the result into `stack[0]`. Stack has to fit `program.depth + 1` values,
+        // and frame has to hold `program.frame` values.
+        Error run(double *stack, const double *frame) const;
+
+    private:
+        Native(std::shared_ptr<const Program> program, void *code, size_t size);
+
+        std::shared_ptr<const Program> m_Program; // Keeps functions called from the code alive.
+        void *m_Code;
+        size_t m_Size;
+    };
+}
+
+#endif /* MATHEX_JIT_HEADER */
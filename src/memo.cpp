@@ -0,0 +1,179 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "memo.hpp"
+#include "mathex"
+#include <cstring>
+#include <vector>
+
+namespace mathex {
+    // Hashes bits of arguments.
+    static std::uint64_t hash(const double *args, size_t count) {
+        std::uint64_t hash = 14695981039346656037ull ^ count;
+
+        for (size_t i = 0; i < count; i++) {
+            std::uint64_t word;
+            std::memcpy(&word, args + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+
+        // Low bits of the product mix poorly, so high bits are folded into them
+        return hash ^ (hash >> 32);
+    }
+
+    Memo::Memo(size_t capacity) : capacity(capacity), hits(0), misses(0), m_Hand(0) {
+        // Table is at most half full, so probes stay short
+        size_t size = 2;
+
+        while (size < 2 * capacity) {
+            size *= 2;
+        }
+
+        this->m_Entries.reserve(capacity);
+        this->m_Table.assign(capacity > 0 ? size : 0, 0);
+    }
+
+    Error Memo::call(const Function &function, double *args, int argc, double &result) {
+        size_t count = argc > 0 ? (size_t)argc : 0;
+
+        if (this->find(args, count, result)) {
+            return Error::Success;
+        }
+
+        // Function may change its arguments, so they are kept aside
+        std::vector<double> key(args, args + count);
+        Error error = function(args, argc, result);
+
+        if (error == Error::Success) {
+            this->remember(key.data(), count, result);
+        }
+
+        return error;
+    }
+
+    double Memo::call(detail::Invoke invoke, const void *state, std::uint32_t arity, const double *args) {
+        double result;
+
+        if (!this->find(args, arity, result)) {
+            result = invoke(state, args);
+            this->remember(args, arity, result);
+        }
+
+        return result;
+    }
+
+    size_t Memo::probe(const double *args, size_t count, std::uint64_t hash) const {
+        size_t mask = this->m_Table.size() - 1;
+
+        // Arguments are compared bit by bit, so that NaN finds itself and zeros of different sign are told apart
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            std::uint32_t index = this->m_Table[i];
+
+            if (index == 0) {
+                return i;
+            }
+
+            const Entry &entry = this->m_Entries[index - 1];
+
+            if (entry.hash == hash && entry.args.size() == count && (count == 0 || std::memcmp(entry.args.data(), args, count * sizeof(double)) == 0)) {
+                return i;
+            }
+        }
+    }
+
+    void Memo::erase(size_t position) {
+        size_t mask = this->m_Table.size() - 1;
+
+        for (size_t i = (position + 1) & mask; this->m_Table[i] != 0; i = (i + 1) & mask) {
+            size_t home = this->m_Entries[this->m_Table[i] - 1].hash & mask;
+
+            // Entry moves into the hole unless its hash points between the hole and itself
+            bool between = position <= i ? (position < home && home <= i) : (position < home || home <= i);
+
+            if (!between) {
+                this->m_Table[position] = this->m_Table[i];
+                position = i;
+            }
+        }
+
+        this->m_Table[position] = 0;
+    }
+
+    bool Memo::find(const double *args, size_t count, double &result) {
+        if (this->capacity == 0) {
+            this->misses++;
+            return false;
+        }
+
+        std::uint64_t hash = mathex::hash(args, count);
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        std::uint32_t index = this->m_Table[this->probe(args, count, hash)];
+
+        if (index == 0) {
+            this->misses++;
+            return false;
+        }
+
+        Entry &entry = this->m_Entries[index - 1];
+        entry.referenced = true;
+        result = entry.result;
+        this->hits++;
+        return true;
+    }
+
+    void Memo::remember(const double *args, size_t count, double result) {
+        if (this->capacity == 0) {
+            return;
+        }
+
+        std::uint64_t hash = mathex::hash(args, count);
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        size_t position = this->probe(args, count, hash);
+
+        // Another thread may have remembered the same call meanwhile
+        if (this->m_Table[position] != 0) {
+            return;
+        }
+
+        if (this->m_Entries.size() < this->capacity) {
+            this->m_Entries.push_back(Entry{std::vector<double>(args, args + count), result, hash, false});
+            this->m_Table[position] = (std::uint32_t)this->m_Entries.size();
+            return;
+        }
+
+        while (this->m_Entries[this->m_Hand].referenced) {
+            this->m_Entries[this->m_Hand].referenced = false;
+            this->m_Hand = (this->m_Hand + 1) % this->capacity;
+        }
+
+        Entry &entry = this->m_Entries[this->m_Hand];
+        this->erase(this->probe(entry.args.data(), entry.args.size(), entry.hash));
+
+        entry.args.assign(args, args + count);
+        entry.result = result;
+        entry.hash = hash;
+        entry.referenced = false;
+
+        this->m_Table[this->probe(args, count, hash)] = (std::uint32_t)(this->m_Hand + 1);
+        this->m_Hand = (this->m_Hand + 1) % this->capacity;
+    }
+}
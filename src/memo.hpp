@@ -0,0 +1,78 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_MEMO_HEADER
+#define MATHEX_MEMO_HEADER
+
+#include "mathex"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace mathex {
+    // Identity of a pure function added to the config, shared by all programs calling it, and results of its recent calls
+    // remembered by their arguments, if capacity is not zero. Thread-safe, entries are guarded by one lock, which is not
+    // held while the function runs.
+    class Memo {
+    public:
+        Memo(size_t capacity);
+
+        // Returns remembered result for given arguments, or calls the function and remembers its result unless it failed.
+        Error call(const Function &function, double *args, int argc, double &result);
+
+        // Same as above, for function with fixed number of arguments.
+        double call(detail::Invoke invoke, const void *state, std::uint32_t arity, const double *args);
+
+        const size_t capacity;
+        std::atomic<size_t> hits;
+        std::atomic<size_t> misses;
+
+    private:
+        struct Entry {
+            std::vector<double> args;
+            double result;
+            std::uint64_t hash; // Hash of `args`.
+            bool referenced;    // Found since the clock hand last passed it.
+        };
+
+        // Looks up result for given arguments, compared bit by bit, counting a hit or a miss.
+        bool find(const double *args, size_t count, double &result);
+
+        // Remembers result for given arguments. When memo is full, entries that were not found since the clock hand last
+        // passed them are replaced first.
+        void remember(const double *args, size_t count, double result);
+
+        // Returns position in the table holding entry with given arguments, or empty position where it belongs.
+        size_t probe(const double *args, size_t count, std::uint64_t hash) const;
+
+        // Empties position in the table, moving following entries back so that each stays reachable from its hash.
+        void erase(size_t position);
+
+        std::mutex m_Mutex;
+        std::vector<Entry> m_Entries;        // At most `capacity`.
+        std::vector<std::uint32_t> m_Table;  // Open addressing by hash, index of entry plus one, or zero if empty.
+        size_t m_Hand;                       // Next entry to be replaced when memo is full.
+    };
+}
+
+#endif /* MATHEX_MEMO_HEADER */
@@ -0,0 +1,190 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "number.hpp"
+#include "pow5.hpp"
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace mathex {
+    // Unsigned 128-bit product of two 64-bit numbers.
+    static void multiply(std::uint64_t a, std::uint64_t b, std::uint64_t &high, std::uint64_t &low) {
+#if defined(__SIZEOF_INT128__)
+        __extension__ typedef unsigned __int128 uint128;
+        uint128 product = (uint128)a * b;
+        high = (std::uint64_t)(product >> 64);
+        low = (std::uint64_t)product;
+#else
+        std::uint64_t a_low = a & 0xFFFFFFFF, a_high = a >> 32;
+        std::uint64_t b_low = b & 0xFFFFFFFF, b_high = b >> 32;
+        std::uint64_t low_low = a_low * b_low, low_high = a_low * b_high, high_low = a_high * b_low, high_high = a_high * b_high;
+        std::uint64_t middle = (low_low >> 32) + (low_high & 0xFFFFFFFF) + (high_low & 0xFFFFFFFF);
+
+        high = high_high + (low_high >> 32) + (high_low >> 32) + (middle >> 32);
+        low = (middle << 32) | (low_low & 0xFFFFFFFF);
+#endif
+    }
+
+    static int leadingZeros(std::uint64_t value) {
+#if defined(__GNUC__)
+        return __builtin_clzll(value);
+#else
+        int zeros = 0;
+
+        while ((value & (1ull << 63)) == 0) {
+            value <<= 1;
+            zeros++;
+        }
+
+        return zeros;
+#endif
+    }
+
+    static double fromBits(std::uint64_t bits) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Eisel-Lemire algorithm (https://arxiv.org/abs/2101.11408), converting exact `mantissa * 10^exponent`.
+    // Returns false if the result cannot be determined from the 128-bit approximation of the power.
+    static bool eiselLemire(std::uint64_t mantissa, std::int64_t exponent, double &result) {
+        if (mantissa == 0 || exponent < SmallestPower5) {
+            result = 0;
+            return true;
+        }
+
+        if (exponent > LargestPower5) {
+            result = std::numeric_limits<double>::infinity();
+            return true;
+        }
+
+        int zeros = leadingZeros(mantissa);
+        mantissa <<= zeros;
+
+        const std::uint64_t *power = Powers5[exponent - SmallestPower5];
+        std::uint64_t high, low;
+        multiply(mantissa, power[0], high, low);
+
+        // Low bits below the 55 bits kept are all ones, so the truncated power may have lost a carry into them
+        if ((high & 0x1FF) == 0x1FF) {
+            std::uint64_t second_high, second_low;
+            multiply(mantissa, power[1], second_high, second_low);
+            low += second_high;
+            high += low < second_high ? 1 : 0;
+
+            if (low == 0xFFFFFFFFFFFFFFFF && (exponent < -27 || exponent > 55)) {
+                return false;
+            }
+        }
+
+        int upper_bit = (int)(high >> 63);
+        int shift = upper_bit + 9;
+        std::uint64_t bits = high >> shift;
+
+        // floor(log2(10^exponent)) + 63, plus bias of the binary exponent
+        std::int64_t binary_exponent = (((152170 + 65536) * exponent) >> 16) + 63 + upper_bit - zeros + 1023;
+
+        if (binary_exponent <= 0) {
+            // Subnormal results
+            if (-binary_exponent + 1 >= 64) {
+                result = 0;
+                return true;
+            }
+
+            bits >>= -binary_exponent + 1;
+            bits += bits & 1;
+            bits >>= 1;
+            binary_exponent = bits < (1ull << 52) ? 0 : 1;
+            result = fromBits(((std::uint64_t)binary_exponent << 52) | (bits & ((1ull << 52) - 1)));
+            return true;
+        }
+
+        // Halfway between two doubles is only possible when the power of five is exact, so round to even
+        if (low <= 1 && exponent >= -4 && exponent <= 23 && (bits & 3) == 1 && (bits << shift) == high) {
+            bits &= ~1ull;
+        }
+
+        bits += bits & 1;
+        bits >>= 1;
+
+        if (bits >= (2ull << 52)) {
+            bits = 1ull << 52;
+            binary_exponent++;
+        }
+
+        if (binary_exponent >= 0x7FF) {
+            result = std::numeric_limits<double>::infinity();
+            return true;
+        }
+
+        result = fromBits(((std::uint64_t)binary_exponent << 52) | (bits & ((1ull << 52) - 1)));
+        return true;
+    }
+
+    double Decimal::value(const char *literal, size_t length) const {
+        std::int64_t scientific = this->m_Negative ? -this->m_Scientific : this->m_Scientific;
+        std::int64_t exponent = this->m_Exponent + scientific;
+
+        // Clinger's fast path: both mantissa and power of ten are exact doubles, so a single rounding is correct
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        if (!this->m_Truncated && this->m_Mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+            double value = (double)this->m_Mantissa;
+            return exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+        }
+#endif
+
+        double value;
+
+        if (eiselLemire(this->m_Mantissa, exponent, value)) {
+            // Dropped digits put the exact value between the mantissa and the next one; if both round the same, so does it
+            double upper;
+
+            if (!this->m_Truncated || (eiselLemire(this->m_Mantissa + 1, exponent, upper) && upper == value)) {
+                return value;
+            }
+        }
+
+        // Rare cases are left to the C library, given digits without a decimal point, which is the only part of number
+        // syntax that depends on the locale
+        std::string digits;
+        std::int64_t fraction = 0;
+        bool point = false;
+
+        for (size_t i = 0; i < length; i++) {
+            if (literal[i] == '.') {
+                point = true;
+            } else {
+                digits += literal[i];
+                fraction += point ? 1 : 0;
+            }
+        }
+
+        digits += "e" + std::to_string(scientific - fraction);
+        return std::strtod(digits.c_str(), nullptr);
+    }
+}
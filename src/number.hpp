@@ -0,0 +1,80 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_NUMBER_HEADER
+#define MATHEX_NUMBER_HEADER
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mathex {
+    // Decimal number literal, collected digit by digit while it is scanned, and converted to the nearest double.
+    class Decimal {
+    public:
+        Decimal() : m_Mantissa(0), m_Exponent(0), m_Digits(0), m_Truncated(false), m_Scientific(0), m_Negative(false) {}
+
+        // Appends digit of integer part, or of fractional part if `fraction` is true.
+        void digit(char digit, bool fraction) {
+            if (this->m_Digits < MaxDigits) {
+                this->m_Mantissa = this->m_Mantissa * 10 + (std::uint64_t)(digit - '0');
+                this->m_Exponent -= fraction ? 1 : 0;
+
+                // Leading zeros are not significant
+                if (this->m_Mantissa != 0) {
+                    this->m_Digits++;
+                }
+            } else {
+                this->m_Truncated = this->m_Truncated || digit != '0';
+                this->m_Exponent += fraction ? 0 : 1;
+            }
+        }
+
+        // Appends digit of exponent in scientific notation.
+        void exponentDigit(char digit) {
+            // Larger exponents overflow or underflow anyway
+            if (this->m_Scientific < MaxExponent) {
+                this->m_Scientific = this->m_Scientific * 10 + (digit - '0');
+            }
+        }
+
+        void exponentSign(bool negative) {
+            this->m_Negative = negative;
+        }
+
+        // Returns the value correctly rounded to the nearest double. Characters of the literal before the exponent
+        // are only read when digits that did not fit into the mantissa make the result ambiguous.
+        double value(const char *literal, size_t length) const;
+
+    private:
+        static constexpr int MaxDigits = 19;                // Any 19 decimal digits fit into 64 bits.
+        static constexpr std::int64_t MaxExponent = 100000; // Keeps sums of exponents far from overflowing.
+
+        std::uint64_t m_Mantissa;  // First `MaxDigits` significant digits.
+        std::int64_t m_Exponent;   // Power of ten the mantissa is multiplied by.
+        int m_Digits;              // Number of significant digits in the mantissa.
+        bool m_Truncated;          // Whether nonzero digits were dropped from the mantissa.
+        std::int64_t m_Scientific; // Exponent in scientific notation.
+        bool m_Negative;           // Sign of exponent in scientific notation.
+    };
+}
+
+#endif /* MATHEX_NUMBER_HEADER */
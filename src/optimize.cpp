@@ -0,0 +1,314 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "builtins.hpp"
+#include "mathex"
+#include "program.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    // Node of expression tree, built back from reverse polish notation.
+    struct Node {
+        Instruction instruction;
+        std::vector<size_t> args; // Indices of argument nodes.
+    };
+
+    static bool isConstant(const Node &node) {
+        return node.instruction.opcode == Opcode::Constant;
+    }
+
+    // Checks that node is a constant with given value, distinguishing positive and negative zero.
+    static bool isConstant(const Node &node, double value) {
+        return isConstant(node) && node.instruction.constant == value && std::signbit(node.instruction.constant) == std::signbit(value);
+    }
+
+    // Checks that reciprocal of a value is exactly representable, so multiplying by it is same as dividing by the value.
+    static bool hasExactReciprocal(double value) {
+        int exponent;
+        return std::isfinite(value) && std::fabs(std::frexp(value, &exponent)) == 0.5 && std::isfinite(1 / value);
+    }
+
+    // Computes call of pure function with constant arguments, returning false if the function is not pure or fails.
+    static bool fold(const Program &program, const std::vector<Node> &nodes, const Node &node, double &value) {
+        const Instruction &instruction = node.instruction;
+        std::vector<double> args;
+
+        for (size_t arg : node.args) {
+            if (!isConstant(nodes[arg])) {
+                return false;
+            }
+
+            args.push_back(nodes[arg].instruction.constant);
+        }
+
+        // Function that throws is left to throw when the expression is evaluated, if the call is reached at all
+        try {
+            if (instruction.opcode == Opcode::Function) {
+                const Function &function = program.functions[instruction.index].second;
+                return program.memos[instruction.index] && function(args.empty() ? nullptr : args.data(), (int)args.size(), value) == Error::Success;
+            }
+
+            const Callback &callback = program.callbacks[instruction.index].second;
+
+            if (!program.callbackMemos[instruction.index]) {
+                return false;
+            }
+
+            value = callback.invoke(callback.state.get(), args.data());
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    // Checks whether node or any of its arguments calls a user function, which may fail, so the node cannot be left out.
+    static bool calls(const std::vector<Node> &nodes, size_t i) {
+        std::vector<size_t> pending = {i};
+
+        while (!pending.empty()) {
+            const Node &node = nodes[pending.back()];
+            pending.pop_back();
+
+            if (node.instruction.opcode == Opcode::Function || node.instruction.opcode == Opcode::Call) {
+                return true;
+            }
+
+            pending.insert(pending.end(), node.args.begin(), node.args.end());
+        }
+
+        return false;
+    }
+
+    static void simplify(const Program &program, std::vector<Node> &nodes, size_t i, Optimization optimization) {
+        Node &node = nodes[i];
+        Opcode opcode = node.instruction.opcode;
+        bool fast = optimization == Optimization::Fast;
+
+        if (opcode == Opcode::Constant || opcode == Opcode::Variable || opcode == Opcode::Slot) {
+            return;
+        }
+
+        // Calls of pure functions with constant arguments are computed right away
+        if (opcode == Opcode::Function || opcode == Opcode::Call) {
+            double value;
+
+            if (fold(program, nodes, node, value)) {
+                node = Node{Instruction(value), {}};
+            }
+
+            return;
+        }
+
+        // Operators with constant arguments are computed right away
+        bool folded = true;
+
+        for (size_t arg : node.args) {
+            folded = folded && isConstant(nodes[arg]);
+        }
+
+        if (folded) {
+            double a = nodes[node.args[0]].instruction.constant;
+            double value;
+
+            switch (opcode) {
+            case Opcode::Pos: {
+                value = a;
+            } break;
+
+            case Opcode::Neg: {
+                value = -a;
+            } break;
+
+            case Opcode::PowInt: {
+                value = powi(a, node.instruction.constant);
+            } break;
+
+            case Opcode::Builtin: {
+                double args[2] = {a, nodes[node.args.back()].instruction.constant};
+                value = call((Builtin)node.instruction.index, args);
+            } break;
+
+            case Opcode::Not: {
+                value = a == 0 ? 1 : 0;
+            } break;
+
+            case Opcode::Select: {
+                value = nodes[node.args[a != 0 ? 1 : 2]].instruction.constant;
+            } break;
+
+            default: {
+                value = apply(opcode, a, nodes[node.args[1]].instruction.constant);
+            } break;
+            }
+
+            node = Node{Instruction(value), {}};
+            return;
+        }
+
+        const Node &a = nodes[node.args[0]];
+        const Node &b = nodes[node.args.back()];
+
+        switch (opcode) {
+        case Opcode::Pos: {
+            // +x => x
+            node = Node(a);
+        } break;
+
+        case Opcode::Neg: {
+            // --x => x
+            if (a.instruction.opcode == Opcode::Neg) {
+                node = Node(nodes[a.args[0]]);
+            }
+        } break;
+
+        case Opcode::Add: {
+            // x + (-0) => x, and x + 0 => x (not for x = -0)
+            if (isConstant(b, -0.0) || (fast && isConstant(b, 0.0))) {
+                node = Node(a);
+            } else if (isConstant(a, -0.0) || (fast && isConstant(a, 0.0))) {
+                node = Node(b);
+            }
+        } break;
+
+        case Opcode::Sub: {
+            // x - 0 => x
+            if (isConstant(b, 0.0)) {
+                node = Node(a);
+            }
+        } break;
+
+        case Opcode::Mul: {
+            // x * 1 => x
+            if (isConstant(b, 1.0)) {
+                node = Node(a);
+            } else if (isConstant(a, 1.0)) {
+                node = Node(b);
+            }
+        } break;
+
+        case Opcode::Div: {
+            // x / c => x * (1 / c) (rounds differently unless 1 / c is exact)
+            if (isConstant(b, 1.0)) {
+                node = Node(a);
+            } else if (isConstant(b) && (hasExactReciprocal(b.instruction.constant) || (fast && b.instruction.constant != 0))) {
+                nodes[node.args[1]].instruction.constant = 1 / b.instruction.constant;
+                node.instruction.opcode = Opcode::Mul;
+            }
+        } break;
+
+        case Opcode::Select: {
+            // if(c, x, y) => x or y, for known c
+            if (isConstant(a)) {
+                node = Node(nodes[node.args[a.instruction.constant != 0 ? 1 : 2]]);
+            }
+        } break;
+
+        case Opcode::Pow: {
+            // x^0 => 1 (even for NaN, but not for x calling functions, whose errors would be lost)
+            if ((isConstant(b, 0.0) || isConstant(b, -0.0)) && !calls(nodes, node.args[0])) {
+                node = Node{Instruction(1.0), {}};
+                break;
+            }
+
+            // x^n => x * x * ... * x (rounds differently from `std::pow`)
+            double exponent = b.instruction.constant;
+
+            if (fast && isConstant(b) && exponent == std::trunc(exponent) && std::fabs(exponent) <= 64) {
+                if (exponent == 1) {
+                    node = Node(a);
+                } else {
+                    node = Node{Instruction(Opcode::PowInt, exponent), {node.args[0]}};
+                }
+            }
+        } break;
+
+        default: {
+        } break;
+        }
+    }
+
+    void optimize(Program &program, Optimization optimization) {
+        if (optimization == Optimization::None || program.code.empty()) {
+            return;
+        }
+
+        // Build the tree, arguments of each node always come before it
+        std::vector<Node> nodes;
+        std::vector<size_t> stack;
+
+        nodes.reserve(program.code.size());
+
+        for (const Instruction &instruction : program.code) {
+            // Branches are arguments of the `Select` ending the conditional, jumps are emitted back along with it
+            if (isJump(instruction.opcode)) {
+                continue;
+            }
+
+            size_t args_num = arity(instruction);
+            Node node{instruction, std::vector<size_t>(stack.end() - (std::ptrdiff_t)args_num, stack.end())};
+
+            stack.resize(stack.size() - args_num);
+            stack.push_back(nodes.size());
+            nodes.push_back(std::move(node));
+
+            simplify(program, nodes, nodes.size() - 1, optimization);
+        }
+
+        // Emit the tree back in reverse polish notation
+        std::vector<Instruction> code;
+        std::vector<std::pair<size_t, size_t>> pending; // Node and its next argument to emit.
+
+        pending.push_back(std::make_pair(stack.back(), (size_t)0));
+
+        while (!pending.empty()) {
+            size_t node = pending.back().first;
+            size_t arg = pending.back().second;
+
+            if (arg < nodes[node].args.size()) {
+                // Branches of conditional follow jumps
+                if (nodes[node].instruction.opcode == Opcode::Select && arg > 0) {
+                    code.push_back(Instruction(arg == 1 ? Opcode::Condition : Opcode::Else));
+                }
+
+                pending.back().second++;
+                pending.push_back(std::make_pair(nodes[node].args[arg], (size_t)0));
+                continue;
+            }
+
+            code.push_back(nodes[node].instruction);
+            pending.pop_back();
+        }
+
+        // Rewritten code has the same shape as the parsed code, but keep the parsed code if it were ever malformed
+        Code rewritten(std::move(code));
+        size_t depth = 0;
+
+        if (link(rewritten) && measure(rewritten, depth)) {
+            program.code = std::move(rewritten);
+            program.depth = depth;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_PARSER_HEADER
+#define MATHEX_PARSER_HEADER
+
+#include "mathex"
+#include "program.hpp"
+#include "symbols.hpp"
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mathex {
+    enum class LexemeType : unsigned char {
+        Number,     // Number literal.
+        Identifier, // Name of a variable, constant or function.
+        Symbol,     // Operator, parenthesis or comma.
+        Invalid,    // Malformed number literal or unknown character.
+    };
+
+    struct Lexeme {
+        LexemeType type;
+        char symbol;   // Character of the symbol, or its first character if it has two, if `type` is symbol.
+        size_t start;  // Position of the first character in the expression.
+        size_t length; // Number of characters.
+        double value;  // Value of the literal, if `type` is number.
+    };
+
+    inline bool readFlag(Flags flags, Flags flag) {
+        return static_cast<Flags>(static_cast<std::underlying_type<Flags>::type>(flags) & static_cast<std::underlying_type<Flags>::type>(flag)) != Flags::None;
+    }
+
+    // Splits expression into lexemes, skipping spaces. Lexing stops at the first invalid lexeme,
+    // which is still added, so that errors before it are reported first.
+    void lex(const std::string &expression, Flags flags, std::vector<Lexeme> &lexemes);
+
+    // Translates lexemes of expression into a program using shunting yard algorithm, looking up identifiers in `symbols`.
+    Error translate(const std::string &expression, const std::vector<Lexeme> &lexemes, const SymbolTable &symbols, Flags flags, Program &program);
+
+    // Translates expression built in code into a program, emitting the same instructions as for the expression written as text.
+    Error translate(const Term &term, const SymbolTable &symbols, Flags flags, Program &program);
+}
+
+#endif /* MATHEX_PARSER_HEADER */
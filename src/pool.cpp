@@ -0,0 +1,146 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "pool.hpp"
+#include "mathex"
+#include "program.hpp"
+#include <algorithm>
+
+namespace mathex {
+    Workers::Workers(size_t threads) : m_Size(threads), m_Queues(new Queue[threads]), m_Scratch(new Scratch[threads]), m_Task(nullptr), m_Remaining(0), m_Generation(0), m_Stop(false) {
+        for (size_t i = 0; i < threads; i++) {
+            this->m_Threads.emplace_back(&Workers::work, this, i);
+        }
+    }
+
+    Workers::~Workers() {
+        {
+            std::lock_guard<std::mutex> lock(this->m_Mutex);
+            this->m_Stop = true;
+        }
+
+        this->m_Wake.notify_all();
+
+        for (std::thread &thread : this->m_Threads) {
+            thread.join();
+        }
+    }
+
+    void Workers::run(size_t chunks, const Task &task) {
+        if (chunks == 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> running(this->m_Running);
+        size_t threads = this->m_Size;
+
+        this->m_Task = &task;
+        this->m_Remaining = chunks;
+
+        // Consecutive chunks go to the same worker, so that rows of each worker stay close in memory
+        for (size_t i = 0; i < threads; i++) {
+            std::lock_guard<std::mutex> lock(this->m_Queues[i].mutex);
+
+            for (size_t chunk = chunks * i / threads; chunk < chunks * (i + 1) / threads; chunk++) {
+                this->m_Queues[i].chunks.push_back(chunk);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(this->m_Mutex);
+        this->m_Generation++;
+        this->m_Wake.notify_all();
+
+        this->m_Done.wait(lock, [this]() { return this->m_Remaining == 0; });
+        this->m_Task = nullptr;
+    }
+
+    size_t Workers::size() const {
+        return this->m_Size;
+    }
+
+    void Workers::work(size_t worker) {
+        std::uint64_t generation = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->m_Mutex);
+                this->m_Wake.wait(lock, [&]() { return this->m_Stop || this->m_Generation != generation; });
+
+                if (this->m_Stop) {
+                    return;
+                }
+
+                generation = this->m_Generation;
+            }
+
+            size_t chunk;
+
+            while (this->take(worker, chunk)) {
+                (*this->m_Task)(chunk, this->m_Scratch[worker]);
+
+                if (--this->m_Remaining == 0) {
+                    std::lock_guard<std::mutex> lock(this->m_Mutex);
+                    this->m_Done.notify_all();
+                }
+            }
+        }
+    }
+
+    bool Workers::take(size_t worker, size_t &chunk) {
+        size_t threads = this->m_Size;
+
+        for (size_t i = 0; i < threads; i++) {
+            Queue &queue = this->m_Queues[(worker + i) % threads];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (queue.chunks.empty()) {
+                continue;
+            }
+
+            if (i == 0) {
+                chunk = queue.chunks.front();
+                queue.chunks.pop_front();
+            } else {
+                chunk = queue.chunks.back();
+                queue.chunks.pop_back();
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    ThreadPool::ThreadPool(size_t threads /* = 0 */) {
+        if (threads == 0) {
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+
+        this->m_Workers.reset(new Workers(threads));
+    }
+
+    ThreadPool::~ThreadPool() {}
+
+    size_t ThreadPool::size() const {
+        return this->m_Workers->size();
+    }
+}
@@ -0,0 +1,80 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_POOL_HEADER
+#define MATHEX_POOL_HEADER
+
+#include "mathex"
+#include "program.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mathex {
+    // Threads of a pool, each with its own queue of chunks and evaluation memory.
+    // Workers take chunks from the front of their own queue and steal from the back of others when it runs out.
+    class Workers {
+    public:
+        using Task = std::function<void(size_t chunk, Scratch &scratch)>;
+
+        Workers(size_t threads);
+        ~Workers();
+
+        // Runs `task` for each chunk from 0 to `chunks` and waits until all of them are done.
+        // Only one run happens at a time; concurrent calls wait for each other.
+        void run(size_t chunks, const Task &task);
+
+        size_t size() const;
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<size_t> chunks;
+        };
+
+        void work(size_t worker);
+        bool take(size_t worker, size_t &chunk);
+
+        const size_t m_Size; // Known before threads start, unlike size of `m_Threads`.
+        std::vector<std::thread> m_Threads;
+        std::unique_ptr<Queue[]> m_Queues;
+        std::unique_ptr<Scratch[]> m_Scratch;
+
+        std::mutex m_Running; // Held for the whole run.
+        const Task *m_Task;   // Task of the current run, published to workers through the queues.
+        std::atomic<size_t> m_Remaining;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::condition_variable m_Done;
+        std::uint64_t m_Generation; // Incremented for each run to wake up workers. Guarded by `m_Mutex`.
+        bool m_Stop;                // Guarded by `m_Mutex`.
+    };
+}
+
+#endif /* MATHEX_POOL_HEADER */
@@ -0,0 +1,256 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_PROGRAM_HEADER
+#define MATHEX_PROGRAM_HEADER
+
+#include "mathex"
+#include "token.hpp"
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    // Single step of the program.
+    struct Instruction {
+        Instruction() = default;
+        Instruction(Opcode opcode) : opcode(opcode), args(0), index(0) {}
+        Instruction(double constant) : opcode(Opcode::Constant), args(0), constant(constant) {}
+        Instruction(Opcode opcode, double constant) : opcode(opcode), args(0), constant(constant) {}
+        Instruction(Opcode opcode, std::uint32_t index, std::uint32_t args = 0) : opcode(opcode), args(args), index(index) {}
+
+        Opcode opcode;
+        std::uint32_t args; // Number of arguments of function call.
+        union {
+            double constant;     // Value of constant, or exponent of integer power.
+            std::uint32_t index; // Index of variable or function in the program, of value in the frame, or built-in function.
+        };
+    };
+
+    // Checks whether instruction only marks a branch of a conditional. Code that evaluates all branches skips them.
+    inline bool isJump(Opcode opcode) {
+        return opcode == Opcode::Condition || opcode == Opcode::Else;
+    }
+
+    // Number of values instruction takes from the stack. Every instruction except jumps pushes one value.
+    // `Select` takes condition and values of both branches, as if all of them were evaluated.
+    inline std::uint32_t arity(const Instruction &instruction) {
+        switch (instruction.opcode) {
+        case Opcode::Constant:
+        case Opcode::Variable:
+        case Opcode::Slot:
+        case Opcode::Condition:
+        case Opcode::Else:
+            return 0;
+
+        case Opcode::Function:
+        case Opcode::Call:
+        case Opcode::Builtin:
+            return instruction.args;
+
+        case Opcode::Pos:
+        case Opcode::Neg:
+        case Opcode::PowInt:
+        case Opcode::Not:
+            return 1;
+
+        case Opcode::Select:
+            return 3;
+
+        default:
+            return 2;
+        }
+    }
+
+    // Applies binary operator to given values.
+    inline double apply(Opcode opcode, double a, double b) {
+        switch (opcode) {
+        case Opcode::Add:
+            return a + b;
+
+        case Opcode::Sub:
+            return a - b;
+
+        case Opcode::Mul:
+            return a * b;
+
+        case Opcode::Div:
+            return a / b;
+
+        case Opcode::Pow:
+            return std::pow(a, b);
+
+        case Opcode::Mod:
+            return std::fmod(a, b);
+
+        case Opcode::Less:
+            return a < b ? 1 : 0;
+
+        case Opcode::LessEqual:
+            return a <= b ? 1 : 0;
+
+        case Opcode::Greater:
+            return a > b ? 1 : 0;
+
+        case Opcode::GreaterEqual:
+            return a >= b ? 1 : 0;
+
+        case Opcode::Equal:
+            return a == b ? 1 : 0;
+
+        case Opcode::NotEqual:
+            return a != b ? 1 : 0;
+
+        default:
+            return a;
+        }
+    }
+
+    // Raises value to nonzero integer power, multiplying it by itself from left to right.
+    inline double powi(double x, double exponent) {
+        double result = x;
+
+        for (double i = std::fabs(exponent); i > 1; i--) {
+            result = result * x;
+        }
+
+        return exponent < 0 ? 1 / result : result;
+    }
+
+    // Instructions of a program, either owned by it or viewed in memory kept alive by `owner`, such as a mapped file.
+    class Code {
+    public:
+        Code() = default;
+        Code(std::vector<Instruction> instructions) : m_Owned(std::move(instructions)) {}
+        Code(const Instruction *data, size_t size, std::shared_ptr<const void> owner) : m_Data(data), m_Size(size), m_Owner(std::move(owner)) {}
+
+        // Appends instruction to owned code.
+        void push_back(const Instruction &instruction) {
+            this->m_Owned.push_back(instruction);
+        }
+
+        const Instruction *data() const {
+            return this->m_Owner ? this->m_Data : this->m_Owned.data();
+        }
+
+        size_t size() const {
+            return this->m_Owner ? this->m_Size : this->m_Owned.size();
+        }
+
+        bool empty() const {
+            return this->size() == 0;
+        }
+
+        const Instruction *begin() const {
+            return this->data();
+        }
+
+        const Instruction *end() const {
+            return this->data() + this->size();
+        }
+
+        const Instruction &operator[](size_t i) const {
+            return this->data()[i];
+        }
+
+        // Instruction of owned code, for patching it after it was appended.
+        Instruction &at(size_t i) {
+            return this->m_Owned[i];
+        }
+
+    private:
+        std::vector<Instruction> m_Owned;
+        const Instruction *m_Data = nullptr;
+        size_t m_Size = 0;
+        std::shared_ptr<const void> m_Owner;
+    };
+
+    class Program {
+    public:
+        Code code;                 // Instructions in reverse polish notation.
+        size_t depth = 0;          // Maximum number of values on the stack while running `code`.
+        std::uint32_t frame = 0;   // Number of frame values `code` reads, one past its highest slot.
+        Flags flags = Flags::None; // Parameters of the config the program was parsed with.
+
+        std::vector<std::string> symbols;                              // Names of all identifiers used in `code`.
+        std::vector<std::pair<std::string, const double *>> variables; // Variables used in `code`, with their names.
+        std::vector<std::pair<std::string, std::uint32_t>> slots;      // Frame variables used in `code`, with their names.
+        std::vector<std::pair<std::string, Function>> functions;       // Functions used in `code`, with their names.
+        std::vector<Derivative> derivatives;                           // Derivatives of `functions`, null if not known.
+        std::vector<std::shared_ptr<Memo>> memos;                      // Memos of `functions`, null for functions that are not pure.
+        std::vector<std::pair<std::string, Callback>> callbacks;       // Functions with fixed number of arguments used in `code`.
+        std::vector<std::shared_ptr<Memo>> callbackMemos;              // Memos of `callbacks`, null for functions that are not pure.
+    };
+
+    // Points jumps of every conditional in owned code to the start of its else branch and past its end. Fails unless
+    // jumps of every conditional come in order.
+    bool link(Code &code);
+
+    // Computes maximum number of values on the stack while running code with all branches evaluated, which is also
+    // enough when jumping over them. Fails unless code leaves one value and its conditionals are properly nested,
+    // each branch computing one value without taking any from below it, and jumps point where `link` points them.
+    bool measure(const Code &code, size_t &depth);
+
+    // Rewrites program to do less work, changing results only if allowed by optimization level.
+    void optimize(Program &program, Optimization optimization);
+
+    // Number of rows evaluated together by each step of a batch.
+    constexpr size_t BatchSize = 256;
+
+    // Memory reused between evaluations, so that they do not allocate.
+    class Scratch {
+    public:
+        std::vector<double> stack;
+        std::vector<const double *> sources;
+        std::vector<std::pair<const double *, bool>> branches; // Conditions of open conditionals in batches.
+    };
+
+    // Runs compiled program and writes the value left on the stack into `result`.
+    // Slot variables are read from `frame`, which has to hold at least `program.frame` values.
+    Error execute(const Program &program, double &result, const double *frame = nullptr);
+
+    // Same as above, using given stack which has to fit at least `program.depth` values.
+    Error execute(const Program &program, double *stack, double &result, const double *frame = nullptr);
+
+    // Runs compiled program for `count` rows, reading variables from `columns`.
+    Error execute(const Program &program, const Columns &columns, double *results, size_t count);
+
+    // Same as above, reusing memory of `scratch`.
+    Error execute(const Program &program, const Columns &columns, double *results, size_t count, Scratch &scratch);
+
+    // Runs compiled program for `count` records, reading slot variables of record `i` from `frames + i * stride`.
+    Error execute(const Program &program, const double *frames, size_t stride, double *results, size_t count, Scratch &scratch);
+
+    // Finds columns of program variables, null for variables that do not have one.
+    void resolve(const Program &program, const Columns &columns, std::vector<const double *> &sources);
+
+    // Runs compiled program for rows from `begin` to `end`, reading variables from `sources` found by `resolve`.
+    // Rows are evaluated in blocks of `BatchSize` starting at `begin`, and evaluation stops at the first failed block.
+    // Slot variables of row `i` are read from `frames + i * stride`.
+    Error execute(const Program &program, const double *const *sources, double *results, size_t begin, size_t end, Scratch &scratch,
+                  const double *frames = nullptr, size_t stride = 0);
+}
+
+#endif /* MATHEX_PROGRAM_HEADER */
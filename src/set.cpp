@@ -0,0 +1,318 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "set.hpp"
+#include "builtins.hpp"
+#include "mathex"
+#include "program.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    void merge(const std::vector<const Program *> &programs, Dag &dag) {
+        // Steps are hash-consed: key of a step is its operation followed by registers of its arguments
+        std::unordered_map<std::string, std::uint32_t> known;
+        std::vector<std::uint32_t> stack;
+        std::string key;
+
+        // Memos of functions of the graph, since pure functions are the same in all programs
+        std::vector<const Memo *> memos, callbacks;
+
+        // Adds step unless pure and known already, returning its register
+        auto add = [&](const Instruction &step, const std::uint32_t *top, std::uint32_t args, bool pure, std::uint32_t guard) -> std::uint32_t {
+            key.assign(1, (char)step.opcode);
+            key.append(reinterpret_cast<const char *>(&step.args), sizeof(step.args));
+
+            if (step.opcode == Opcode::Constant || step.opcode == Opcode::PowInt) {
+                key.append(reinterpret_cast<const char *>(&step.constant), sizeof(step.constant));
+            } else {
+                key.append(reinterpret_cast<const char *>(&step.index), sizeof(step.index));
+            }
+
+            key.append(reinterpret_cast<const char *>(top), sizeof(std::uint32_t) * args);
+
+            // Pure call in a branch is only the same as calls in branches taken in the same cases
+            key.append(reinterpret_cast<const char *>(&guard), sizeof(guard));
+
+            std::uint32_t index = (std::uint32_t)dag.steps.size();
+            auto fetched = pure ? known.find(key) : known.end();
+
+            if (fetched != known.end()) {
+                return fetched->second;
+            }
+
+            dag.steps.push_back(Step{step, (std::uint32_t)dag.operands.size(), guard});
+            dag.operands.insert(dag.operands.end(), top, top + args);
+
+            if (pure) {
+                known.emplace(key, index);
+            }
+
+            return index;
+        };
+
+        for (const Program *program : programs) {
+            if (program == nullptr || program->code.empty()) {
+                dag.complete = false;
+                dag.outputs.push_back(0);
+                continue;
+            }
+
+            // Functions of different configs may share a name, so impure functions are only shared within a program
+            std::vector<std::uint32_t> functions, indices;
+
+            for (size_t i = 0; i < program->functions.size(); i++) {
+                const Memo *memo = program->memos[i].get();
+                auto fetched = memo ? std::find(memos.begin(), memos.end(), memo) : memos.end();
+                functions.push_back((std::uint32_t)(fetched - memos.begin()));
+
+                if (fetched == memos.end()) {
+                    memos.push_back(memo);
+                    dag.functions.push_back(program->functions[i]);
+                }
+            }
+
+            for (size_t i = 0; i < program->callbacks.size(); i++) {
+                const Memo *memo = program->callbackMemos[i].get();
+                auto fetched = memo ? std::find(callbacks.begin(), callbacks.end(), memo) : callbacks.end();
+                indices.push_back((std::uint32_t)(fetched - callbacks.begin()));
+
+                if (fetched == callbacks.end()) {
+                    callbacks.push_back(memo);
+                    dag.callbacks.push_back(program->callbacks[i]);
+                }
+            }
+
+            dag.frame = std::max(dag.frame, program->frame);
+
+            // Registers of conditions of the enclosing conditionals, and whether each of them is in its then branch
+            std::vector<std::pair<std::uint32_t, bool>> branches;
+
+            for (const Instruction &instruction : program->code) {
+                std::uint32_t args = arity(instruction);
+                std::uint32_t *top = stack.data() + stack.size() - args;
+                Instruction step = instruction;
+                bool pure = true;
+                std::uint32_t guard = 0;
+
+                switch (instruction.opcode) {
+                case Opcode::Pos: {
+                    continue;
+                } break;
+
+                case Opcode::Condition: {
+                    branches.push_back(std::make_pair(stack.back(), true));
+                    continue;
+                } break;
+
+                case Opcode::Else: {
+                    branches.back().second = false;
+                    continue;
+                } break;
+
+                case Opcode::Select: {
+                    branches.pop_back();
+                } break;
+
+                case Opcode::Variable: {
+                    // Variables are the same when they refer to the same value
+                    const auto &variable = program->variables[instruction.index];
+                    auto fetched = std::find_if(dag.variables.begin(), dag.variables.end(), [&](const std::pair<std::string, const double *> &entry) { return entry.second == variable.second; });
+                    step.index = (std::uint32_t)(fetched - dag.variables.begin());
+
+                    if (fetched == dag.variables.end()) {
+                        dag.variables.push_back(variable);
+                    }
+                } break;
+
+                case Opcode::Function: {
+                    step.index = functions[instruction.index];
+                    pure = memos[step.index] != nullptr;
+                } break;
+
+                case Opcode::Call: {
+                    step.index = indices[instruction.index];
+                    pure = callbacks[step.index] != nullptr;
+                } break;
+
+                case Opcode::Add:
+                case Opcode::Mul: {
+                    // Both give the same result for operands in either order
+                    if (top[0] > top[1]) {
+                        std::swap(top[0], top[1]);
+                    }
+                } break;
+
+                default: {
+                } break;
+                }
+
+                if (instruction.opcode == Opcode::Function || instruction.opcode == Opcode::Call || instruction.opcode == Opcode::Builtin) {
+                    dag.arity = std::max(dag.arity, args);
+                }
+
+                // Guard of function in a branch is 1 when all enclosing conditions lead to it, it is never step 0 as it has arguments
+                if ((instruction.opcode == Opcode::Function || instruction.opcode == Opcode::Call) && !branches.empty()) {
+                    std::uint32_t zero = add(Instruction(0.0), nullptr, 0, true, 0);
+
+                    for (const auto &branch : branches) {
+                        std::uint32_t operands[2] = {branch.first, zero};
+                        std::uint32_t taken = add(Instruction(branch.second ? Opcode::NotEqual : Opcode::Equal), operands, 2, true, 0);
+
+                        if (guard != 0) {
+                            std::uint32_t both[2] = {std::min(guard, taken), std::max(guard, taken)};
+                            taken = add(Instruction(Opcode::Mul), both, 2, true, 0);
+                        }
+
+                        guard = taken;
+                    }
+                }
+
+                std::uint32_t index = add(step, top, args, pure, guard);
+
+                stack.resize(stack.size() - args);
+                stack.push_back(index);
+            }
+
+            dag.outputs.push_back(stack.back());
+            stack.clear();
+        }
+    }
+
+    Error execute(const Dag &dag, double *registers, double *arguments, double *results, const double *frame) {
+        if (!dag.complete) {
+            return Error::SyntaxError;
+        }
+
+        if (dag.frame > 0 && frame == nullptr) {
+            return Error::Undefined;
+        }
+
+        for (size_t i = 0; i < dag.steps.size(); i++) {
+            const Instruction &instruction = dag.steps[i].instruction;
+            const std::uint32_t *args = dag.operands.data() + dag.steps[i].first;
+            double &value = registers[i];
+
+            switch (instruction.opcode) {
+            case Opcode::Constant: {
+                value = instruction.constant;
+            } break;
+
+            case Opcode::Variable: {
+                value = *dag.variables[instruction.index].second;
+            } break;
+
+            case Opcode::Slot: {
+                value = frame[instruction.index];
+            } break;
+
+            case Opcode::Function:
+            case Opcode::Call:
+            case Opcode::Builtin: {
+                if (dag.steps[i].guard != 0 && registers[dag.steps[i].guard] == 0) {
+                    value = 0;
+                    break;
+                }
+
+                for (std::uint32_t j = 0; j < instruction.args; j++) {
+                    arguments[j] = registers[args[j]];
+                }
+
+                if (instruction.opcode == Opcode::Builtin) {
+                    value = call((Builtin)instruction.index, arguments);
+                } else if (instruction.opcode == Opcode::Call) {
+                    const Callback &callback = dag.callbacks[instruction.index].second;
+                    value = callback.invoke(callback.state.get(), arguments);
+                } else {
+                    Error error = dag.functions[instruction.index].second(instruction.args > 0 ? arguments : nullptr, (int)instruction.args, value);
+
+                    if (error != Error::Success) {
+                        return error;
+                    }
+                }
+            } break;
+
+            case Opcode::Neg: {
+                value = -registers[args[0]];
+            } break;
+
+            case Opcode::PowInt: {
+                value = powi(registers[args[0]], instruction.constant);
+            } break;
+
+            case Opcode::Not: {
+                value = registers[args[0]] == 0 ? 1 : 0;
+            } break;
+
+            case Opcode::Select: {
+                value = registers[args[0]] != 0 ? registers[args[1]] : registers[args[2]];
+            } break;
+
+            default: {
+                value = apply(instruction.opcode, registers[args[0]], registers[args[1]]);
+            } break;
+            }
+        }
+
+        for (size_t i = 0; i < dag.outputs.size(); i++) {
+            results[i] = registers[dag.outputs[i]];
+        }
+
+        return Error::Success;
+    }
+
+    ExpressionSet::ExpressionSet() : m_Dag(std::make_shared<Dag>()) {}
+
+    ExpressionSet::ExpressionSet(const std::vector<Expression> &expressions) {
+        std::vector<const Program *> programs;
+        std::shared_ptr<Dag> dag = std::make_shared<Dag>();
+
+        for (const Expression &expression : expressions) {
+            programs.push_back(expression.m_Program.get());
+        }
+
+        merge(programs, *dag);
+        this->m_Dag = std::move(dag);
+    }
+
+    ExpressionSet::~ExpressionSet() {}
+
+    Error ExpressionSet::evaluate(double *results, const double *frame /* = nullptr */) const {
+        std::vector<double> registers(this->m_Dag->steps.size() + this->m_Dag->arity);
+        return execute(*this->m_Dag, registers.data(), registers.data() + this->m_Dag->steps.size(), results, frame);
+    }
+
+    size_t ExpressionSet::size() const {
+        return this->m_Dag->outputs.size();
+    }
+
+    size_t ExpressionSet::operations() const {
+        return this->m_Dag->steps.size();
+    }
+}
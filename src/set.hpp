@@ -0,0 +1,66 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_SET_HEADER
+#define MATHEX_SET_HEADER
+
+#include "mathex"
+#include "program.hpp"
+#include "token.hpp"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    // Operation reading its arguments from registers of earlier operations, and writing its result into the register with
+    // the same index as the operation.
+    struct Step {
+        Instruction instruction; // Operation, with index into tables of the graph.
+        std::uint32_t first;     // Index of register of the first argument in `Dag::operands`.
+        std::uint32_t guard;     // Register which is zero when function call is in a branch not taken, or 0 if always called.
+    };
+
+    class Dag {
+    public:
+        std::vector<Step> steps;             // Each after the steps it reads.
+        std::vector<std::uint32_t> operands; // Registers of arguments of all steps.
+        std::vector<std::uint32_t> outputs;  // Register holding result of each expression.
+        std::uint32_t frame = 0;             // Number of frame values the steps read.
+        std::uint32_t arity = 0;             // Maximum number of arguments of a function call.
+        bool complete = true;                // False if any of the expressions was empty.
+
+        std::vector<std::pair<std::string, const double *>> variables;
+        std::vector<std::pair<std::string, Function>> functions;
+        std::vector<std::pair<std::string, Callback>> callbacks;
+    };
+
+    // Merges programs into a graph, in which steps that compute the same value appear once. Both branches of conditionals
+    // are computed and one of them is selected, but functions are only called in the branch taken.
+    void merge(const std::vector<const Program *> &programs, Dag &dag);
+
+    // Runs steps of the graph and writes result of each expression into `results`. Registers have to fit a value for every
+    // step, and `arguments` has to fit `dag.arity` values.
+    Error execute(const Dag &dag, double *registers, double *arguments, double *results, const double *frame);
+}
+
+#endif /* MATHEX_SET_HEADER */
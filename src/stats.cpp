@@ -0,0 +1,199 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "stats.hpp"
+#include "mathex"
+#include <algorithm>
+
+namespace mathex {
+    // Counters are written by one thread only, so there is no need for atomic increment
+    static void add(std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static size_t read(const std::atomic<std::uint64_t> &counter) {
+        return (size_t)counter.load(std::memory_order_relaxed);
+    }
+
+    Counters::Counters() : evaluations(0), lookups(0) {
+        for (std::atomic<std::uint64_t> &errors : this->errors) {
+            errors = 0;
+        }
+
+        for (Timing &timing : this->timings) {
+            timing.count = 0;
+            timing.nanoseconds = 0;
+
+            for (std::atomic<std::uint64_t> &bucket : timing.histogram) {
+                bucket = 0;
+            }
+        }
+    }
+
+    void Counters::time(Phase phase, std::chrono::steady_clock::duration duration) {
+        std::uint64_t nanoseconds = (std::uint64_t)std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0);
+        Timing &timing = this->timings[(size_t)phase];
+        size_t bucket = 0;
+
+        while (bucket + 1 < Buckets && nanoseconds >> (bucket + 1) != 0) {
+            bucket++;
+        }
+
+        add(timing.count, 1);
+        add(timing.nanoseconds, nanoseconds);
+        add(timing.histogram[bucket], 1);
+    }
+
+    // Checks whether error is counted. Lists every error code without a default, so that a new one does not compile
+    // until it is listed here; the last one listed has to be the last one counted by `ErrorCodes`.
+    static bool counted(Error error) {
+        switch (error) {
+        case Error::Success:
+            return false;
+
+        case Error::DivisionByZero:
+        case Error::SyntaxError:
+        case Error::Undefined:
+        case Error::InvalidArgs:
+        case Error::IncorrectArgsNum:
+        case Error::NotDifferentiable:
+        case Error::InvalidFormat:
+        case Error::CircularDependency:
+            return true;
+        }
+
+        // User functions can return values outside of the enumeration
+        return false;
+    }
+
+    static_assert(ErrorCodes == (size_t)Error::CircularDependency + 1, "every error code listed in counted() is counted");
+    static_assert(std::tuple_size<decltype(Statistics::errors)>::value == Counters::Errors, "statistics have a counter of every error code");
+
+    void Counters::evaluated(Error error) {
+        add(this->evaluations, 1);
+
+        if (counted(error)) {
+            add(this->errors[(size_t)error], 1);
+        }
+    }
+
+    void Counters::lookedUp(size_t count) {
+        add(this->lookups, count);
+    }
+
+    // Source of unique recorder ids; zero marks unused slots of counter caches.
+    static std::atomic<std::uint64_t> recorders(0);
+
+    // Counters recently used by this thread, indexed by recorder id.
+    struct Local {
+        std::uint64_t recorder;
+        Counters *counters;
+    };
+
+    static constexpr size_t LocalSlots = 8;
+    static thread_local Local locals[LocalSlots];
+
+    Recorder::Recorder() : m_Id(++recorders), m_Enabled(false) {}
+
+    void Recorder::enable(bool enabled) {
+        this->m_Enabled = enabled;
+    }
+
+    Counters *Recorder::local() {
+        Local &slot = locals[this->m_Id % LocalSlots];
+
+        if (slot.recorder == this->m_Id) {
+            return slot.counters;
+        }
+
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        std::thread::id thread = std::this_thread::get_id();
+        auto fetched = std::find_if(this->m_Threads.begin(), this->m_Threads.end(), [&](const std::pair<std::thread::id, std::unique_ptr<Counters>> &entry) { return entry.first == thread; });
+
+        // Counters of threads that exited are kept, since their counts are still part of the totals
+        if (fetched == this->m_Threads.end()) {
+            this->m_Threads.emplace_back(thread, std::unique_ptr<Counters>(new Counters()));
+            fetched = this->m_Threads.end() - 1;
+        }
+
+        slot.recorder = this->m_Id;
+        slot.counters = fetched->second.get();
+        return slot.counters;
+    }
+
+    void Recorder::sum(Statistics &statistics) {
+        statistics = Statistics();
+
+        for (const auto &thread : this->m_Threads) {
+            const Counters &counters = *thread.second;
+            statistics.evaluations += read(counters.evaluations);
+            statistics.lookups += read(counters.lookups);
+
+            for (size_t i = 0; i < Counters::Errors; i++) {
+                statistics.errors[i] += read(counters.errors[i]);
+            }
+
+            Statistics::Timing *timings[] = {&statistics.tokenize, &statistics.parse, &statistics.execute};
+
+            for (size_t phase = 0; phase < 3; phase++) {
+                const Counters::Timing &timing = counters.timings[phase];
+                timings[phase]->count += read(timing.count);
+                timings[phase]->total += std::chrono::nanoseconds(read(timing.nanoseconds));
+
+                for (size_t i = 0; i < Counters::Buckets; i++) {
+                    timings[phase]->histogram[i] += read(timing.histogram[i]);
+                }
+            }
+        }
+    }
+
+    void Recorder::collect(Statistics &statistics) {
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        this->sum(statistics);
+
+        // Counters are never cleared, since only their threads can write them
+        const Statistics &baseline = this->m_Baseline;
+        statistics.evaluations -= baseline.evaluations;
+        statistics.lookups -= baseline.lookups;
+
+        for (size_t i = 0; i < Counters::Errors; i++) {
+            statistics.errors[i] -= baseline.errors[i];
+        }
+
+        Statistics::Timing *timings[] = {&statistics.tokenize, &statistics.parse, &statistics.execute};
+        const Statistics::Timing *base[] = {&baseline.tokenize, &baseline.parse, &baseline.execute};
+
+        for (size_t phase = 0; phase < 3; phase++) {
+            timings[phase]->count -= base[phase]->count;
+            timings[phase]->total -= base[phase]->total;
+
+            for (size_t i = 0; i < Counters::Buckets; i++) {
+                timings[phase]->histogram[i] -= base[phase]->histogram[i];
+            }
+        }
+    }
+
+    void Recorder::reset() {
+        std::lock_guard<std::mutex> lock(this->m_Mutex);
+        this->sum(this->m_Baseline);
+    }
+}
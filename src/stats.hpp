@@ -0,0 +1,124 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_STATS_HEADER
+#define MATHEX_STATS_HEADER
+
+#include "mathex"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    enum class Phase {
+        Tokenize,
+        Parse,
+        Execute,
+    };
+
+    // Counters of a single thread. Only the owning thread writes them, so updates are plain relaxed
+    // loads and stores without read-modify-write, and other threads can read them at any time.
+    class Counters {
+    public:
+        static constexpr size_t Buckets = 32;
+        static constexpr size_t Errors = ErrorCodes;
+
+        struct Timing {
+            std::atomic<std::uint64_t> count;
+            std::atomic<std::uint64_t> nanoseconds;
+            std::atomic<std::uint64_t> histogram[Buckets];
+        };
+
+        Counters();
+
+        void time(Phase phase, std::chrono::steady_clock::duration duration);
+        void evaluated(Error error);
+        void lookedUp(size_t count);
+
+        std::atomic<std::uint64_t> evaluations;
+        std::atomic<std::uint64_t> errors[Errors];
+        std::atomic<std::uint64_t> lookups;
+        Timing timings[3];
+
+    private:
+        char m_Padding[64]; // Keeps counters of different threads on different cache lines.
+    };
+
+    // Statistics of a config, collected per thread and summed up when read.
+    class Recorder {
+    public:
+        Recorder();
+
+        void enable(bool enabled);
+
+        // Returns counters of the calling thread, or null if statistics are disabled.
+        Counters *counters() {
+            return this->m_Enabled.load(std::memory_order_relaxed) ? this->local() : nullptr;
+        }
+
+        // Sums counters of all threads since the last reset.
+        void collect(Statistics &statistics);
+
+        void reset();
+
+    private:
+        Counters *local();
+        void sum(Statistics &statistics);
+
+        const std::uint64_t m_Id; // Unique for each recorder, never reused.
+        std::atomic<bool> m_Enabled;
+
+        std::mutex m_Mutex;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<Counters>>> m_Threads; // Guarded by `m_Mutex`.
+        Statistics m_Baseline;                                                        // Sums at the last reset. Guarded by `m_Mutex`.
+    };
+
+    // Measures time of a phase, if counters are given.
+    class Stopwatch {
+    public:
+        Stopwatch(Counters *counters) : m_Counters(counters) {
+            if (counters) {
+                this->m_Start = std::chrono::steady_clock::now();
+            }
+        }
+
+        // Records time since construction or the previous lap.
+        void lap(Phase phase) {
+            if (this->m_Counters) {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                this->m_Counters->time(phase, now - this->m_Start);
+                this->m_Start = now;
+            }
+        }
+
+    private:
+        Counters *m_Counters;
+        std::chrono::steady_clock::time_point m_Start;
+    };
+}
+
+#endif /* MATHEX_STATS_HEADER */
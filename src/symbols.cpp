@@ -0,0 +1,253 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "symbols.hpp"
+#include "mathex"
+#include "token.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace mathex {
+    // https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+    static std::uint64_t hash(const char *name, size_t length) {
+        std::uint64_t hash = 14695981039346656037ull;
+
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (unsigned char)name[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    SymbolTable::SymbolTable(Tokens tokens) : m_Tokens(std::move(tokens)) {
+        // Keep load factor at most 1/2, so that probe sequences stay short
+        size_t capacity = 8;
+
+        while (capacity < this->m_Tokens.size() * 2) {
+            capacity *= 2;
+        }
+
+        this->m_Slots.assign(capacity, Symbol{nullptr, nullptr, 0});
+        this->m_Mask = capacity - 1;
+
+        for (const auto &token : this->m_Tokens) {
+            std::uint64_t symbol_hash = hash(token.first.data(), token.first.length());
+            size_t i = (size_t)symbol_hash & this->m_Mask;
+
+            while (this->m_Slots[i].name != nullptr) {
+                i = (i + 1) & this->m_Mask;
+            }
+
+            this->m_Slots[i] = Symbol{&token.first, token.second.get(), symbol_hash};
+        }
+    }
+
+    const Symbol *SymbolTable::find(const char *name, size_t length) const {
+        std::uint64_t symbol_hash = hash(name, length);
+
+        for (size_t i = (size_t)symbol_hash & this->m_Mask;; i = (i + 1) & this->m_Mask) {
+            const Symbol &symbol = this->m_Slots[i];
+
+            if (symbol.name == nullptr) {
+                return nullptr;
+            }
+
+            if (symbol.hash == symbol_hash && symbol.name->length() == length && std::memcmp(symbol.name->data(), name, length) == 0) {
+                return &symbol;
+            }
+        }
+    }
+
+    // Approximate size of a map node holding a token and its name, like in red-black tree of libstdc++.
+    static size_t footprint(const Tokens::value_type &token) {
+        return 4 * sizeof(void *) + sizeof(token) + token.first.capacity() + 1;
+    }
+
+    size_t SymbolTable::memory() const {
+        size_t memory = sizeof(*this) + this->m_Slots.capacity() * sizeof(Symbol);
+
+        for (const auto &token : this->m_Tokens) {
+            memory += footprint(token);
+        }
+
+        return memory;
+    }
+
+    // Source of unique registry ids; zero marks unused slots of snapshot caches.
+    static std::atomic<std::uint64_t> registries(0);
+
+    Registry::Registry() : id(++registries), version(0) {}
+
+    // Slot of thread-local snapshot cache.
+    struct Pinned {
+        std::uint64_t registry = 0;
+        std::uint64_t version = 0;
+        const SymbolTable *symbols = nullptr;             // Snapshot of the version, valid only while the version is current.
+        std::atomic<const SymbolTable *> hazard{nullptr}; // Snapshot in use, which writers must not release.
+        size_t users = 0;                                 // Snapshots using the slot, which cannot be replaced until they are gone.
+    };
+
+    // Snapshots recently used by a thread, indexed by registry id. Registered for as long as the thread lives, so that
+    // writers can see which snapshots are in use.
+    static constexpr size_t PinnedSlots = 8;
+
+    struct Pins {
+        Pins();
+        ~Pins();
+
+        Pinned slots[PinnedSlots];
+    };
+
+    static std::mutex threads;
+    static std::vector<Pins *> pins; // Guarded by `threads`.
+
+    Pins::Pins() {
+        std::lock_guard<std::mutex> lock(threads);
+        pins.push_back(this);
+    }
+
+    Pins::~Pins() {
+        std::lock_guard<std::mutex> lock(threads);
+        pins.erase(std::find(pins.begin(), pins.end(), this));
+    }
+
+    static thread_local Pins pinned;
+
+    void Registry::publish(Tables &unused) {
+        if (this->current) {
+            this->retired.push_back(std::move(this->current));
+        }
+
+        this->current = nullptr;
+        this->version.fetch_add(1, std::memory_order_seq_cst);
+        this->reclaim(unused);
+    }
+
+    void Registry::reclaim(Tables &unused) {
+        if (this->retired.empty()) {
+            return;
+        }
+
+        // Readers set their hazard before checking the version, and the version is bumped before looking at hazards,
+        // so a reader either sees the new version or has its hazard seen here
+        std::lock_guard<std::mutex> lock(threads);
+        auto used = [](const std::shared_ptr<const SymbolTable> &symbols) {
+            for (const Pins *thread : pins) {
+                for (const Pinned &slot : thread->slots) {
+                    if (slot.hazard.load(std::memory_order_seq_cst) == symbols.get()) {
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        };
+
+        auto kept = std::partition(this->retired.begin(), this->retired.end(), used);
+        std::move(kept, this->retired.end(), std::back_inserter(unused));
+        this->retired.erase(kept, this->retired.end());
+    }
+
+    size_t Registry::memory() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        size_t memory = 0;
+
+        // Tokens are allocated together with the control block of their shared pointer
+        for (const auto &token : this->tokens) {
+            memory += footprint(token) + sizeof(Token) + 2 * sizeof(long);
+        }
+
+        if (this->current) {
+            memory += this->current->memory();
+        }
+
+        for (const auto &symbols : this->retired) {
+            memory += symbols->memory();
+        }
+
+        return memory;
+    }
+
+    Snapshot::Snapshot(Registry &registry) : m_Registry(registry), m_Pinned(nullptr) {
+        Pinned &slot = pinned.slots[registry.id % PinnedSlots];
+        std::uint64_t version = registry.version.load(std::memory_order_acquire);
+
+        if (slot.registry == registry.id && slot.version == version) {
+            // Cached snapshot may be released once it is replaced, so it is used only if it is still current with the hazard set
+            if (slot.users == 0) {
+                slot.hazard.store(slot.symbols, std::memory_order_seq_cst);
+            }
+
+            if (slot.users > 0 || registry.version.load(std::memory_order_seq_cst) == version) {
+                slot.users++;
+                this->m_Pinned = &slot;
+                this->m_Symbols = slot.symbols;
+                this->m_Version = version;
+                return;
+            }
+
+            slot.hazard.store(nullptr, std::memory_order_release);
+        }
+
+        Tables unused; // Destroyed outside of the lock.
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        if (!registry.current) {
+            registry.current = std::make_shared<const SymbolTable>(registry.tokens);
+        }
+
+        this->m_Symbols = registry.current.get();
+        this->m_Version = registry.version.load(std::memory_order_relaxed);
+
+        if (slot.users == 0) {
+            // Hazard is set under the lock, so writers see it before they can retire the snapshot
+            slot.registry = registry.id;
+            slot.version = this->m_Version;
+            slot.symbols = this->m_Symbols;
+            slot.hazard.store(this->m_Symbols, std::memory_order_seq_cst);
+            slot.users++;
+            this->m_Pinned = &slot;
+        } else {
+            this->m_Held = registry.current;
+        }
+
+        registry.reclaim(unused);
+    }
+
+    Snapshot::~Snapshot() {
+        if (!this->m_Pinned || --this->m_Pinned->users > 0) {
+            return;
+        }
+
+        this->m_Pinned->hazard.store(nullptr, std::memory_order_seq_cst);
+
+        // Snapshot was replaced while in use, so it was retired but could not be released yet
+        if (this->m_Registry.version.load(std::memory_order_relaxed) != this->m_Pinned->version) {
+            Tables unused; // Destroyed outside of the lock.
+            std::lock_guard<std::mutex> lock(this->m_Registry.mutex);
+            this->m_Registry.reclaim(unused);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_SYMBOLS_HEADER
+#define MATHEX_SYMBOLS_HEADER
+
+#include "mathex"
+#include "token.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mathex {
+    struct Symbol {
+        const std::string *name; // Name of the symbol, null for empty slots.
+        const Token *token;
+        std::uint64_t hash;
+    };
+
+    using Tokens = std::map<std::string, std::shared_ptr<const Token>>;
+
+    // Read-only hash table of config tokens, looked up without copying the name.
+    class SymbolTable {
+    public:
+        SymbolTable(Tokens tokens);
+        SymbolTable(const SymbolTable &) = delete;
+        SymbolTable &operator=(const SymbolTable &) = delete;
+
+        // Returns symbol with name given by `length` characters at `name`, or null if there is none.
+        const Symbol *find(const char *name, size_t length) const;
+
+        // Returns approximate number of bytes held by the table, not counting tokens shared with the registry.
+        size_t memory() const;
+
+    private:
+        Tokens m_Tokens;             // Symbols refer to names and tokens stored here.
+        std::vector<Symbol> m_Slots; // Open addressing with linear probing.
+        size_t m_Mask;
+    };
+
+    using Tables = std::vector<std::shared_ptr<const SymbolTable>>;
+
+    // Symbols of a config, published as immutable snapshots. Writers change `tokens` under `mutex` and bump `version`;
+    // the next reader to see the new version builds a snapshot of them, which is then shared by all readers of that version.
+    // Replaced snapshots are retired, and released as soon as no thread uses them.
+    class Registry {
+    public:
+        Registry();
+        Registry(const Registry &) = delete;
+        Registry &operator=(const Registry &) = delete;
+
+        // Marks `tokens` as changed, moving snapshots no longer in use into `unused`. Has to be called with `mutex` held,
+        // and `unused` destroyed after it is released, since snapshots may hold the last references to user functions.
+        void publish(Tables &unused);
+
+        // Moves retired snapshots no longer in use into `unused`. Has to be called with `mutex` held.
+        void reclaim(Tables &unused);
+
+        // Returns approximate number of bytes held by tokens and their snapshots.
+        size_t memory();
+
+        const std::uint64_t id; // Unique for each registry, never reused.
+        std::atomic<std::uint64_t> version;
+
+        std::mutex mutex;
+        Tokens tokens;                              // Guarded by `mutex`.
+        std::shared_ptr<const SymbolTable> current; // Snapshot of `tokens`, or null if it is not built yet. Guarded by `mutex`.
+        Tables retired;                             // Replaced snapshots that may still be in use. Guarded by `mutex`.
+        std::uint32_t slots = 0;                    // Number of slots given to frame variables. Guarded by `mutex`.
+    };
+
+    struct Pinned;
+
+    // Pins current snapshot of a registry while alive. When the snapshot was already used by the same thread and the registry
+    // has not changed since, this takes no locks and does not write any memory shared with other threads.
+    class Snapshot {
+    public:
+        explicit Snapshot(Registry &registry);
+        ~Snapshot();
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        const SymbolTable &symbols() const {
+            return *this->m_Symbols;
+        }
+
+        // Version of the registry the snapshot was taken from.
+        std::uint64_t version() const {
+            return this->m_Version;
+        }
+
+    private:
+        Registry &m_Registry;
+        Pinned *m_Pinned;                          // Slot of thread-local snapshot cache that is used, or null.
+        std::shared_ptr<const SymbolTable> m_Held; // Owns the snapshot if it could not be cached.
+        const SymbolTable *m_Symbols;
+        std::uint64_t m_Version;
+    };
+}
+
+#endif /* MATHEX_SYMBOLS_HEADER */
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "term.hpp"
+#include "mathex"
+#include "token.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mathex {
+    Term::Term(double value) : m_Node(std::make_shared<const Node>(Node{Node::Kind::Constant, value, std::string(), nullptr, {}})) {}
+
+    Term::Term(std::shared_ptr<const Node> node) : m_Node(std::move(node)) {}
+
+    Term Term::Node::make(Node node) {
+        return Term(std::make_shared<const Node>(std::move(node)));
+    }
+
+    static void append(const Term &term, std::string &key) {
+        const Term::Node &node = Term::Node::of(term);
+        key += (char)node.kind;
+
+        switch (node.kind) {
+        case Term::Node::Kind::Constant: {
+            char bytes[sizeof(double)];
+            std::memcpy(bytes, &node.value, sizeof(bytes));
+            key.append(bytes, sizeof(bytes));
+        } break;
+
+        case Term::Node::Kind::Operator: {
+            // Logical operators share opcode, but not precedence
+            key += (char)node.op->opcode;
+            key += (char)node.op->precedence;
+        } break;
+
+        default: {
+            key += node.name;
+            key += '\0';
+        } break;
+        }
+
+        // Number of operands tells where arguments of a call end
+        std::uint32_t count = (std::uint32_t)node.operands.size();
+        char bytes[sizeof(count)];
+        std::memcpy(bytes, &count, sizeof(bytes));
+        key.append(bytes, sizeof(bytes));
+
+        for (const Term &operand : node.operands) {
+            append(operand, key);
+        }
+    }
+
+    std::string Term::Node::key(const Term &term) {
+        std::string key(1, '\0');
+        append(term, key);
+        return key;
+    }
+
+    static Term apply(const Operator &op, std::vector<Term> operands) {
+        return Term::Node::make(Term::Node{Term::Node::Kind::Operator, 0, std::string(), &op, std::move(operands)});
+    }
+
+    Term var(const std::string &name) {
+        return Term::Node::make(Term::Node{Term::Node::Kind::Name, 0, name, nullptr, {}});
+    }
+
+    Term call(const std::string &name, std::vector<Term> args) {
+        return Term::Node::make(Term::Node{Term::Node::Kind::Call, 0, name, nullptr, std::move(args)});
+    }
+
+    Term pow(const Term &base, const Term &exponent) {
+        return apply(PowToken, {base, exponent});
+    }
+
+    Term operator+(const Term &a, const Term &b) {
+        return apply(AddToken, {a, b});
+    }
+
+    Term operator-(const Term &a, const Term &b) {
+        return apply(SubToken, {a, b});
+    }
+
+    Term operator*(const Term &a, const Term &b) {
+        return apply(MulToken, {a, b});
+    }
+
+    Term operator/(const Term &a, const Term &b) {
+        return apply(DivToken, {a, b});
+    }
+
+    Term operator%(const Term &a, const Term &b) {
+        return apply(ModToken, {a, b});
+    }
+
+    Term operator<(const Term &a, const Term &b) {
+        return apply(LessToken, {a, b});
+    }
+
+    Term operator<=(const Term &a, const Term &b) {
+        return apply(LessEqualToken, {a, b});
+    }
+
+    Term operator>(const Term &a, const Term &b) {
+        return apply(GreaterToken, {a, b});
+    }
+
+    Term operator>=(const Term &a, const Term &b) {
+        return apply(GreaterEqualToken, {a, b});
+    }
+
+    Term operator==(const Term &a, const Term &b) {
+        return apply(EqualToken, {a, b});
+    }
+
+    Term operator!=(const Term &a, const Term &b) {
+        return apply(NotEqualToken, {a, b});
+    }
+
+    Term operator&&(const Term &a, const Term &b) {
+        return apply(AndToken, {a, b});
+    }
+
+    Term operator||(const Term &a, const Term &b) {
+        return apply(OrToken, {a, b});
+    }
+
+    Term operator+(const Term &a) {
+        return apply(PosToken, {a});
+    }
+
+    Term operator-(const Term &a) {
+        return apply(NegToken, {a});
+    }
+
+    Term operator!(const Term &a) {
+        return apply(NotToken, {a});
+    }
+}
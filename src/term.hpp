@@ -0,0 +1,60 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MATHEX_TERM_HEADER
+#define MATHEX_TERM_HEADER
+
+#include "mathex"
+#include "token.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mathex {
+    struct Term::Node {
+        enum class Kind {
+            Constant, // Number `value`.
+            Name,     // Variable or constant `name`.
+            Operator, // Operator `op` applied to `operands`.
+            Call,     // Function `name` called with `operands`.
+        };
+
+        Kind kind;
+        double value;
+        std::string name;
+        const Operator *op;
+        std::vector<Term> operands;
+
+        // Wraps node into a term.
+        static Term make(Node node);
+
+        static const Node &of(const Term &term) {
+            return *term.m_Node;
+        }
+
+        // Returns string identifying structure of the term in the cache of parsed expressions. It starts with a null
+        // character, so it never equals a valid expression.
+        static std::string key(const Term &term);
+    };
+}
+
+#endif /* MATHEX_TERM_HEADER */
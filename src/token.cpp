@@ -22,13 +22,11 @@
 
 #include "token.hpp"
 #include "mathex"
-#include <cmath>
 #include <functional>
+#include <utility>
 
 namespace mathex {
-    Token::Token(const Token &token) {
-        this->type = token.type;
-
+    Token::Token(const Token &token) : type(token.type), data(0.0), derivative(token.derivative), memo(token.memo) {
         switch (this->type) {
         case TokenType::Constant: {
             this->data.constant = token.data.constant;
@@ -38,18 +36,16 @@ namespace mathex {
             this->data.variable = token.data.variable;
         } break;
 
-        case TokenType::Function: {
-            new (&this->data.function) auto(token.data.function);
+        case TokenType::Slot: {
+            this->data.slot = token.data.slot;
         } break;
 
-        case TokenType::BinaryOperator: {
-            new (&this->data.binaryOperator.invoke) auto(token.data.binaryOperator.invoke);
-            this->data.binaryOperator.precedence = token.data.binaryOperator.precedence;
-            this->data.binaryOperator.leftAssociative = token.data.binaryOperator.leftAssociative;
+        case TokenType::Function: {
+            new (&this->data.function) auto(token.data.function);
         } break;
 
-        case TokenType::UnaryOperator: {
-            new (&this->data.unaryOperator) auto(token.data.unaryOperator);
+        case TokenType::Callback: {
+            new (&this->data.callback) auto(token.data.callback);
         } break;
 
         default: {
@@ -57,24 +53,20 @@ namespace mathex {
         }
     }
 
-    Token::Token(TokenType emptyType) : type(emptyType) {}
     Token::Token(double constant) : type(TokenType::Constant), data(constant) {}
     Token::Token(const double *variable) : type(TokenType::Variable), data(variable) {}
-    Token::Token(Function function) : type(TokenType::Function), data(function) {}
-    Token::Token(BinaryOperator binaryOperator, int precedence, bool leftAssociative) : type(TokenType::BinaryOperator), data(binaryOperator, precedence, leftAssociative) {}
-    Token::Token(UnaryOperator unaryOperator) : type(TokenType::UnaryOperator), data(unaryOperator) {}
+    Token::Token(std::uint32_t slot) : type(TokenType::Slot), data(slot) {}
+    Token::Token(Function function, Derivative derivative /* = nullptr */, std::shared_ptr<Memo> memo /* = nullptr */)
+        : type(TokenType::Function), data(function), derivative(derivative), memo(std::move(memo)) {}
+    Token::Token(Callback callback, std::shared_ptr<Memo> memo /* = nullptr */) : type(TokenType::Callback), data(std::move(callback)), memo(std::move(memo)) {}
     Token::~Token() {
         switch (this->type) {
         case TokenType::Function:
             this->data.function.~function();
             break;
 
-        case TokenType::BinaryOperator:
-            this->data.binaryOperator.invoke.~function();
-            break;
-
-        case TokenType::UnaryOperator:
-            this->data.unaryOperator.~function();
+        case TokenType::Callback:
+            this->data.callback.~Callback();
             break;
 
         default:
@@ -82,22 +74,10 @@ namespace mathex {
         }
     }
 
-    Token::Data::Data() {}
     Token::Data::Data(double constant) : constant(constant) {}
     Token::Data::Data(const double *variable) : variable(variable) {}
+    Token::Data::Data(std::uint32_t slot) : slot(slot) {}
     Token::Data::Data(Function function) : function(function) {}
-    Token::Data::Data(BinaryOperator binaryOperator, int precedence, bool leftAssociative) : binaryOperator({binaryOperator, precedence, leftAssociative}) {}
-    Token::Data::Data(UnaryOperator unaryOperator) : unaryOperator(unaryOperator) {}
+    Token::Data::Data(Callback callback) : callback(std::move(callback)) {}
     Token::Data::~Data() {}
-
-    const Token AddToken(std::plus<double>{}, 2, true);
-    const Token SubToken(std::minus<double>{}, 2, true);
-    const Token MulToken(std::multiplies<double>{}, 3, true);
-    const Token DivToken(std::divides<double>{}, 3, true);
-
-    const Token PowToken(static_cast<double (*)(double, double)>(std::pow), 2, true);
-    const Token ModToken(static_cast<double (*)(double, double)>(std::fmod), 2, true);
-
-    const Token PosToken([](double x) -> double { return x; });
-    const Token NegToken(std::negate<double>{});
 }
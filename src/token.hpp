@@ -20,12 +20,42 @@
   THE SOFTWARE.
 */
 
+#ifndef MATHEX_TOKEN_HEADER
+#define MATHEX_TOKEN_HEADER
+
 #include "mathex"
+#include <cstdint>
 #include <functional>
+#include <memory>
 
 namespace mathex {
-    using BinaryOperator = std::function<double(double, double)>;
-    using UnaryOperator = std::function<double(double)>;
+    enum class Opcode : unsigned char {
+        Constant,     // Push constant.
+        Variable,     // Push value of variable.
+        Slot,         // Push value of variable from frame.
+        Function,     // Call user function.
+        Call,         // Call user function with fixed number of arguments.
+        Builtin,      // Call built-in math function.
+        Add,          // Addition operator.
+        Sub,          // Substraction operator.
+        Mul,          // Multiplication operator.
+        Div,          // Division operator.
+        Pow,          // Exponentiation operator.
+        Mod,          // Modulus operator.
+        Pos,          // Unary identity operator.
+        Neg,          // Unary negation operator.
+        PowInt,       // Exponentiation to integer power, by chain of multiplications. (only produced by optimizer)
+        Less,         // Less than comparison, gives 1 or 0.
+        LessEqual,    // Less than or equal comparison.
+        Greater,      // Greater than comparison.
+        GreaterEqual, // Greater than or equal comparison.
+        Equal,        // Equality comparison.
+        NotEqual,     // Inequality comparison.
+        Not,          // Logical negation, gives 1 for zero and 0 otherwise.
+        Condition,    // Pop condition, jump to instruction `index` (start of the else branch) if it is zero.
+        Else,         // Jump to instruction `index`, past the `Select` ending the conditional.
+        Select,       // End of conditional. Picks one of condition, then and else values when all branches were evaluated.
+    };
 
     enum class TokenType {
         None = 0,
@@ -34,56 +64,86 @@ namespace mathex {
         Comma,
         Constant,
         Variable,
+        Slot,
         Function,
+        Callback,
+        Builtin,
         BinaryOperator,
         UnaryOperator,
+        Conditional,
+    };
+
+    class Memo;
+
+    // Function with fixed number of arguments, inserted by typed `Config::addFunction`.
+    struct Callback {
+        std::uint32_t arity;
+        detail::Invoke invoke;             // Calls the function with `arity` arguments.
+        detail::Address address;           // The function itself taking `arity` doubles, if it can be called directly, or null.
+        std::shared_ptr<const void> state; // Function object passed to `invoke`.
     };
 
+    // Constant, variable or function inserted into the config.
     class Token {
     public:
-        Token(const Token &token);                                                  // Copy
-        Token(TokenType emptyType);                                                 // Empty token
-        Token(double constant);                                                     // Constant
-        Token(const double *variable);                                              // Variable
-        Token(Function function);                                                   // Function
-        Token(BinaryOperator binaryOperator, int precedence, bool leftAssociative); // Binary operator
-        Token(UnaryOperator unaryOperator);                                         // Unary operator
+        Token(const Token &token);                                                                       // Copy
+        Token(double constant);                                                                          // Constant
+        Token(const double *variable);                                                                   // Variable
+        Token(std::uint32_t slot);                                                                       // Slot
+        Token(Function function, Derivative derivative = nullptr, std::shared_ptr<Memo> memo = nullptr); // Function
+        Token(Callback callback, std::shared_ptr<Memo> memo = nullptr);                                  // Callback
         ~Token();
 
         TokenType type;
         union Data {
-            Data();                                                                    // Empty token
-            Data(double constant);                                                     // Constant
-            Data(const double *variable);                                              // Variable
-            Data(Function function);                                                   // Function
-            Data(BinaryOperator binaryOperator, int precedence, bool leftAssociative); // Binary operator
-            Data(UnaryOperator unaryOperator);                                         // Unary operator
+            Data(double constant);        // Constant
+            Data(const double *variable); // Variable
+            Data(std::uint32_t slot);     // Slot
+            Data(Function function);      // Function
+            Data(Callback callback);      // Callback
             ~Data();
 
             double constant;
             const double *variable;
+            std::uint32_t slot;
             Function function;
-            struct {
-                BinaryOperator invoke;
-                int precedence;
-                bool leftAssociative;
-
-                double operator()(double a, double b) {
-                    return this->invoke(a, b);
-                }
-            } binaryOperator;
-            UnaryOperator unaryOperator;
+            Callback callback;
         } data;
+
+        Derivative derivative;      // Partial derivatives of function, if known.
+        std::shared_ptr<Memo> memo; // Memo of function or callback if it is pure, or null.
     };
 
-    extern const Token AddToken; // Addition operator.
-    extern const Token SubToken; // Substraction operator.
-    extern const Token MulToken; // Multiplication operator.
-    extern const Token DivToken; // Division operator.
+    // Built-in operator.
+    struct Operator {
+        TokenType type;
+        Opcode opcode;
+        int precedence;
+        bool leftAssociative;
+    };
+
+    constexpr Operator AddToken = {TokenType::BinaryOperator, Opcode::Add, 2, true}; // Addition operator.
+    constexpr Operator SubToken = {TokenType::BinaryOperator, Opcode::Sub, 2, true}; // Substraction operator.
+    constexpr Operator MulToken = {TokenType::BinaryOperator, Opcode::Mul, 3, true}; // Multiplication operator.
+    constexpr Operator DivToken = {TokenType::BinaryOperator, Opcode::Div, 3, true}; // Division operator.
 
-    extern const Token PowToken; // Exponentiation operator.
-    extern const Token ModToken; // Modulus operator.
+    constexpr Operator PowToken = {TokenType::BinaryOperator, Opcode::Pow, 2, true}; // Exponentiation operator.
+    constexpr Operator ModToken = {TokenType::BinaryOperator, Opcode::Mod, 2, true}; // Modulus operator.
 
-    extern const Token PosToken; // Unary identity operator.
-    extern const Token NegToken; // Unary negation operator.
+    constexpr Operator LessToken = {TokenType::BinaryOperator, Opcode::Less, 1, true};                 // Less than operator.
+    constexpr Operator LessEqualToken = {TokenType::BinaryOperator, Opcode::LessEqual, 1, true};       // Less than or equal operator.
+    constexpr Operator GreaterToken = {TokenType::BinaryOperator, Opcode::Greater, 1, true};           // Greater than operator.
+    constexpr Operator GreaterEqualToken = {TokenType::BinaryOperator, Opcode::GreaterEqual, 1, true}; // Greater than or equal operator.
+    constexpr Operator EqualToken = {TokenType::BinaryOperator, Opcode::Equal, 0, true};               // Equality operator.
+    constexpr Operator NotEqualToken = {TokenType::BinaryOperator, Opcode::NotEqual, 0, true};         // Inequality operator.
+
+    // Logical operators are conditionals ended by `Select`, see `translate`.
+    constexpr Operator AndToken = {TokenType::BinaryOperator, Opcode::Select, -1, true}; // Logical and operator.
+    constexpr Operator OrToken = {TokenType::BinaryOperator, Opcode::Select, -2, true};  // Logical or operator.
+
+    constexpr Operator PosToken = {TokenType::UnaryOperator, Opcode::Pos, 0, false}; // Unary identity operator.
+    constexpr Operator NegToken = {TokenType::UnaryOperator, Opcode::Neg, 0, false}; // Unary negation operator.
+    constexpr Operator NotToken = {TokenType::UnaryOperator, Opcode::Not, 0, false}; // Logical negation operator.
 }
+
+#endif /* MATHEX_TOKEN_HEADER */
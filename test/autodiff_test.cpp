@@ -0,0 +1,193 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <string>
+#include <vector>
+
+mathex::Config *config = nullptr;
+
+double x = 0.7;
+double y = -1.3;
+double z = 2.5;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus + mathex::Flags::Functions);
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+    config->addVariable("z", z);
+
+    config->addFunction(
+        "sq",
+        [](double args[], int argc, double &result) -> mathex::Error {
+            if (argc != 1) {
+                return mathex::Error::IncorrectArgsNum;
+            }
+
+            result = args[0] * args[0];
+            return mathex::Success;
+        },
+        [](double args[], int, double partials[]) -> mathex::Error {
+            partials[0] = 2 * args[0];
+            return mathex::Success;
+        });
+
+    config->addFunction("opaque", [](double args[], int argc, double &result) -> mathex::Error {
+        result = argc > 0 ? args[0] : 1;
+        return mathex::Success;
+    });
+
+    config->addFunction<double(double)>("twice", [](double value) { return 2 * value; });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(autodiff, .init = suite_setup, .fini = suite_teardown);
+
+// Checks value and gradient of expression with respect to x, y and z in all modes and optimization levels.
+static void check(const char *source, double dx, double dy, double dz) {
+    const mathex::Differentiation modes[] = {mathex::Differentiation::Auto, mathex::Differentiation::Forward, mathex::Differentiation::Reverse};
+    const mathex::Optimization optimizations[] = {mathex::Optimization::None, mathex::Optimization::Exact, mathex::Optimization::Fast};
+
+    for (mathex::Optimization optimization : optimizations) {
+        mathex::Expression expression;
+        cr_assert(config->compile(source, expression, optimization) == mathex::Success, "%s", source);
+
+        double expected;
+        cr_assert(expression.evaluate(expected) == mathex::Success, "%s", source);
+
+        for (mathex::Differentiation mode : modes) {
+            double result, gradient[3];
+
+            cr_assert(expression.differentiate({"x", "y", "z"}, result, gradient, mode) == mathex::Success, "%s", source);
+            cr_expect(std::memcmp(&result, &expected, sizeof(double)) == 0, "%s: value %.17g != %.17g", source, result, expected);
+            cr_expect(ieee_ulp_eq(dbl, gradient[0], dx, 8), "%s: d/dx %.17g != %.17g", source, gradient[0], dx);
+            cr_expect(ieee_ulp_eq(dbl, gradient[1], dy, 8), "%s: d/dy %.17g != %.17g", source, gradient[1], dy);
+            cr_expect(ieee_ulp_eq(dbl, gradient[2], dz, 8), "%s: d/dz %.17g != %.17g", source, gradient[2], dz);
+        }
+    }
+}
+
+Test(autodiff, operators) {
+    check("x + y - z", 1, 1, -1);
+    check("x * y / z", y / z, x / z, -x * y / (z * z));
+    check("-x + (+y)", -1, 1, 0);
+    check("x^3", 3 * x * x, 0, 0);
+    check("x^(-2)", -2 / (x * x * x), 0, 0);
+    check("z^y", 0, std::pow(z, y) * std::log(z), y * std::pow(z, y - 1));
+    check("z % x", -std::trunc(z / x), 0, 1);
+    check("2x * (x + y)", 4 * x + 2 * y, 2 * x, 0);
+    check("5", 0, 0, 0);
+    check("x * 0 + y", 0, 1, 0);
+}
+
+Test(autodiff, builtins) {
+    check("sqrt(z)", 0, 0, 0.5 / std::sqrt(z));
+    check("exp(x) * log(z)", std::exp(x) * std::log(z), 0, std::exp(x) / z);
+    check("sin(x) + cos(y)", std::cos(x), -std::sin(y), 0);
+    check("tan(x)", 1 / (std::cos(x) * std::cos(x)), 0, 0);
+    check("atan2(x, z)", z / (x * x + z * z), 0, -x / (x * x + z * z));
+    check("hypot(x, y)", x / std::hypot(x, y), y / std::hypot(x, y), 0);
+    check("min(x, y) + max(x, z)", 0, 1, 1);
+    check("abs(y) + floor(z)", 0, -1, 0);
+    check("log2(z) + log10(z)", 0, 0, 1 / (z * std::log(2)) + 1 / (z * std::log(10)));
+    check("asin(x) + acos(x) + atan(y)", 0, 1 / (1 + y * y), 0);
+    check("tanh(x) + sinh(y) + cosh(z)", 1 - std::tanh(x) * std::tanh(x), std::cosh(y), std::sinh(z));
+    check("cbrt(z)", 0, 0, 1 / (3 * std::cbrt(z) * std::cbrt(z)));
+}
+
+Test(autodiff, functions) {
+    mathex::Expression expression;
+    double result, gradient[2];
+
+    check("sq(x * y)", 2 * x * y * y, 2 * x * x * y, 0);
+
+    // Functions without derivatives are fine as long as their arguments do not depend on the variables
+    check("x * opaque(2) + twice(3)", 2, 0, 0);
+
+    cr_assert(config->compile("opaque(x) + y", expression) == mathex::Success);
+    cr_expect(expression.differentiate({"x"}, result, gradient) == mathex::Error::NotDifferentiable);
+    cr_expect(expression.differentiate({"x"}, result, gradient, mathex::Differentiation::Reverse) == mathex::Error::NotDifferentiable);
+
+    cr_assert(config->compile("twice(y) + x", expression) == mathex::Success);
+    cr_expect(expression.differentiate({"y"}, result, gradient) == mathex::Error::NotDifferentiable);
+
+    // Derivatives with respect to other variables are still known
+    cr_assert(config->compile("opaque(y) + x", expression) == mathex::Success);
+    cr_assert(expression.differentiate({"x", "x"}, result, gradient) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, gradient[0], 1, 0));
+    cr_expect(ieee_ulp_eq(dbl, gradient[1], 1, 0));
+}
+
+Test(autodiff, frame) {
+    mathex::Config local;
+    mathex::Expression expression;
+    double frame[2] = {3, 4};
+    double result, gradient[3];
+
+    local.declareVariable("a");
+    local.declareVariable("b");
+
+    cr_assert(local.compile("a * a * b", expression) == mathex::Success);
+    cr_expect(expression.differentiate({"a"}, result, gradient) == mathex::Error::Undefined);
+
+    cr_assert(expression.differentiate(frame, {"a", "b", "c"}, result, gradient) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 36, 0));
+    cr_expect(ieee_ulp_eq(dbl, gradient[0], 24, 0));
+    cr_expect(ieee_ulp_eq(dbl, gradient[1], 9, 0));
+    cr_expect(ieee_ulp_eq(dbl, gradient[2], 0, 0));
+}
+
+Test(autodiff, many_variables) {
+    // Gradient of a long sum of products, differentiated in reverse mode
+    mathex::Config local;
+    std::vector<double> values(50);
+    std::vector<std::string> names;
+    std::string source = "0";
+
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = (double)i / 7;
+        names.push_back("v" + std::to_string(i));
+        local.addVariable(names.back(), values[i]);
+        source += " + " + std::to_string(i) + " * " + names.back() + " * " + names.back();
+    }
+
+    mathex::Expression expression;
+    std::vector<double> reverse(values.size()), forward(values.size());
+    double result;
+
+    cr_assert(local.compile(source, expression) == mathex::Success);
+    cr_assert(expression.differentiate(names, result, reverse.data()) == mathex::Success);
+    cr_assert(expression.differentiate(names, result, forward.data(), mathex::Differentiation::Forward) == mathex::Success);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        cr_expect(ieee_ulp_eq(dbl, reverse[i], 2 * (double)i * values[i], 4), "v%zu", i);
+        cr_expect(ieee_ulp_eq(dbl, forward[i], reverse[i], 4), "v%zu", i);
+    }
+}
@@ -0,0 +1,198 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <limits>
+#include <mathex>
+#include <random>
+#include <string>
+#include <vector>
+
+mathex::Config *config = nullptr;
+
+double x = 0.5;
+double y = 2;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Functions);
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(builtins, .init = suite_setup, .fini = suite_teardown);
+
+// Distance between two doubles in units in the last place of `expected`.
+static double ulps(double actual, double expected) {
+    if (actual == expected || (std::isnan(actual) && std::isnan(expected))) {
+        return 0;
+    }
+
+    double ulp = std::nextafter(std::fabs(expected), std::numeric_limits<double>::infinity()) - std::fabs(expected);
+    return std::fabs(actual - expected) / ulp;
+}
+
+Test(builtins, disabled) {
+    mathex::Config plain;
+    double result;
+
+    cr_expect(plain.evaluate("sqrt(4)", result) == mathex::Error::Undefined);
+}
+
+Test(builtins, scalar) {
+    struct {
+        const char *source;
+        double expected;
+    } cases[] = {
+        {"abs(-x)", std::fabs(-x)},
+        {"sqrt(y)", std::sqrt(y)},
+        {"cbrt(y)", std::cbrt(y)},
+        {"exp(x)", std::exp(x)},
+        {"log(y)", std::log(y)},
+        {"log2(y)", std::log2(y)},
+        {"log10(y)", std::log10(y)},
+        {"sin(x)", std::sin(x)},
+        {"cos(x)", std::cos(x)},
+        {"tan(x)", std::tan(x)},
+        {"asin(x)", std::asin(x)},
+        {"acos(x)", std::acos(x)},
+        {"atan(x)", std::atan(x)},
+        {"sinh(x)", std::sinh(x)},
+        {"cosh(x)", std::cosh(x)},
+        {"tanh(x)", std::tanh(x)},
+        {"floor(-x)", std::floor(-x)},
+        {"ceil(x)", std::ceil(x)},
+        {"round(x)", std::round(x)},
+        {"trunc(-y - x)", std::trunc(-y - x)},
+        {"min(x, y)", std::fmin(x, y)},
+        {"max(x, y)", std::fmax(x, y)},
+        {"atan2(x, y)", std::atan2(x, y)},
+        {"hypot(x, y)", std::hypot(x, y)},
+        {"2 * max(sin(x), cos(x)) - exp(-x)", 2 * std::fmax(std::sin(x), std::cos(x)) - std::exp(-x)},
+    };
+
+    for (const auto &test : cases) {
+        mathex::Expression expression;
+        double result;
+
+        cr_assert(config->evaluate(test.source, result) == mathex::Success, "%s", test.source);
+        cr_expect(std::memcmp(&result, &test.expected, sizeof(double)) == 0, "%s: %.17g != %.17g", test.source, result, test.expected);
+
+        cr_assert(config->compile(test.source, expression, mathex::Optimization::None) == mathex::Success, "%s", test.source);
+
+        if (expression.jit()) {
+            cr_assert(expression.evaluate(result) == mathex::Success, "%s", test.source);
+            cr_expect(std::memcmp(&result, &test.expected, sizeof(double)) == 0, "%s: %.17g != %.17g", test.source, result, test.expected);
+        }
+    }
+}
+
+Test(builtins, syntax) {
+    mathex::Expression expression;
+    double result;
+
+    cr_expect(config->evaluate("sin(1, 2)", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config->evaluate("min(1)", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config->evaluate("sqrt()", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config->evaluate("sqrt", result) == mathex::Error::SyntaxError);
+    cr_expect(config->evaluate("sqrt 4", result) == mathex::Error::SyntaxError);
+    cr_expect(config->evaluate("sine(1)", result) == mathex::Error::Undefined);
+
+    cr_expect(config->evaluate("2sqrt(16", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 8, 0));
+
+    // Arguments that are all constants are computed while compiling
+    cr_assert(config->compile("sqrt(16) + min(3, 2)", expression) == mathex::Success);
+    cr_expect(expression.size() == 1);
+}
+
+Test(builtins, shadowing) {
+    double result;
+
+    config->setCacheCapacity(8);
+    cr_assert(config->evaluate("abs(-3)", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 3, 0));
+
+    // Names defined in the config hide built-in functions, even in cached expressions
+    config->addFunction<double(double)>("abs", [](double value) { return value; });
+    cr_assert(config->evaluate("abs(-3)", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, -3, 0));
+
+    config->remove("abs");
+    cr_assert(config->evaluate("abs(-3)", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 3, 0));
+    config->setCacheCapacity(0);
+}
+
+Test(builtins, batch) {
+    const size_t count = 10000;
+    std::vector<double> xs(count), ys(count), results(count);
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> small(-10, 10), wide(-300, 300);
+
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = i % 3 == 0 ? small(random) : std::pow(10.0, wide(random)) * (i % 2 ? -1 : 1);
+        ys[i] = small(random);
+    }
+
+    // Values outside of the range of polynomials
+    double special[] = {0.0, -0.0, 1e-310, -1e-310, 1e6, -1e6, 710, -710, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), std::nan("")};
+
+    for (size_t i = 0; i < sizeof(special) / sizeof(*special); i++) {
+        xs[count - 1 - i] = special[i];
+    }
+
+    const char *names[] = {"abs", "sqrt", "cbrt", "exp", "log", "log2", "log10", "sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh", "floor", "ceil", "round", "trunc", "min", "max", "atan2", "hypot"};
+
+    for (const char *name : names) {
+        std::string source = name;
+        bool binary = source == "min" || source == "max" || source == "atan2" || source == "hypot";
+        bool approximated = source == "exp" || source == "log" || source == "sin" || source == "cos";
+        source += binary ? "(x, y)" : "(x)";
+
+        mathex::Expression expression;
+        cr_assert(config->compile(source, expression) == mathex::Success, "%s", source.c_str());
+        cr_assert(expression.evaluate({{"x", xs.data()}, {"y", ys.data()}}, results.data(), count) == mathex::Success, "%s", source.c_str());
+
+        for (size_t i = 0; i < count; i++) {
+            x = xs[i];
+            y = ys[i];
+
+            double expected;
+            cr_assert(expression.evaluate(expected) == mathex::Success);
+
+            // Polynomials used for many rows at once stay within 2 ulp of <cmath>
+            double error = ulps(results[i], expected);
+            cr_expect(approximated ? error <= 2 : error == 0, "%s at %.17g: %.17g != %.17g", source.c_str(), xs[i], results[i], expected);
+        }
+    }
+
+    x = 0.5;
+    y = 2;
+}
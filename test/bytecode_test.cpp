@@ -0,0 +1,253 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <cstdio>
+#include <mathex>
+#include <string>
+#include <vector>
+
+const char *path = "bytecode_test.bin";
+
+double x = 1.5;
+double y = -2;
+
+static double scale(double a, double b) noexcept {
+    return a * b;
+}
+
+// Defines the same names in the config, with slots of `a` and `b` depending on the order they are declared in.
+static void define(mathex::Config &config, bool swapped) {
+    config.addVariable("x", x);
+    config.addVariable("y", y);
+    config.declareVariable(swapped ? "b" : "a");
+    config.declareVariable(swapped ? "a" : "b");
+    config.addConstant("k", 3);
+
+    config.addFunction("sum", [](double args[], int argc, double &result) -> mathex::Error {
+        result = 0;
+
+        for (int i = 0; i < argc; i++) {
+            result += args[i];
+        }
+
+        return mathex::Success;
+    });
+
+    config.addFunction<double(double, double)>("scale", scale);
+}
+
+static std::string read() {
+    std::string contents;
+    std::FILE *file = std::fopen(path, "rb");
+    int c;
+
+    while ((c = std::fgetc(file)) != EOF) {
+        contents.push_back((char)c);
+    }
+
+    std::fclose(file);
+    return contents;
+}
+
+static void write(const std::string &contents) {
+    std::FILE *file = std::fopen(path, "wb");
+    std::fwrite(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+}
+
+static void cleanup(void) {
+    std::remove(path);
+}
+
+TestSuite(bytecode, .fini = cleanup);
+
+const std::vector<std::string> sources = {
+    "x + y * k",
+    "sum(a, b, x) - scale(a, 2) / b",
+    "sin(a) + hypot(x, b) * abs(y)",
+    "(a + 1)^3 - x^(-2)",
+    "sum() + 2.5e-3",
+};
+
+Test(bytecode, roundtrip) {
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Functions);
+    std::vector<mathex::Expression> expressions(sources.size());
+    define(config, false);
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        cr_assert(config.compile(sources[i], expressions[i], i % 2 ? mathex::Optimization::Fast : mathex::Optimization::Exact) == mathex::Success, "%s", sources[i].c_str());
+    }
+
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+
+    // Declaring variables in another order gives them other slots, which the loaded instructions are changed to use
+    for (bool swapped : {false, true}) {
+        mathex::Config other(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Functions + mathex::Flags::Modulus);
+        std::vector<mathex::Expression> loaded;
+        define(other, swapped);
+
+        cr_assert(other.load(path, loaded) == mathex::Success);
+        cr_assert(loaded.size() == expressions.size());
+
+        double frame[] = {0.75, -4};
+        double swapped_frame[] = {-4, 0.75};
+
+        for (size_t i = 0; i < sources.size(); i++) {
+            double expected, result;
+            cr_assert(expressions[i].evaluate(frame, expected) == mathex::Success);
+            cr_assert(loaded[i].evaluate(swapped ? swapped_frame : frame, result) == mathex::Success);
+            cr_expect(ieee_ulp_eq(dbl, result, expected, 0), "%s", sources[i].c_str());
+            cr_expect(loaded[i].size() == expressions[i].size());
+
+            if (loaded[i].jit()) {
+                cr_assert(loaded[i].evaluate(swapped ? swapped_frame : frame, result) == mathex::Success);
+                cr_expect(ieee_ulp_eq(dbl, result, expected, 0), "%s", sources[i].c_str());
+            }
+
+            // Variables are read through references of the loading config
+            y = 5;
+            cr_assert(expressions[i].evaluate(frame, expected) == mathex::Success);
+            cr_assert(loaded[i].evaluate(swapped ? swapped_frame : frame, result) == mathex::Success);
+            cr_expect(ieee_ulp_eq(dbl, result, expected, 0), "%s", sources[i].c_str());
+            y = -2;
+        }
+    }
+
+    // Files of the same expressions are the same
+    std::string contents = read();
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+    cr_expect(read() == contents);
+}
+
+Test(bytecode, batch) {
+    mathex::Config config;
+    std::vector<mathex::Expression> expressions(1);
+    define(config, false);
+
+    cr_assert(config.compile("a * x - b / 2", expressions[0]) == mathex::Success);
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+    cr_assert(config.load(path, expressions) == mathex::Success);
+
+    const size_t count = 1000;
+    std::vector<double> frames(count * 2);
+    std::vector<double> results(count);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i] = (double)i * 0.25;
+    }
+
+    cr_assert(expressions[0].evaluate(frames.data(), 2, results.data(), count) == mathex::Success);
+
+    for (size_t i = 0; i < count; i++) {
+        cr_expect(ieee_ulp_eq(dbl, results[i], frames[2 * i] * x - frames[2 * i + 1] / 2, 0), "record %zu", i);
+    }
+}
+
+Test(bytecode, resolve) {
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Functions);
+    std::vector<mathex::Expression> expressions(2);
+    define(config, false);
+
+    cr_assert(config.compile("x + sum(a)", expressions[0]) == mathex::Success);
+    cr_assert(config.compile("sqrt(scale(x, k))", expressions[1]) == mathex::Success);
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+
+    std::vector<mathex::Expression> loaded(3);
+
+    // Missing names
+    mathex::Config empty(mathex::DefaultFlags + mathex::Flags::Functions);
+    cr_expect(empty.load(path, loaded) == mathex::Error::Undefined);
+    cr_expect(loaded.size() == 3, "failed load leaves expressions unchanged");
+
+    // Names of another kind
+    mathex::Config kinds(mathex::DefaultFlags + mathex::Flags::Functions);
+    kinds.addVariable("y", y);
+    kinds.addConstant("x", 1);
+    kinds.declareVariable("a");
+    kinds.addFunction("sum", [](double[], int, double &result) -> mathex::Error {
+        result = 0;
+        return mathex::Success;
+    });
+    kinds.addFunction<double(double, double)>("scale", scale);
+    cr_expect(kinds.load(path, loaded) == mathex::Error::Undefined);
+
+    // Typed function with other number of arguments
+    mathex::Config arity(mathex::DefaultFlags + mathex::Flags::Functions);
+    define(arity, false);
+    arity.remove("scale");
+    arity.addFunction<double(double)>("scale", [](double a) { return a; });
+    cr_expect(arity.load(path, loaded) == mathex::Error::IncorrectArgsNum);
+
+    // Built-in functions need flag that was used to compile them
+    mathex::Config flags;
+    define(flags, false);
+    cr_expect(flags.load(path, loaded) == mathex::Error::SyntaxError);
+
+    // Built-in functions are not hidden by names defined after compilation
+    mathex::Config shadowed(mathex::DefaultFlags + mathex::Flags::Functions);
+    define(shadowed, false);
+    shadowed.addFunction<double(double)>("sqrt", [](double) { return 0.0; });
+    cr_assert(shadowed.load(path, loaded) == mathex::Success);
+
+    double result;
+    cr_assert(loaded[1].evaluate(result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, std::sqrt(scale(x, 3)), 0));
+}
+
+Test(bytecode, invalid) {
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Functions);
+    std::vector<mathex::Expression> expressions(2);
+    define(config, false);
+
+    cr_expect(mathex::Expression::save(path, expressions) == mathex::Error::InvalidArgs, "empty expressions are not saved");
+
+    cr_assert(config.compile("sum(a, b) * sin(x)", expressions[0]) == mathex::Success);
+    cr_assert(config.compile("scale(y, 2) / k", expressions[1]) == mathex::Success);
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+
+    std::string contents = read();
+    std::vector<mathex::Expression> loaded;
+
+    cr_expect(config.load("missing_bytecode_test.bin", loaded) == mathex::Error::InvalidFormat);
+
+    // Every damaged byte and every truncation is detected
+    for (size_t i = 0; i < contents.size(); i++) {
+        std::string damaged = contents;
+        damaged[i] ^= 0x10;
+        write(damaged);
+        cr_expect(config.load(path, loaded) == mathex::Error::InvalidFormat, "byte %zu", i);
+
+        write(contents.substr(0, i));
+        cr_expect(config.load(path, loaded) == mathex::Error::InvalidFormat, "size %zu", i);
+    }
+
+    write(contents + '\0');
+    cr_expect(config.load(path, loaded) == mathex::Error::InvalidFormat);
+    cr_expect(loaded.empty());
+
+    write(contents);
+    cr_expect(config.load(path, loaded) == mathex::Success);
+    cr_expect(loaded.size() == 2);
+}
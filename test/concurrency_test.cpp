@@ -0,0 +1,206 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <atomic>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+mathex::Config *config = nullptr;
+
+double x = 5;
+
+void suite_setup(void) {
+    config = new mathex::Config();
+    config->addVariable("x", x);
+    config->addConstant("c", 2);
+
+    config->addFunction("f", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] * 10;
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(concurrency, .init = suite_setup, .fini = suite_teardown);
+
+// Evaluates expressions from many threads while another thread keeps adding and removing symbols.
+// Returns number of evaluations that gave unexpected results.
+static int stress(bool compile) {
+    const int readers = 4;
+    const int iterations = 20000;
+
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+
+    std::thread writer([&]() {
+        for (int i = 0; !done; i++) {
+            config->addFunction("g", [](double[], int, double &result) -> mathex::Error {
+                result = 7;
+                return mathex::Success;
+            });
+
+            config->addConstant("k" + std::to_string(i % 100), i);
+            config->remove("g");
+            config->remove("k" + std::to_string(i % 100));
+        }
+    });
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < readers; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < iterations; i++) {
+                double result = 0;
+                mathex::Error error;
+
+                if (compile) {
+                    mathex::Expression expression;
+                    error = config->compile("x * c + f(2)", expression);
+                    error = error == mathex::Success ? expression.evaluate(result) : error;
+                } else {
+                    error = config->evaluate("x * c + f(2)", result);
+                }
+
+                if (error != mathex::Success || result != 30) {
+                    failures++;
+                }
+
+                // Function `g` may or may not be defined, but it has to work whenever it is
+                error = config->evaluate("g() + c", result);
+
+                if (!(error == mathex::Error::Undefined || (error == mathex::Success && result == 9))) {
+                    failures++;
+                }
+            }
+        });
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    done = true;
+    writer.join();
+
+    return failures;
+}
+
+Test(concurrency, evaluate) {
+    cr_expect(stress(false) == 0);
+}
+
+Test(concurrency, cached) {
+    config->setCacheCapacity(16);
+    cr_expect(stress(true) == 0);
+    cr_expect(config->cacheHits() > 0);
+}
+
+Test(concurrency, many_configs) {
+    // More configs than a thread keeps snapshots of, used in turns and from inside each other's functions
+    std::vector<std::unique_ptr<mathex::Config>> configs;
+
+    for (int i = 0; i < 20; i++) {
+        configs.emplace_back(new mathex::Config());
+        configs.back()->addConstant("n", i);
+    }
+
+    for (int i = 0; i < 20; i++) {
+        mathex::Config *next = configs[(size_t)(i + 1) % configs.size()].get();
+
+        configs[(size_t)i]->addFunction("next", [next](double[], int, double &result) -> mathex::Error {
+            return next->evaluate("n", result);
+        });
+    }
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 20; i++) {
+            double result;
+
+            cr_assert(configs[(size_t)i]->evaluate("n * 100 + next()", result) == mathex::Success);
+            cr_expect(ieee_ulp_eq(dbl, result, i * 100 + (i + 1) % 20, 0));
+        }
+
+        configs[(size_t)round]->remove("n");
+        configs[(size_t)round]->addConstant("n", round);
+    }
+}
+
+Test(concurrency, released) {
+    // Functions are released once removed, even though threads that used them are still alive
+    std::shared_ptr<int> resource = std::make_shared<int>(0);
+    std::unique_ptr<mathex::Config> local(new mathex::Config());
+    std::atomic<int> stage(0);
+
+    auto function = [resource](double[], int, double &result) -> mathex::Error {
+        result = *resource;
+        return mathex::Success;
+    };
+
+    local->addFunction("f", function);
+    local->addFunction("g", function);
+    local->addFunction("h", [&local](double[], int, double &result) -> mathex::Error {
+        result = local->remove("g");
+        return mathex::Success;
+    });
+
+    std::thread worker([&]() {
+        double result;
+        local->evaluate("f() + g()", result);
+        stage = 1;
+
+        while (stage != 2) {
+            std::this_thread::yield();
+        }
+    });
+
+    while (stage != 1) {
+        std::this_thread::yield();
+    }
+
+    double result;
+    cr_assert(local->evaluate("f() + h()", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 1, 0));
+    cr_expect(local->remove("f"));
+    cr_expect(eq(long, resource.use_count(), 2)); // held by `function`
+
+    // Destroying the config releases all of its functions
+    local->addFunction("f", function);
+    cr_assert(local->evaluate("f()", result) == mathex::Success);
+    local.reset();
+    cr_expect(eq(long, resource.use_count(), 2));
+
+    stage = 2;
+    worker.join();
+}
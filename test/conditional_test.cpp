@@ -0,0 +1,327 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <cstdio>
+#include <mathex>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr mathex::Flags Flags = mathex::DefaultFlags + mathex::Flags::Functions + mathex::Flags::Comparison + mathex::Flags::Logical + mathex::Flags::Conditional;
+
+int calls = 0;
+
+static void define(mathex::Config &config) {
+    config.addFunction("counted", [](double args[], int argc, double &result) -> mathex::Error {
+        calls++;
+        result = argc > 0 ? args[0] : 0;
+        return mathex::Success;
+    });
+
+    config.addFunction("root", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1 || args[0] < 0) {
+            return mathex::Error::InvalidArgs;
+        }
+
+        result = std::sqrt(args[0]);
+        return mathex::Success;
+    });
+}
+
+Test(conditional, operators) {
+    mathex::Config config(Flags);
+
+    std::vector<std::pair<std::string, double>> cases = {
+        {"1 < 2", 1},
+        {"2 < 1", 0},
+        {"2 <= 2", 1},
+        {"3 > 2", 1},
+        {"2 >= 3", 0},
+        {"2 == 2", 1},
+        {"2 != 2", 0},
+        {"1 + 1 == 2", 1},
+        {"1 < 2 == 2 < 3", 1},
+        {"2 * 3 > 5", 1},
+        {"5 && 3", 1},
+        {"5 && 0", 0},
+        {"0 || (-2)", 1},
+        {"0 || 0", 0},
+        {"0 || 1 && 0", 0},
+        {"1 || 1 && 0", 1},
+        {"!0 + 1", 2},
+        {"!(2 > 1)", 0},
+        {"!!7", 1},
+        {"2 > 1 && 3 >= 3", 1},
+        {"if(1, 2, 3)", 2},
+        {"if(0, 2, 3)", 3},
+        {"if(-0.5, 2, 3)", 2},
+        {"if(1 > 2, 10, if(2 > 1, 20, 30)) + 1", 21},
+        {"if(if(0, 1, 0), 2, 3) * 2", 6},
+        {"-if(1, 2, 3)", -2},
+        {"max(if(0, 1, 4), 2 && 3)", 4},
+    };
+
+    for (const auto &entry : cases) {
+        double result;
+        cr_assert(config.evaluate(entry.first, result) == mathex::Success, "%s", entry.first.c_str());
+        cr_expect(ieee_ulp_eq(dbl, result, entry.second, 0), "%s", entry.first.c_str());
+    }
+}
+
+Test(conditional, flags) {
+    mathex::Config config(mathex::DefaultFlags);
+    double result;
+
+    cr_expect(config.evaluate("1 < 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 == 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 && 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("!1", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("if(1, 2, 3)", result) == mathex::Error::Undefined);
+
+    mathex::Config comparison(mathex::DefaultFlags + mathex::Flags::Comparison);
+
+    cr_expect(comparison.evaluate("1 < 2", result) == mathex::Success);
+    cr_expect(comparison.evaluate("1 != 2", result) == mathex::Success);
+    cr_expect(comparison.evaluate("!1", result) == mathex::Error::SyntaxError);
+    cr_expect(comparison.evaluate("1 || 2", result) == mathex::Error::SyntaxError);
+
+    mathex::Config conditional(mathex::DefaultFlags + mathex::Flags::Conditional);
+
+    cr_expect(conditional.evaluate("if(1, 2, 3)", result) == mathex::Success);
+    cr_expect(conditional.evaluate("if (1, 2, 3)", result) == mathex::Error::SyntaxError);
+
+    // Defining the name hides the conditional
+    conditional.addConstant("if", 4);
+    cr_expect(conditional.evaluate("if", result) == mathex::Success && result == 4);
+}
+
+Test(conditional, syntax) {
+    mathex::Config config(Flags);
+    double result;
+
+    cr_expect(config.evaluate("1 = 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 & 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 | 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 <", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("< 1", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("&& 1", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 !", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("1 < < 2", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("if(1, 2)", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config.evaluate("if(1, 2, 3, 4)", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config.evaluate("if(1)", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config.evaluate("if()", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config.evaluate("if(1, 2, 3", result) == mathex::Success && result == 2);
+
+    // Commas inside parentheses of a subexpression do not separate arguments
+    mathex::Expression expression;
+    cr_expect(config.evaluate("if((1, 2), 3)", result) == mathex::Error::SyntaxError);
+    cr_expect(config.compile("if((1, 2), 3)", expression) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("if(1, (2, 3), 4)", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("if(1, 2, (3, 4))", result) == mathex::Error::SyntaxError);
+    cr_expect(config.evaluate("if(if(1, 2, 3), (4), 5)", result) == mathex::Success && result == 4);
+}
+
+Test(conditional, short_circuit) {
+    mathex::Config config(Flags);
+    define(config);
+    double result;
+
+    std::vector<std::string> skipped = {"0 && counted(1)", "1 || counted(1)", "if(1, 2, counted(3))", "if(0, counted(2), 3)", "if(0 && counted(1), counted(2), 3)"};
+
+    for (const std::string &expression : skipped) {
+        for (mathex::Optimization optimization : {mathex::Optimization::None, mathex::Optimization::Exact}) {
+            mathex::Expression compiled;
+            cr_assert(config.compile(expression, compiled, optimization) == mathex::Success, "%s", expression.c_str());
+
+            calls = 0;
+            cr_expect(compiled.evaluate(result) == mathex::Success, "%s", expression.c_str());
+            cr_expect(calls == 0, "%s", expression.c_str());
+
+            if (compiled.jit()) {
+                cr_expect(compiled.evaluate(result) == mathex::Success, "%s", expression.c_str());
+                cr_expect(calls == 0, "%s", expression.c_str());
+            }
+        }
+    }
+
+    calls = 0;
+    cr_expect(config.evaluate("1 && counted(1)", result) == mathex::Success && result == 1);
+    cr_expect(config.evaluate("0 || counted(0)", result) == mathex::Success && result == 0);
+    cr_expect(calls == 2);
+
+    // Error of function in the branch not taken is never seen
+    cr_expect(config.evaluate("if(-4 < 0, 0, root(-4))", result) == mathex::Success && result == 0);
+    cr_expect(config.evaluate("if(-4 >= 0, root(-4), 0)", result) == mathex::Success && result == 0);
+    cr_expect(config.evaluate("if(4 >= 0, root(-4), 0)", result) == mathex::Error::InvalidArgs);
+}
+
+Test(conditional, nan) {
+    mathex::Config config(Flags);
+    config.addConstant("nan", std::nan(""));
+    double result;
+
+    // NaN is not equal to anything and is not zero, so it counts as true
+    std::vector<std::pair<std::string, double>> cases = {
+        {"nan < 1", 0}, {"nan >= 1", 0}, {"nan == nan", 0}, {"nan != nan", 1}, {"!nan", 0}, {"nan && 1", 1}, {"if(nan, 2, 3)", 2},
+    };
+
+    for (const auto &entry : cases) {
+        mathex::Expression compiled;
+        cr_assert(config.compile(entry.first, compiled) == mathex::Success, "%s", entry.first.c_str());
+        cr_expect(compiled.evaluate(result) == mathex::Success && result == entry.second, "%s", entry.first.c_str());
+
+        if (compiled.jit()) {
+            cr_expect(compiled.evaluate(result) == mathex::Success && result == entry.second, "%s", entry.first.c_str());
+        }
+    }
+}
+
+static bool same(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || (a == b && std::signbit(a) == std::signbit(b));
+}
+
+Test(conditional, modes) {
+    mathex::Config config(Flags + mathex::Flags::Exponentiation);
+    define(config);
+
+    config.declareVariable("x");
+    config.declareVariable("y");
+
+    std::vector<std::string> sources = {
+        "if(x > y, x - y, y - x)",
+        "if(x > 0, root(x), -root(-x)) + 1",
+        "x > 0 && y > 0 || x < y",
+        "if(x >= 0 && y >= 0, root(x * y), if(x < 0, counted(x), y))",
+        "!(x == y) * if(x < 0.5, x, 2 * y)",
+        "if(x > 0, if(y > 0, x * y, x / y), if(y > 0, counted(y), x + y))",
+    };
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> distribution(-2, 2);
+    std::vector<double> frames(2000);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        // Some rows have equal values, so that branches on equality are taken too
+        frames[i] = i % 7 == 0 ? 0.25 : distribution(random);
+    }
+
+    size_t count = frames.size() / 2;
+    std::vector<mathex::Expression> expressions;
+
+    for (const std::string &source : sources) {
+        mathex::Expression none, exact, jit;
+        cr_assert(config.compile(source, none, mathex::Optimization::None) == mathex::Success, "%s", source.c_str());
+        cr_assert(config.compile(source, exact, mathex::Optimization::Exact) == mathex::Success, "%s", source.c_str());
+        cr_assert(config.compile(source, jit, mathex::Optimization::Exact) == mathex::Success, "%s", source.c_str());
+        jit.jit();
+        expressions.push_back(none);
+
+        // Both branches are computed for every row, yet functions in the branch not taken are not called
+        std::vector<double> batch(count);
+        cr_assert(none.evaluate(frames.data(), 2, batch.data(), count) == mathex::Success, "%s", source.c_str());
+
+        for (size_t i = 0; i < count; i++) {
+            double expected, result;
+            cr_assert(none.evaluate(frames.data() + 2 * i, expected) == mathex::Success, "%s", source.c_str());
+            cr_expect(same(batch[i], expected), "%s row %zu", source.c_str(), i);
+
+            cr_assert(exact.evaluate(frames.data() + 2 * i, result) == mathex::Success, "%s", source.c_str());
+            cr_expect(same(result, expected), "%s row %zu", source.c_str(), i);
+
+            cr_assert(jit.evaluate(frames.data() + 2 * i, result) == mathex::Success, "%s", source.c_str());
+            cr_expect(same(result, expected), "%s row %zu", source.c_str(), i);
+        }
+    }
+
+    mathex::ExpressionSet set(expressions);
+    std::vector<double> results(set.size());
+
+    for (size_t i = 0; i < count; i++) {
+        cr_assert(set.evaluate(results.data(), frames.data() + 2 * i) == mathex::Success);
+
+        for (size_t k = 0; k < expressions.size(); k++) {
+            double expected;
+            cr_assert(expressions[k].evaluate(frames.data() + 2 * i, expected) == mathex::Success);
+            cr_expect(same(results[k], expected), "%s row %zu", sources[k].c_str(), i);
+        }
+    }
+}
+
+Test(conditional, differentiate) {
+    mathex::Config config(Flags);
+    double x = 1.5;
+    config.addVariable("x", x);
+
+    mathex::Expression expression;
+    cr_assert(config.compile("if(x > 1, x * x, -x) + (x < 3)", expression) == mathex::Success);
+
+    for (mathex::Differentiation mode : {mathex::Differentiation::Forward, mathex::Differentiation::Reverse}) {
+        double result, gradient;
+
+        x = 1.5;
+        cr_assert(expression.differentiate({"x"}, result, &gradient, mode) == mathex::Success);
+        cr_expect(result == 3.25 && gradient == 3);
+
+        x = 0.5;
+        cr_assert(expression.differentiate({"x"}, result, &gradient, mode) == mathex::Success);
+        cr_expect(result == 0.5 && gradient == -1);
+    }
+}
+
+Test(conditional, bytecode) {
+    mathex::Config config(Flags);
+    double x = 2;
+    config.addVariable("x", x);
+
+    std::vector<mathex::Expression> expressions(2);
+    cr_assert(config.compile("if(x > 1 && x < 3, x * 10, if(x == 0, 1, -1))", expressions[0]) == mathex::Success);
+    cr_assert(config.compile("!x || x >= 2", expressions[1]) == mathex::Success);
+
+    std::string path = "conditional_test.mxbc";
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+
+    std::vector<mathex::Expression> loaded;
+    cr_assert(config.load(path, loaded) == mathex::Success);
+    std::remove(path.c_str());
+
+    for (double value : {0.0, 2.0, 5.0}) {
+        x = value;
+
+        for (size_t i = 0; i < expressions.size(); i++) {
+            double expected, result;
+            cr_assert(expressions[i].evaluate(expected) == mathex::Success);
+            cr_assert(loaded[i].evaluate(result) == mathex::Success);
+            cr_expect(result == expected);
+        }
+    }
+
+    // Files with conditionals are only loaded with the same flags
+    mathex::Config plain(mathex::DefaultFlags);
+    plain.addVariable("x", x);
+    cr_assert(mathex::Expression::save(path, expressions) == mathex::Success);
+    cr_expect(plain.load(path, loaded) == mathex::Error::SyntaxError);
+    std::remove(path.c_str());
+}
@@ -25,6 +25,8 @@
 #include <criterion/new/assert.h>
 #include <mathex>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 mathex::Config *config = nullptr;
 double result;
@@ -111,3 +113,113 @@ Test(config, addFunction) {
     cr_assert_not(config->remove("رطانة"));
     cr_assert(config->evaluate("abs(foo()) + 1.12", result) == mathex::Error::Undefined);
 }
+
+static double hypotenuse(double a, double b) {
+    return std::sqrt(a * a + b * b);
+}
+
+Test(config, addTypedFunction) {
+    double scale = 2;
+    mathex::Expression expression;
+
+    cr_assert_none_throw(config->addFunction<double(double, double)>("hyp", hypotenuse));
+    cr_assert_none_throw(config->addFunction<double(double)>("scale", [&scale](double x) { return x * scale; }));
+    cr_assert_none_throw(config->addFunction<double()>("one", []() noexcept { return 1.0; }));
+    cr_assert_throw(config->addFunction<double(double)>("scale", [](double x) { return x; }), mathex::AlreadyDefined);
+    cr_assert_throw(config->addFunction<double(double)>("رطانة", [](double x) { return x; }), std::invalid_argument);
+
+    cr_assert(config->evaluate("scale(hyp(3, 4)) + one()", result) == mathex::Success, "typed functions used in expressions without errors");
+    cr_assert(ieee_ulp_eq(dbl, result, 11, 0), "calculations with typed functions are correct");
+
+    // Number of arguments is checked without evaluating the expression
+    cr_assert(config->compile("hyp(3)", expression) == mathex::Error::IncorrectArgsNum);
+    cr_assert(config->compile("1 + scale(1, 2)", expression) == mathex::Error::IncorrectArgsNum);
+    cr_assert(config->compile("one(1)", expression) == mathex::Error::IncorrectArgsNum);
+    cr_assert(config->compile("hyp", expression) == mathex::Error::SyntaxError);
+
+    std::vector<double> xs(1000), results(1000);
+
+    for (size_t i = 0; i < xs.size(); i++) {
+        xs[i] = (double)i;
+    }
+
+    config->addVariable("x", xs[0]);
+    cr_assert(config->compile("hyp(x, scale(x)) - one()", expression) == mathex::Success);
+    cr_assert(expression.evaluate({{"x", xs.data()}}, results.data(), xs.size()) == mathex::Success);
+
+    for (size_t i = 0; i < xs.size(); i++) {
+        cr_expect(ieee_ulp_eq(dbl, results[i], hypotenuse(xs[i], 2 * xs[i]) - 1, 0), "row %zu", i);
+    }
+
+    cr_assert(config->remove("x"));
+    cr_assert(config->remove("hyp"));
+    cr_assert(config->remove("scale"));
+    cr_assert(config->remove("one"));
+    cr_assert(config->evaluate("one()", result) == mathex::Error::Undefined);
+}
+
+Test(config, cache) {
+    double x = 5;
+    config->addVariable("x", x);
+    config->addConstant("c", 2);
+
+    // Cache is disabled by default
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(config->cacheHits() == 0 && config->cacheMisses() == 0);
+
+    config->setCacheCapacity(2);
+
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 7, 4));
+    cr_assert(config->cacheHits() == 1 && config->cacheMisses() == 1);
+
+    // Cached expressions still read current values of variables
+    x = 10;
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 12, 4));
+    cr_assert(config->cacheHits() == 2);
+
+    // Least recently used expression is evicted
+    cr_assert(config->evaluate("x * 2", result) == mathex::Success);
+    cr_assert(config->evaluate("x * 3", result) == mathex::Success);
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(config->cacheHits() == 2 && config->cacheMisses() == 4);
+
+    // Changing a symbol discards expressions using it
+    cr_assert(config->remove("c"));
+    cr_assert(config->evaluate("x + c", result) == mathex::Error::Undefined);
+    config->addConstant("c", 4);
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 14, 4));
+
+    // Compiled expressions share the cache
+    mathex::Expression expression;
+    size_t hits = config->cacheHits();
+    cr_assert(config->compile("x + c", expression) == mathex::Success);
+    cr_assert(config->cacheHits() == hits + 1);
+
+    config->setCacheCapacity(0);
+    cr_assert(config->evaluate("x + c", result) == mathex::Success);
+    cr_assert(config->cacheHits() == hits + 1);
+}
+
+Test(config, many_symbols) {
+    std::vector<double> values(5000);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = (double)i;
+        config->addVariable("v" + std::to_string(i), values[i]);
+    }
+
+    cr_assert(config->evaluate("v0 + v1234 * v4999", result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 1234 * 4999, 4));
+    cr_assert(config->evaluate("v5000", result) == mathex::Error::Undefined);
+
+    // Lookup table is updated after changes
+    config->addConstant("v5000", 0.5);
+    cr_assert(config->remove("v1234"));
+    cr_assert(config->evaluate("v5000 + v4999", result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 4999.5, 4));
+    cr_assert(config->evaluate("v1234", result) == mathex::Error::Undefined);
+}
@@ -23,7 +23,11 @@
 #include <cmath>
 #include <criterion/criterion.h>
 #include <criterion/new/assert.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <mathex>
+#include <random>
 
 mathex::Config *config = nullptr;
 double result;
@@ -177,6 +181,38 @@ Test(evaluate, number_format) {
     cr_expect(config->evaluate("1.6e4.3", result) == mathex::Error::SyntaxError);
 }
 
+Test(evaluate, number_rounding) {
+    // Literals are rounded to the nearest double, just like by the compiler
+    const char *sources[] = {"0.1", "0.3", "1e23", "9007199254740993", "2.2250738585072011e-308", "4.9406564584124654e-324", "1.7976931348623157e308", "123456789012345678901234567890", "0.000000000000000000000000000000000000001", "1.00000000000000011102230246251565404236316680908203125"};
+    double values[] = {0.1, 0.3, 1e23, 9007199254740993., 2.2250738585072011e-308, 4.9406564584124654e-324, 1.7976931348623157e308, 123456789012345678901234567890., 0.000000000000000000000000000000000000001, 1.00000000000000011102230246251565404236316680908203125};
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++) {
+        cr_expect(config->evaluate(sources[i], result) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, result, values[i], 0), "%s", sources[i]);
+    }
+
+    cr_expect(config->evaluate("1e400", result) == mathex::Success);
+    cr_expect(std::isinf(result));
+
+    cr_expect(config->evaluate("1e-400", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 0, 0));
+
+    // Any finite double printed with 17 significant digits is parsed back exactly
+    std::mt19937_64 random(1);
+
+    for (int i = 0; i < 10000; i++) {
+        std::uint64_t bits = random() & 0x7FEFFFFFFFFFFFFFull;
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+
+        char source[32];
+        std::snprintf(source, sizeof(source), "%.17g", value);
+
+        cr_expect(config->evaluate(source, result) == mathex::Success, "%s", source);
+        cr_expect(std::memcmp(&result, &value, sizeof(value)) == 0, "%s", source);
+    }
+}
+
 Test(evaluate, variables) {
     cr_expect(config->evaluate("x + 5", result) == mathex::Success);
     cr_expect(ieee_ulp_eq(dbl, result, 10, 4));
@@ -248,3 +284,13 @@ Test(evaluate, functions) {
     cr_expect(config->evaluate("3^2 + f(2x - g(3^1))", result) == mathex::Success);
     cr_expect(ieee_ulp_eq(dbl, result, 13, 4));
 }
+
+Test(evaluate, nested_commas) {
+    // Commas only separate arguments directly inside parentheses of a call
+    cr_expect(config->evaluate("foo((2, 5))", result) == mathex::Error::SyntaxError);
+    cr_expect(config->evaluate("foo(2, (5, 1))", result) == mathex::Error::SyntaxError);
+    cr_expect(config->evaluate("(2, 5)", result) == mathex::Error::SyntaxError);
+
+    cr_expect(config->evaluate("foo((2), h(1, 5))", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 2, 4));
+}
@@ -0,0 +1,181 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstdlib>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <new>
+
+// Counts heap allocations made by the test process
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+
+    if (void *pointer = std::malloc(size > 0 ? size : 1)) {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+mathex::Config *config = nullptr;
+double result;
+
+double x = 5;
+double y = 3;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Exponentiation);
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+    config->addConstant("pi", 3.14);
+
+    config->addFunction("h", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 2) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] * args[0] + args[1];
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(evaluator, .init = suite_setup, .fini = suite_teardown);
+
+Test(evaluator, evaluate) {
+    mathex::Evaluator evaluator;
+    mathex::Expression expression;
+
+    cr_assert(config->compile("h(x, y) * 2 - (pi^2)", expression) == mathex::Success);
+    cr_assert(evaluator.evaluate(expression, result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 56 - 3.14 * 3.14, 4));
+
+    cr_assert(evaluator.evaluate(mathex::Expression(), result) == mathex::Error::SyntaxError);
+}
+
+Test(evaluator, no_allocations) {
+    mathex::Evaluator evaluator(1);
+    mathex::Expression expression;
+    cr_assert(config->compile("h(x, h(y, -x)) / (1 + (2 + (3 + (4 + x)))) + 2pi", expression) == mathex::Success);
+
+    // Warm up
+    cr_assert(evaluator.evaluate(expression, result) == mathex::Success);
+
+    // Make sure allocations are actually counted
+    size_t before = allocations;
+    cr_assert(config->compile("x + 1", expression) == mathex::Success);
+    cr_assert(allocations > before);
+    cr_assert(config->compile("h(x, h(y, -x)) / (1 + (2 + (3 + (4 + x)))) + 2pi", expression) == mathex::Success);
+
+    before = allocations;
+    bool success = true;
+
+    for (int i = 0; i < 1000; i++) {
+        x = i;
+        success = success && evaluator.evaluate(expression, result) == mathex::Success;
+    }
+
+    size_t after = allocations;
+    x = 5;
+
+    cr_assert(success);
+    cr_assert(after == before, "warmed up evaluation does not allocate");
+}
+
+Test(evaluator, no_allocations_batch) {
+    mathex::Evaluator evaluator;
+    mathex::Expression expression;
+    cr_assert(config->compile("h(x, y) - (x^2) / 2", expression) == mathex::Success);
+
+    const size_t count = 1000;
+    double xs[count];
+    double results[count];
+
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = (double)i;
+    }
+
+    mathex::Columns columns = {{"x", xs}};
+
+    // Warm up
+    cr_assert(evaluator.evaluate(expression, columns, results, count) == mathex::Success);
+
+    size_t before = allocations;
+    bool success = evaluator.evaluate(expression, columns, results, count) == mathex::Success;
+    size_t after = allocations;
+
+    cr_assert(success);
+    cr_assert(after == before, "warmed up batch evaluation does not allocate");
+
+    for (size_t i = 0; i < count; i++) {
+        cr_assert(ieee_ulp_eq(dbl, results[i], xs[i] * xs[i] / 2 + y, 4));
+    }
+}
+
+Test(evaluator, no_allocations_conditional) {
+    mathex::Config conditional(mathex::DefaultFlags + mathex::Flags::Comparison + mathex::Flags::Conditional);
+    conditional.addVariable("x", x);
+    conditional.addFunction("twice", [](double args[], int, double &result) -> mathex::Error {
+        result = 2 * args[0];
+        return mathex::Success;
+    });
+
+    mathex::Evaluator evaluator;
+    mathex::Expression expression;
+    cr_assert(conditional.compile("if(x < 500, twice(x), if(x < 800, x, 0 - x))", expression) == mathex::Success);
+
+    const size_t count = 1000;
+    double xs[count];
+    double results[count];
+
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = (double)i;
+    }
+
+    mathex::Columns columns = {{"x", xs}};
+
+    // Warm up
+    cr_assert(evaluator.evaluate(expression, columns, results, count) == mathex::Success);
+
+    size_t before = allocations;
+    bool success = evaluator.evaluate(expression, columns, results, count) == mathex::Success;
+    size_t after = allocations;
+
+    cr_assert(success);
+    cr_assert(after == before, "warmed up batch evaluation of conditionals does not allocate");
+
+    for (size_t i = 0; i < count; i++) {
+        cr_assert(ieee_ulp_eq(dbl, results[i], xs[i] < 500 ? 2 * xs[i] : xs[i] < 800 ? xs[i] : -xs[i], 4));
+    }
+}
@@ -0,0 +1,162 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+
+mathex::Config *config = nullptr;
+double result;
+
+double x = 5;
+double y = 3;
+
+void suite_setup(void) {
+    config = new mathex::Config();
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+    config->addConstant("pi", 3.14);
+
+    config->addFunction("f", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] * args[0];
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(expression, .init = suite_setup, .fini = suite_teardown);
+
+Test(expression, compile) {
+    mathex::Expression expression;
+
+    cr_assert(config->compile("2x + f(y) - pi", expression) == mathex::Success);
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 15.86, 4));
+
+    cr_expect(config->compile("5 5", expression) == mathex::Error::SyntaxError);
+    cr_expect(config->compile("x + a", expression) == mathex::Error::Undefined);
+
+    // Failed compilation leaves previous expression intact
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 15.86, 4));
+}
+
+Test(expression, empty_expression) {
+    mathex::Expression expression;
+    cr_expect(expression.evaluate(result) == mathex::Error::SyntaxError);
+}
+
+Test(expression, changing_variables) {
+    mathex::Expression expression;
+    cr_assert(config->compile("x * y", expression) == mathex::Success);
+
+    for (int i = 0; i < 10; i++) {
+        x = i;
+        y = i + 1;
+
+        cr_assert(expression.evaluate(result) == mathex::Success);
+        cr_assert(ieee_ulp_eq(dbl, result, i * (i + 1), 4));
+    }
+
+    x = 5;
+    y = 3;
+}
+
+Test(expression, outlives_config) {
+    mathex::Expression expression;
+    cr_assert(config->compile("f(pi) + 1", expression) == mathex::Success);
+
+    delete config;
+    config = nullptr;
+
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 3.14 * 3.14 + 1, 4));
+}
+
+Test(expression, function_errors) {
+    mathex::Expression expression;
+    cr_assert(config->compile("f()", expression) == mathex::Success);
+    cr_expect(expression.evaluate(result) == mathex::Error::IncorrectArgsNum);
+}
+
+Test(expression, implicit_parentheses) {
+    mathex::Expression expression;
+    cr_assert(config->compile("(x + y", expression) == mathex::Success);
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_assert(ieee_ulp_eq(dbl, result, 8, 4));
+}
+
+Test(expression, batch) {
+    mathex::Config local(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus);
+    double a = 0;
+    double b = 0;
+    double c = 0.5;
+
+    local.addVariable("a", a);
+    local.addVariable("b", b);
+    local.addVariable("c", c);
+    local.addFunction("f", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 2) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] - 2 * args[1];
+        return mathex::Success;
+    });
+
+    const size_t count = 1000;
+    double as[count];
+    double bs[count];
+    double results[count];
+
+    for (size_t i = 0; i < count; i++) {
+        as[i] = (double)i / 7;
+        bs[i] = 3 - (double)i / 13;
+    }
+
+    mathex::Expression expression;
+    cr_assert(local.compile("-a * b + a / (b % 5) - f(a, c)^2 + 2c", expression) == mathex::Success);
+    cr_assert(expression.evaluate({{"a", as}, {"b", bs}}, results, count) == mathex::Success);
+
+    for (size_t i = 0; i < count; i++) {
+        a = as[i];
+        b = bs[i];
+
+        double expected;
+        cr_assert(expression.evaluate(expected) == mathex::Success);
+        cr_assert(ieee_ulp_eq(dbl, results[i], expected, 0), "batch row matches scalar evaluation");
+    }
+
+    cr_assert(expression.evaluate({{"a", as}}, results, 0) == mathex::Success);
+
+    cr_assert(local.compile("f(a)", expression) == mathex::Success);
+    cr_expect(expression.evaluate({{"a", as}}, results, count) == mathex::Error::IncorrectArgsNum);
+}
@@ -0,0 +1,157 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <stdexcept>
+#include <vector>
+
+mathex::Config *config = nullptr;
+
+double z = 10;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Exponentiation);
+    config->declareVariable("a");
+    config->declareVariable("b");
+    config->declareVariable("c");
+    config->addVariable("z", z);
+
+    config->addFunction("sum", [](double args[], int argc, double &result) -> mathex::Error {
+        result = 0;
+
+        for (int i = 0; i < argc; i++) {
+            result += args[i];
+        }
+
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(frame, .init = suite_setup, .fini = suite_teardown);
+
+Test(frame, slots) {
+    mathex::Config local;
+
+    cr_expect(local.frameSize() == 0);
+    cr_expect(local.declareVariable("first") == 0);
+    cr_expect(local.declareVariable("second") == 1);
+    cr_expect_throw(local.declareVariable("second"), mathex::AlreadyDefined);
+    cr_expect_throw(local.declareVariable("2nd"), std::invalid_argument);
+
+    // Slots of removed variables are not given out again
+    cr_expect(local.remove("first"));
+    cr_expect(local.declareVariable("third") == 2);
+    cr_expect(local.declareVariable("first") == 3);
+    cr_expect(local.frameSize() == 4);
+}
+
+Test(frame, evaluate) {
+    mathex::Expression expression;
+    double frame[] = {1, 2, 3};
+    double result;
+
+    cr_assert(config->compile("a + b * c - z", expression) == mathex::Success);
+    cr_assert(expression.evaluate(frame, result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, -3, 0));
+
+    frame[1] = 10;
+    cr_assert(expression.evaluate(frame, result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 21, 0));
+
+    // Declared variables have no value without a frame
+    cr_expect(expression.evaluate(result) == mathex::Error::Undefined);
+    cr_expect(config->evaluate("a + 1", result) == mathex::Error::Undefined);
+
+    // Expressions without declared variables do not need a frame
+    cr_assert(config->compile("z^2", expression) == mathex::Success);
+    cr_assert(expression.evaluate(nullptr, result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 100, 0));
+}
+
+Test(frame, records) {
+    const size_t count = 1000, stride = 4;
+    std::vector<double> frames(count * stride);
+    std::vector<double> results(count);
+    mathex::Expression expression;
+    mathex::Evaluator evaluator;
+
+    for (size_t i = 0; i < count; i++) {
+        frames[i * stride + 0] = (double)i;
+        frames[i * stride + 1] = (double)i * 0.5;
+        frames[i * stride + 2] = -(double)i;
+        frames[i * stride + 3] = 1e300; // Padding, never read.
+    }
+
+    cr_assert(config->compile("sum(a, b) * c^2 - z / (a + 1)", expression) == mathex::Success);
+    cr_assert(expression.evaluate(frames.data(), stride, results.data(), count) == mathex::Success);
+
+    for (size_t i = 0; i < count; i++) {
+        double expected;
+        cr_assert(expression.evaluate(&frames[i * stride], expected) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, results[i], expected, 0), "record %zu", i);
+    }
+
+    std::fill(results.begin(), results.end(), 0);
+    cr_assert(evaluator.evaluate(expression, frames.data(), stride, results.data(), count) == mathex::Success);
+
+    for (size_t i = 0; i < count; i++) {
+        double expected;
+        cr_assert(evaluator.evaluate(expression, &frames[i * stride], expected) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, results[i], expected, 0), "record %zu", i);
+    }
+
+    // Frames have to cover every slot the expression reads
+    cr_expect(expression.evaluate(frames.data(), 2, results.data(), count) == mathex::Error::InvalidArgs);
+    cr_expect(expression.evaluate(nullptr, stride, results.data(), count) == mathex::Error::Undefined);
+    cr_expect(expression.evaluate(mathex::Columns(), results.data(), count) == mathex::Error::Undefined);
+}
+
+Test(frame, jit) {
+    mathex::Expression interpreted, native;
+    double frame[] = {1.5, -2, 0.25};
+
+    cr_assert(config->compile("(a - b) * sum(c, z, a) / (b^3)", interpreted) == mathex::Success);
+    native = interpreted;
+
+    if (!native.jit()) {
+        return;
+    }
+
+    for (double value : {1.5, 0.0, -7.0, 1e300}) {
+        frame[0] = value;
+        double expected, actual;
+
+        cr_assert(interpreted.evaluate(frame, expected) == mathex::Success);
+        cr_assert(native.evaluate(frame, actual) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, actual, expected, 0));
+    }
+
+    double result;
+    cr_expect(native.evaluate(result) == mathex::Error::Undefined);
+}
@@ -0,0 +1,190 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+double price = 10;
+double quantity = 3;
+double rate = 0.2;
+
+static double value(const mathex::FormulaGraph &graph, const std::string &name) {
+    double result = 0;
+    cr_assert(graph.value(name, result) == mathex::Success, "%s", name.c_str());
+    return result;
+}
+
+Test(graph, update) {
+    mathex::Config config;
+    config.addVariable("price", price);
+    config.addVariable("quantity", quantity);
+    config.addVariable("rate", rate);
+
+    mathex::FormulaGraph graph(config);
+    cr_assert(graph.define("subtotal", "price * quantity") == mathex::Success);
+    cr_assert(graph.define("tax", "subtotal * rate") == mathex::Success);
+    cr_assert(graph.define("total", "subtotal + tax") == mathex::Success);
+    cr_assert(graph.define("discounted", "total * 0.9") == mathex::Success);
+
+    cr_assert(graph.update() == mathex::Success);
+    cr_expect(graph.recomputed() == 4);
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "total"), 36, 0));
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "discounted"), 36 * 0.9, 0));
+
+    // Nothing changed
+    cr_assert(graph.update() == mathex::Success);
+    cr_expect(graph.recomputed() == 0);
+
+    // Only formulas downstream of the input are recomputed
+    rate = 0.5;
+    graph.changed("rate");
+    cr_assert(graph.update() == mathex::Success);
+    cr_expect(graph.recomputed() == 3);
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "tax"), 15, 0));
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "total"), 45, 0));
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "subtotal"), 30, 0));
+
+    // Formula whose value did not change does not recompute formulas using it
+    price = 5;
+    quantity = 6;
+    graph.changed("price");
+    graph.changed("quantity");
+    cr_assert(graph.update() == mathex::Success);
+    cr_expect(graph.recomputed() == 1);
+
+    // Values of formulas are variables of the config
+    double result;
+    cr_assert(config.evaluate("total - tax", result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 30, 0));
+
+    price = 10;
+    quantity = 3;
+    rate = 0.2;
+}
+
+Test(graph, order) {
+    mathex::Config config;
+    config.addVariable("price", price);
+
+    mathex::FormulaGraph graph(config);
+    cr_assert(graph.define("a", "price + 1") == mathex::Success);
+    cr_assert(graph.define("b", "a * 2") == mathex::Success);
+    cr_assert(graph.define("c", "price - b") == mathex::Success);
+
+    // Redefining a formula to use a formula defined after it moves it after that formula
+    cr_assert(graph.define("a", "price + 1") == mathex::Success);
+    cr_assert(graph.define("d", "price") == mathex::Success);
+    cr_assert(graph.define("a", "d / 2") == mathex::Success);
+
+    std::vector<std::string> order = graph.order();
+    auto position = [&](const std::string &name) { return std::find(order.begin(), order.end(), name) - order.begin(); };
+
+    cr_assert(order.size() == 4);
+    cr_expect(position("d") < position("a"));
+    cr_expect(position("a") < position("b"));
+    cr_expect(position("b") < position("c"));
+
+    cr_assert(graph.update() == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "c"), 0, 0));
+}
+
+Test(graph, cycles) {
+    mathex::Config config;
+    config.addVariable("price", price);
+
+    mathex::FormulaGraph graph(config);
+    cr_expect(graph.define("a", "a + 1") == mathex::Error::CircularDependency);
+    cr_expect(graph.order().empty());
+
+    double result;
+    cr_expect(config.evaluate("a", result) == mathex::Error::Undefined, "failed definition leaves no variable behind");
+
+    cr_assert(graph.define("a", "price") == mathex::Success);
+    cr_assert(graph.define("b", "a + 1") == mathex::Success);
+    cr_assert(graph.define("c", "b * 2") == mathex::Success);
+    cr_expect(graph.define("a", "c - 1") == mathex::Error::CircularDependency);
+    cr_expect(graph.define("b", "b") == mathex::Error::CircularDependency);
+
+    // Failed definitions leave previous formulas in place
+    cr_assert(graph.update() == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "c"), 22, 0));
+}
+
+Test(graph, errors) {
+    mathex::Config config;
+    config.addVariable("price", price);
+    config.declareVariable("slot");
+
+    mathex::FormulaGraph graph(config);
+    cr_expect(graph.define("a", "unknown + 1") == mathex::Error::Undefined);
+    cr_expect(graph.define("a", "price +") == mathex::Error::SyntaxError);
+    cr_expect_throw(graph.define("price", "1"), mathex::AlreadyDefined);
+    cr_expect_throw(graph.define("2a", "1"), std::invalid_argument);
+
+    // Formulas reading frame variables need a frame
+    cr_assert(graph.define("a", "slot * 2") == mathex::Success);
+    cr_assert(graph.define("b", "a + price") == mathex::Success);
+    cr_expect(graph.update() == mathex::Error::Undefined);
+
+    double result;
+    cr_expect(graph.value("a", result) == mathex::Error::Undefined);
+    cr_expect(graph.value("missing", result) == mathex::Error::Undefined);
+
+    double frame[] = {4};
+    graph.changed("slot");
+    cr_assert(graph.update(frame) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "b"), 18, 0));
+
+    frame[0] = 5;
+    graph.changed("slot");
+    cr_assert(graph.update(frame) == mathex::Success);
+    cr_expect(graph.recomputed() == 2);
+    cr_expect(ieee_ulp_eq(dbl, value(graph, "b"), 20, 0));
+}
+
+Test(graph, remove) {
+    mathex::Config config;
+    config.addVariable("price", price);
+
+    {
+        mathex::FormulaGraph graph(config);
+        cr_assert(graph.define("a", "price") == mathex::Success);
+        cr_assert(graph.define("b", "a + 1") == mathex::Success);
+
+        cr_expect(!graph.remove("a"), "formula used by other formulas is kept");
+        cr_expect(!graph.remove("missing"));
+        cr_expect(graph.remove("b"));
+        cr_expect(graph.remove("a"));
+        cr_expect(graph.order().empty());
+
+        cr_assert(graph.define("a", "price * 2") == mathex::Success);
+    }
+
+    // Graph removes its variables from the config
+    double result;
+    cr_expect(config.evaluate("a", result) == mathex::Error::Undefined);
+}
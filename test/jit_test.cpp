@@ -0,0 +1,211 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cstring>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <stdexcept>
+#include <string>
+
+mathex::Config *config = nullptr;
+
+double x = 5;
+double y = -3;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus);
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+    config->addConstant("pi", 3.14159);
+
+    config->addFunction("sum", [](double args[], int argc, double &result) -> mathex::Error {
+        result = 0;
+
+        for (int i = 0; i < argc; i++) {
+            result += args[i];
+        }
+
+        return mathex::Success;
+    });
+
+    config->addFunction("inv", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        if (args[0] == 0) {
+            return mathex::Error::DivisionByZero;
+        }
+
+        result = 1 / args[0];
+        return mathex::Success;
+    });
+
+    config->addFunction("fail", [](double[], int, double &) -> mathex::Error {
+        throw std::runtime_error("fail");
+    });
+
+    // Called directly from native code
+    config->addFunction<double(double, double, double)>("mad", [](double a, double b, double c) noexcept { return a * b + c; });
+    config->addFunction<double(double)>("half", [](double a) noexcept { return a / 2; });
+
+    // Called through a trampoline
+    config->addFunction<double(double, double)>("diff", [](double a, double b) { return a - b; });
+    config->addFunction<double()>("boom", []() -> double { throw std::runtime_error("boom"); });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(jit, .init = suite_setup, .fini = suite_teardown);
+
+// Checks that native code gives the same results as the interpreter, bit for bit.
+static void check(const char *source, mathex::Optimization optimization) {
+    mathex::Expression interpreted, native;
+
+    cr_assert(config->compile(source, interpreted, optimization) == mathex::Success, "%s", source);
+    cr_assert(config->compile(source, native, optimization) == mathex::Success, "%s", source);
+
+    if (!native.jit()) {
+        return;
+    }
+
+    for (double value : {5.0, -3.0, 0.0, 0.5, 1e300}) {
+        x = value;
+        double expected = 1, actual = 2;
+
+        mathex::Error error = interpreted.evaluate(expected);
+        cr_expect(native.evaluate(actual) == error, "%s", source);
+
+        if (error == mathex::Success) {
+            cr_expect(std::memcmp(&expected, &actual, sizeof(double)) == 0, "%s: %g != %g", source, expected, actual);
+        }
+    }
+
+    x = 5;
+}
+
+Test(jit, results) {
+    const char *sources[] = {
+        "x",
+        "-x",
+        "+x",
+        "2pi/360",
+        "x + y * 2 - x / 3",
+        "(x - y) * (x + y) / (x * y)",
+        "x^2",
+        "x^(-3)",
+        "x^7 + y^0.5",
+        "(x^y) % 3",
+        "x % (y + 1)",
+        "-(x - (-(-y)))",
+        "sum()",
+        "sum(x)",
+        "sum(x, y, 2) * sum(1, sum(x, 2), 3)",
+        "x * inv(x - 5)",
+        "inv(x) + inv(y)",
+        "((((((((((x+1)*2)-3)/4)+5)*6)-7)/8)+9)*10)",
+        "mad(x, y, 2) + half(x)",
+        "diff(mad(x, 2, y), half(diff(y, x))) * 3",
+        "sum(half(x), diff(1, x), mad(x, x, x))",
+    };
+
+    for (const char *source : sources) {
+        check(source, mathex::Optimization::None);
+        check(source, mathex::Optimization::Exact);
+        check(source, mathex::Optimization::Fast);
+    }
+}
+
+Test(jit, deep) {
+    // Right-nested expression needs more stack than fits into the local buffer.
+    std::string source = "x";
+
+    for (int i = 0; i < 100; i++) {
+        source = "x - (" + source + ")";
+    }
+
+    check(source.c_str(), mathex::Optimization::None);
+}
+
+Test(jit, evaluator) {
+    mathex::Expression expression;
+    mathex::Evaluator evaluator;
+    double result;
+
+    cr_assert(config->compile("sum(x, y, 1) * x", expression) == mathex::Success);
+    expression.jit();
+
+    cr_assert(evaluator.evaluate(expression, result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 15, 0));
+
+    x = 0;
+    cr_assert(evaluator.evaluate(expression, result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 0, 0));
+    x = 5;
+}
+
+Test(jit, exceptions) {
+    mathex::Expression expression;
+    double result;
+    bool thrown = false;
+
+    cr_assert(config->compile("x + fail()", expression) == mathex::Success);
+    expression.jit();
+
+    try {
+        expression.evaluate(result);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+
+    cr_expect(thrown);
+    thrown = false;
+
+    cr_assert(config->compile("half(x) + boom()", expression) == mathex::Success);
+    expression.jit();
+
+    try {
+        expression.evaluate(result);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+
+    cr_expect(thrown);
+}
+
+Test(jit, recompile) {
+    mathex::Expression expression;
+    double result;
+
+    cr_expect(!expression.jit());
+
+    cr_assert(config->compile("x + 1", expression) == mathex::Success);
+    expression.jit();
+    cr_assert(config->compile("x + 2", expression) == mathex::Success);
+
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 7, 0));
+}
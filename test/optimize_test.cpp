@@ -0,0 +1,187 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+
+mathex::Config *config = nullptr;
+double result;
+
+double x = 5;
+double y = 3;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus);
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+    config->addConstant("pi", 3.14159);
+
+    config->addFunction("f", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0] * args[0];
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(optimize, .init = suite_setup, .fini = suite_teardown);
+
+// Compiles expression with given optimization and returns its size, or zero if it failed.
+static size_t compile(const char *expression, mathex::Optimization optimization, mathex::Expression &compiled) {
+    return config->compile(expression, compiled, optimization) == mathex::Success ? compiled.size() : 0;
+}
+
+Test(optimize, constant_folding) {
+    mathex::Expression expression;
+
+    cr_expect(compile("2pi/360", mathex::Optimization::None, expression) == 5);
+    cr_expect(compile("2pi/360", mathex::Optimization::Exact, expression) == 1);
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 2 * 3.14159 / 360, 0));
+
+    cr_expect(compile("x * ((2 + 3)^2) - f(-(4 % 3))", mathex::Optimization::Exact, expression) == 6);
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 5 * 25 - 1, 0));
+}
+
+Test(optimize, exact_identities) {
+    mathex::Expression expression;
+
+    cr_expect(compile("x * 1", mathex::Optimization::Exact, expression) == 1);
+    cr_expect(compile("1 * x", mathex::Optimization::Exact, expression) == 1);
+    cr_expect(compile("x / 1", mathex::Optimization::Exact, expression) == 1);
+    cr_expect(compile("x - 0", mathex::Optimization::Exact, expression) == 1);
+    cr_expect(compile("--x", mathex::Optimization::Exact, expression) == 1);
+    cr_expect(compile("+x", mathex::Optimization::Exact, expression) == 1);
+    cr_expect(compile("x^0", mathex::Optimization::Exact, expression) == 1);
+
+    // Not exact for negative zero
+    cr_expect(compile("x + 0", mathex::Optimization::Exact, expression) == 3);
+
+    x = -0.0;
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(!std::signbit(result));
+    x = 5;
+}
+
+Test(optimize, failing_functions) {
+    // Calls are kept even where their value does not matter, so that their errors are not lost
+    mathex::Config local(mathex::DefaultFlags + mathex::Flags::Exponentiation);
+    local.addFunction("fail", [](double[], int, double &) -> mathex::Error { return mathex::Error::InvalidArgs; });
+
+    mathex::Expression expression;
+    cr_assert(local.compile("fail()^0", expression) == mathex::Success);
+    cr_expect(expression.evaluate(result) == mathex::Error::InvalidArgs);
+    cr_assert(local.compile("(2 * fail() + 1)^0", expression) == mathex::Success);
+    cr_expect(expression.evaluate(result) == mathex::Error::InvalidArgs);
+
+    cr_expect(local.evaluate("fail()^0", result) == mathex::Error::InvalidArgs);
+    local.setCacheCapacity(4);
+    cr_expect(local.evaluate("fail()^0", result) == mathex::Error::InvalidArgs);
+    cr_expect(local.evaluate("fail()^0", result) == mathex::Error::InvalidArgs);
+}
+
+Test(optimize, reciprocal) {
+    mathex::Expression exact;
+    mathex::Expression fast;
+
+    cr_expect(compile("x / 4", mathex::Optimization::Exact, exact) == 3);
+    cr_expect(compile("x / 3", mathex::Optimization::Exact, exact) == 3);
+    cr_expect(compile("x / 3", mathex::Optimization::Fast, fast) == 3);
+
+    for (int i = 0; i < 100; i++) {
+        x = i * 0.37;
+
+        double expected = x / 3;
+        cr_assert(exact.evaluate(result) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, result, expected, 0));
+        cr_assert(fast.evaluate(result) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, result, expected, 1));
+    }
+
+    x = 5;
+}
+
+Test(optimize, fast_identities) {
+    mathex::Expression expression;
+
+    cr_expect(compile("x + 0", mathex::Optimization::Fast, expression) == 1);
+    cr_expect(compile("0 + x", mathex::Optimization::Fast, expression) == 1);
+    cr_expect(compile("x^1", mathex::Optimization::Fast, expression) == 1);
+    cr_expect(compile("x^3", mathex::Optimization::Exact, expression) == 3);
+
+    cr_expect(compile("(x + y)^3", mathex::Optimization::Fast, expression) == 4);
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 512, 0));
+
+    cr_expect(compile("(x + y)^(-2)", mathex::Optimization::Fast, expression) == 4);
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, result, 1.0 / 64, 0));
+
+    double xs[] = {1, 2, 3, 4};
+    double results[4];
+    cr_assert(expression.evaluate({{"x", xs}}, results, 4) == mathex::Success);
+
+    for (int i = 0; i < 4; i++) {
+        cr_expect(ieee_ulp_eq(dbl, results[i], 1 / ((xs[i] + 3) * (xs[i] + 3)), 0));
+    }
+}
+
+Test(optimize, exact_results) {
+    const char *expressions[] = {
+        "x * 1 + y / 8 - (0 - x) * (2 % 3)",
+        "f(x / 1) - (--y) + 2pi * x",
+        "(x - 0) / (y + (-0)) * 1 / 0.5",
+        "x^0 + (1 * x)^(2 * 1)",
+    };
+
+    for (const char *text : expressions) {
+        mathex::Expression plain;
+        mathex::Expression optimized;
+
+        cr_assert(config->compile(text, plain, mathex::Optimization::None) == mathex::Success);
+        cr_assert(config->compile(text, optimized, mathex::Optimization::Exact) == mathex::Success);
+        cr_expect(optimized.size() < plain.size());
+
+        for (int i = -20; i < 20; i++) {
+            x = i * 0.73;
+            y = 1 - i * 0.11;
+
+            double expected;
+            cr_assert(plain.evaluate(expected) == mathex::Success);
+            cr_assert(optimized.evaluate(result) == mathex::Success);
+            cr_expect(ieee_ulp_eq(dbl, result, expected, 0), "%s", text);
+        }
+    }
+
+    x = 5;
+    y = 3;
+}
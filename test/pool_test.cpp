@@ -0,0 +1,147 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <stdexcept>
+#include <vector>
+
+mathex::Config *config = nullptr;
+
+double x = 0;
+double y = 3;
+
+void suite_setup(void) {
+    config = new mathex::Config(mathex::DefaultFlags + mathex::Flags::Exponentiation);
+    config->addVariable("x", x);
+    config->addVariable("y", y);
+
+    // Fails for some rows, with different errors for different rows
+    config->addFunction("check", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        if (args[0] == 70000) {
+            return mathex::Error::InvalidArgs;
+        }
+
+        if (args[0] == 30000) {
+            return mathex::Error::DivisionByZero;
+        }
+
+        if (args[0] == 90000) {
+            throw std::runtime_error("check");
+        }
+
+        result = args[0];
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(pool, .init = suite_setup, .fini = suite_teardown);
+
+Test(pool, identical_results) {
+    const size_t count = 100003;
+    std::vector<double> xs(count), expected(count), actual(count);
+
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = std::sin((double)i) * 100;
+    }
+
+    mathex::Expression expression;
+    cr_assert(config->compile("(x^3 - 2x) / (y + x^2) + check(x)", expression, mathex::Optimization::Fast) == mathex::Success);
+    cr_assert(expression.evaluate({{"x", xs.data()}}, expected.data(), count) == mathex::Success);
+
+    for (size_t threads : {1, 2, 3, 8}) {
+        mathex::ThreadPool pool(threads);
+        cr_expect(pool.size() == threads);
+
+        for (size_t chunk : {0, 1, 256, 1000, 50000, 1000000}) {
+            std::fill(actual.begin(), actual.end(), 0);
+            cr_assert(expression.evaluate({{"x", xs.data()}}, actual.data(), count, pool, chunk) == mathex::Success);
+            cr_expect(std::memcmp(expected.data(), actual.data(), count * sizeof(double)) == 0, "%zu threads, chunk %zu", threads, chunk);
+        }
+    }
+}
+
+Test(pool, first_error) {
+    const size_t count = 100000;
+    std::vector<double> xs(count), results(count);
+
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = (double)i;
+    }
+
+    mathex::Expression expression;
+    mathex::ThreadPool pool(4);
+    cr_assert(config->compile("check(x) + 1", expression) == mathex::Success);
+
+    // Row 30000 fails first, even though other threads reach rows 70000 and 90000 earlier
+    mathex::Error expected = expression.evaluate({{"x", xs.data()}}, results.data(), count);
+    cr_expect(expected == mathex::Error::DivisionByZero);
+
+    for (int i = 0; i < 10; i++) {
+        cr_expect(expression.evaluate({{"x", xs.data()}}, results.data(), count, pool, 1024) == expected);
+    }
+
+    // Exception thrown for row 90000 is rethrown when no earlier row fails
+    bool thrown = false;
+
+    try {
+        expression.evaluate({{"x", xs.data() + 75000}}, results.data(), count - 75000, pool, 1024);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+
+    cr_expect(thrown);
+}
+
+Test(pool, edge_cases) {
+    mathex::Expression expression;
+    mathex::ThreadPool pool(2);
+    double results[4];
+
+    cr_expect(pool.size() > 0);
+    cr_expect(expression.evaluate({}, results, 4, pool) == mathex::Error::SyntaxError);
+
+    cr_assert(config->compile("x + y", expression) == mathex::Success);
+    cr_expect(expression.evaluate({}, results, 0, pool) == mathex::Success);
+
+    x = 2;
+    cr_assert(expression.evaluate({}, results, 4, pool) == mathex::Success);
+
+    for (double result : results) {
+        cr_expect(ieee_ulp_eq(dbl, result, 5, 0));
+    }
+
+    mathex::ThreadPool hardware;
+    cr_expect(hardware.size() > 0);
+}
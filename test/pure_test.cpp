@@ -0,0 +1,209 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <atomic>
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+std::atomic<int> calls(0);
+
+static mathex::Error square(double args[], int argc, double &result) {
+    calls++;
+
+    if (argc != 1) {
+        return mathex::Error::IncorrectArgsNum;
+    }
+
+    result = args[0] * args[0];
+    return mathex::Success;
+}
+
+static mathex::Error inverse(double args[], int, double &result) {
+    calls++;
+    result = 1 / args[0];
+    args[0] = 0; // Functions may change their arguments
+    return mathex::Success;
+}
+
+Test(pure, folding) {
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Functions);
+    double x = 3;
+    config.addVariable("x", x);
+    config.addFunction("pure", square, mathex::Purity::Pure);
+    config.addFunction("impure", square);
+
+    mathex::Expression expression;
+    double result;
+
+    calls = 0;
+    cr_assert(config.compile("pure(2) + pure(pure(1) + 2) * sqrt(pure(4))", expression) == mathex::Success);
+    cr_expect(calls == 4);
+    cr_expect(expression.size() == 1);
+
+    calls = 0;
+    cr_assert(expression.evaluate(result) == mathex::Success);
+    cr_expect(result == 4 + 9 * 4);
+    cr_expect(calls == 0);
+
+    // Calls with variable arguments, impure functions and unoptimized expressions are left as they are
+    cr_assert(config.compile("pure(x) + impure(2)", expression) == mathex::Success);
+    cr_expect(expression.size() == 5);
+
+    cr_assert(config.compile("pure(2)", expression, mathex::Optimization::None) == mathex::Success);
+    cr_expect(expression.size() == 2);
+
+    // Failing call is left to fail when evaluated
+    cr_assert(config.compile("pure(1, 2)", expression) == mathex::Success);
+    cr_expect(expression.evaluate(result) == mathex::Error::IncorrectArgsNum);
+
+    config.addFunction<double(double)>("typed", [](double a) { return a + 1; }, mathex::Purity::Pure);
+    cr_assert(config.compile("typed(typed(1))", expression) == mathex::Success);
+    cr_expect(expression.size() == 1);
+    cr_expect(expression.evaluate(result) == mathex::Success && result == 3);
+}
+
+Test(pure, memo) {
+    mathex::Config config(mathex::DefaultFlags);
+    double x = 0;
+    config.addVariable("x", x);
+    config.addFunction("inverse", inverse, mathex::Purity::Pure, 64);
+    config.addFunction("plain", inverse, mathex::Purity::Pure);
+
+    cr_expect_throw(config.addFunction("impure", inverse, mathex::Purity::Impure, 64), std::invalid_argument);
+
+    mathex::Expression memoized, plain;
+    cr_assert(config.compile("inverse(x)", memoized) == mathex::Success);
+    cr_assert(config.compile("plain(x)", plain) == mathex::Success);
+
+    calls = 0;
+
+    for (int i = 0; i < 100; i++) {
+        double result;
+        x = i % 4 + 1;
+        cr_assert(memoized.evaluate(result) == mathex::Success);
+        cr_expect(result == 1 / x);
+    }
+
+    cr_expect(calls == 4);
+    cr_expect(config.memoHits("inverse") == 96);
+    cr_expect(config.memoMisses("inverse") == 4);
+
+    // Zeros of different sign are different arguments
+    double result;
+    x = 0.0;
+    cr_expect(memoized.evaluate(result) == mathex::Success && result == INFINITY);
+    x = -0.0;
+    cr_expect(memoized.evaluate(result) == mathex::Success && result == -INFINITY);
+
+    cr_expect(plain.evaluate(result) == mathex::Success);
+    cr_expect(config.memoHits("plain") == 0 && config.memoMisses("plain") == 0);
+    cr_expect(config.memoHits("x") == 0 && config.memoHits("undefined") == 0);
+}
+
+Test(pure, batch) {
+    mathex::Config config(mathex::DefaultFlags);
+    config.declareVariable("x");
+    config.addFunction("square", square, mathex::Purity::Pure, 16);
+    config.addFunction<double(double)>("half", [](double a) { return a / 2; }, mathex::Purity::Pure, 16);
+
+    mathex::Expression expression;
+    cr_assert(config.compile("square(x) + half(x)", expression) == mathex::Success);
+
+    std::vector<double> frames(10000), results(frames.size());
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i] = (double)(i % 10);
+    }
+
+    calls = 0;
+    cr_assert(expression.evaluate(frames.data(), 1, results.data(), frames.size()) == mathex::Success);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        cr_expect(results[i] == frames[i] * frames[i] + frames[i] / 2);
+    }
+
+    cr_expect(calls == 10);
+    cr_expect(config.memoHits("square") == frames.size() - 10 && config.memoMisses("square") == 10);
+    cr_expect(config.memoHits("half") == frames.size() - 10 && config.memoMisses("half") == 10);
+
+    // Native code calls typed function through the memo too
+    if (expression.jit()) {
+        double result;
+        cr_assert(expression.evaluate(frames.data() + 3, result) == mathex::Success);
+        cr_expect(result == 10.5);
+        cr_expect(config.memoHits("half") == frames.size() - 9);
+    }
+}
+
+Test(pure, threads) {
+    mathex::Config config(mathex::DefaultFlags);
+    double x = 0;
+    config.addVariable("x", x);
+    config.addFunction("square", square, mathex::Purity::Pure, 7);
+
+    mathex::Expression expression;
+    cr_assert(config.compile("square(x)", expression) == mathex::Success);
+
+    std::vector<double> values(100000), results(values.size());
+
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = (double)(i % 100);
+    }
+
+    mathex::ThreadPool pool(4);
+    cr_assert(expression.evaluate({{"x", values.data()}}, results.data(), values.size(), pool, 1000) == mathex::Success);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        cr_expect(results[i] == values[i] * values[i]);
+    }
+
+    cr_expect(config.memoHits("square") + config.memoMisses("square") == values.size());
+}
+
+Test(pure, set) {
+    mathex::Config config(mathex::DefaultFlags);
+    double x = 2;
+    config.addVariable("x", x);
+    config.addFunction("pure", square, mathex::Purity::Pure);
+    config.addFunction("impure", square);
+
+    std::vector<mathex::Expression> expressions(4);
+    cr_assert(config.compile("pure(x) + 1", expressions[0]) == mathex::Success);
+    cr_assert(config.compile("pure(x) * 2", expressions[1]) == mathex::Success);
+    cr_assert(config.compile("impure(x) + 1", expressions[2]) == mathex::Success);
+    cr_assert(config.compile("impure(x) * 2", expressions[3]) == mathex::Success);
+
+    // x, pure, 1, +, 2, *, impure, +, impure, *
+    mathex::ExpressionSet set(expressions);
+    cr_expect(set.operations() == 10);
+
+    std::vector<double> results(set.size());
+    calls = 0;
+    cr_assert(set.evaluate(results.data()) == mathex::Success);
+    cr_expect(calls == 3);
+    cr_expect(results[0] == 5 && results[1] == 8 && results[2] == 5 && results[3] == 8);
+}
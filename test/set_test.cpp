@@ -0,0 +1,200 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <random>
+#include <string>
+#include <vector>
+
+double x = 1.75;
+double y = -0.5;
+double mu = 0.25;
+double sigma = 2;
+
+int calls = 0;
+
+static void define(mathex::Config &config) {
+    config.addVariable("x", x);
+    config.addVariable("y", y);
+    config.addVariable("mu", mu);
+    config.addVariable("sigma", sigma);
+
+    config.addFunction("counted", [](double args[], int argc, double &result) -> mathex::Error {
+        calls++;
+        result = argc > 0 ? args[0] : 0;
+        return mathex::Success;
+    });
+
+    config.addFunction("fail", [](double[], int, double &) -> mathex::Error {
+        return mathex::Error::InvalidArgs;
+    });
+}
+
+static std::vector<mathex::Expression> compile(mathex::Config &config, const std::vector<std::string> &sources, mathex::Optimization optimization = mathex::Optimization::None) {
+    std::vector<mathex::Expression> expressions(sources.size());
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        cr_assert(config.compile(sources[i], expressions[i], optimization) == mathex::Success, "%s", sources[i].c_str());
+    }
+
+    return expressions;
+}
+
+Test(set, shared) {
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Functions);
+    define(config);
+
+    std::vector<std::string> sources = {
+        "(x - mu) / sigma",
+        "(x - mu) / sigma * 2",
+        "2 * ((x - mu) / sigma)",
+        "abs((x - mu) / sigma) + abs((x - mu) / sigma)",
+    };
+
+    std::vector<mathex::Expression> expressions = compile(config, sources);
+    mathex::ExpressionSet set(expressions);
+
+    // x, mu, -, sigma, /, 2, *, abs, +
+    cr_expect(set.size() == 4);
+    cr_expect(set.operations() == 9);
+
+    std::vector<double> results(set.size());
+    cr_assert(set.evaluate(results.data()) == mathex::Success);
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        double expected;
+        cr_assert(expressions[i].evaluate(expected) == mathex::Success);
+        cr_expect(ieee_ulp_eq(dbl, results[i], expected, 0), "%s", sources[i].c_str());
+    }
+
+    // Variables are read at the time of evaluation
+    x = 4.25;
+    cr_assert(set.evaluate(results.data()) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, results[0], 2, 0));
+    cr_expect(ieee_ulp_eq(dbl, results[3], 4, 0));
+    x = 1.75;
+}
+
+Test(set, commutative) {
+    mathex::Config config;
+    define(config);
+
+    mathex::ExpressionSet set(compile(config, {"x + y", "y + x", "x * y", "y * x", "x - y", "y - x"}));
+
+    // x, y, +, *, and both differences
+    cr_expect(set.operations() == 6);
+
+    double results[6];
+    cr_assert(set.evaluate(results) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, results[0], results[1], 0));
+    cr_expect(ieee_ulp_eq(dbl, results[2], results[3], 0));
+    cr_expect(ieee_ulp_eq(dbl, results[4], -results[5], 0));
+}
+
+Test(set, functions) {
+    mathex::Config config;
+    define(config);
+
+    // Functions added to the config are called for every call in the expressions
+    mathex::ExpressionSet set(compile(config, {"counted(x) + counted(x)", "counted(x)"}));
+    double results[2];
+
+    calls = 0;
+    cr_assert(set.evaluate(results) == mathex::Success);
+    cr_expect(calls == 3);
+    cr_expect(ieee_ulp_eq(dbl, results[0], 2 * x, 0));
+
+    mathex::ExpressionSet failing(compile(config, {"x + 1", "fail(x)"}));
+    cr_expect(failing.evaluate(results) == mathex::Error::InvalidArgs);
+
+    // Empty expressions cannot be evaluated
+    std::vector<mathex::Expression> expressions = compile(config, {"x"});
+    expressions.push_back(mathex::Expression());
+    cr_expect(mathex::ExpressionSet(expressions).evaluate(results) == mathex::Error::SyntaxError);
+
+    // Nothing to evaluate
+    mathex::ExpressionSet empty;
+    cr_expect(empty.size() == 0);
+    cr_expect(empty.evaluate(nullptr) == mathex::Success);
+}
+
+Test(set, frame) {
+    mathex::Config config;
+    define(config);
+    config.declareVariable("a");
+    config.declareVariable("b");
+
+    mathex::ExpressionSet set(compile(config, {"a * b + x", "x + b * a", "a - sigma"}));
+    mathex::Evaluator evaluator;
+    double frame[] = {3, 5};
+    double results[3];
+
+    cr_expect(set.operations() == 7);
+    cr_expect(set.evaluate(results) == mathex::Error::Undefined);
+
+    cr_assert(evaluator.evaluate(set, results, frame) == mathex::Success);
+    cr_expect(ieee_ulp_eq(dbl, results[0], 15 + x, 0));
+    cr_expect(ieee_ulp_eq(dbl, results[1], 15 + x, 0));
+    cr_expect(ieee_ulp_eq(dbl, results[2], 1, 0));
+}
+
+// Random expressions made of few subterms give the same results as when evaluated one by one
+Test(set, random) {
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Functions);
+    define(config);
+
+    std::mt19937 random(7);
+    std::vector<std::string> terms = {"x", "y", "mu", "sigma", "(x - mu) / sigma", "sin(y)", "2.5", "hypot(x, y)", "-x"};
+    std::vector<std::string> operators = {" + ", " - ", " * ", " / ", "^"};
+    std::vector<std::string> sources;
+
+    for (int i = 0; i < 300; i++) {
+        std::string source = terms[random() % terms.size()];
+
+        for (int j = (int)(random() % 4); j > 0; j--) {
+            source = "(" + source + ")" + operators[random() % operators.size()] + "(" + terms[random() % terms.size()] + ")";
+        }
+
+        sources.push_back(source);
+    }
+
+    for (mathex::Optimization optimization : {mathex::Optimization::None, mathex::Optimization::Exact, mathex::Optimization::Fast}) {
+        std::vector<mathex::Expression> expressions = compile(config, sources, optimization);
+        mathex::ExpressionSet set(expressions);
+        std::vector<double> results(set.size());
+        size_t total = 0;
+
+        cr_assert(set.evaluate(results.data()) == mathex::Success);
+
+        for (size_t i = 0; i < sources.size(); i++) {
+            double expected;
+            cr_assert(expressions[i].evaluate(expected) == mathex::Success);
+            cr_expect((std::isnan(results[i]) && std::isnan(expected)) || ieee_ulp_eq(dbl, results[i], expected, 0), "%s", sources[i].c_str());
+            total += expressions[i].size();
+        }
+
+        cr_expect(set.operations() < total / 4, "%zu operations for %zu instructions", set.operations(), total);
+    }
+}
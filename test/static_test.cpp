@@ -0,0 +1,212 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <cstdint>
+#include <cstring>
+#include <mathex>
+#include <string>
+
+constexpr mathex::Flags Flags = mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus + mathex::Flags::Functions +
+                                mathex::Flags::Comparison + mathex::Flags::Logical + mathex::Flags::Conditional;
+
+#define SOURCE(name, text)                                    \
+    struct name {                                             \
+        static constexpr const char *expression = text;       \
+        static constexpr const char *variables = "x, y";      \
+    }
+
+SOURCE(Arithmetic, "x + y * 2 - x / y");
+SOURCE(Precedence, "2 + x ^ 2 % 3 * y");
+SOURCE(Unary, "-x * (+y) - (-2) + (!!x)");
+SOURCE(Implicit, "2x + 3sin(y) - 2.5y");
+SOURCE(Parentheses, "(x + (y * 2");
+SOURCE(Unmatched, "x + 1) * y)");
+SOURCE(Builtins, "abs(x) + sqrt(y) + cbrt(x) + exp(y) + log(y) + log2(y) + log10(y) + floor(x) + ceil(x) + round(x) + trunc(x)");
+SOURCE(Trigonometry, "sin(x) * cos(y) + tan(x) - asin(0.5) + acos(0.25) * atan(y) + sinh(x) - cosh(y) * tanh(x)");
+SOURCE(Binary, "min(x, y) + max(x, y) * atan2(x, y) - hypot(x, y)");
+SOURCE(Comparison, "(x < y) + (x <= y) * 2 + (x > y) * 4 + (x >= y) * 8 + (x == y) * 16 + (x != y) * 32");
+SOURCE(Logical, "x && y || (!x && 2)");
+SOURCE(Conditional, "if(x > y, if(y, x / y, 0), sin(if(x, x, y)))");
+SOURCE(Numbers, "0.1 + .5 * 3. + 1e3 - 2.5E-3 + 6.02214076e23 - 1e-30 + 1.7976931348623157e308 * 0");
+SOURCE(Digits, "123456789012345678901234567890 + 0.30000000000000000000000000001 * x");
+SOURCE(Tiny, "4.9406564584124654e-324 * x + 2.2250738585072011e-308");
+SOURCE(Exponent, "1e+x * 2e2x");
+
+struct Shadowed {
+    static constexpr const char *expression = "sin * if";
+    static constexpr const char *variables = "sin, if";
+};
+
+struct Constant {
+    static constexpr const char *expression = "1 + 2 * 3";
+    static constexpr const char *variables = "";
+};
+
+static bool same(double a, double b) {
+    std::uint64_t a_bits, b_bits;
+    std::memcpy(&a_bits, &a, sizeof(a_bits));
+    std::memcpy(&b_bits, &b, sizeof(b_bits));
+    return a_bits == b_bits;
+}
+
+// Checks that static expression gives the same result as the interpreter, bit for bit.
+template <class Source, mathex::Flags flags = Flags>
+static void compare(double x, double y) {
+    mathex::Config config(flags);
+    double variables[] = {x, y};
+    config.addVariable("x", variables[0]);
+    config.addVariable("y", variables[1]);
+
+    double expected;
+    cr_assert(eq(int, (int)config.evaluate(Source::expression, expected), (int)mathex::Success));
+
+    mathex::StaticExpression<Source, flags> expression;
+    cr_expect(same(expression(x, y), expected), "%s with x = %g, y = %g", Source::expression, x, y);
+    cr_expect(same(expression.evaluate(variables), expected));
+}
+
+template <class Source>
+static void compareAll() {
+    const double values[] = {0, -0.0, 1, -1, 0.5, 2, 3.75, -7.25, 1e-300, 1e300, NAN, INFINITY};
+
+    for (double x : values) {
+        for (double y : values) {
+            compare<Source>(x, y);
+        }
+    }
+}
+
+Test(static, results) {
+    compareAll<Arithmetic>();
+    compareAll<Precedence>();
+    compareAll<Unary>();
+    compareAll<Implicit>();
+    compareAll<Parentheses>();
+    compareAll<Unmatched>();
+    compareAll<Builtins>();
+    compareAll<Trigonometry>();
+    compareAll<Binary>();
+    compareAll<Comparison>();
+    compareAll<Logical>();
+    compareAll<Conditional>();
+}
+
+Test(static, numbers) {
+    compare<Numbers>(0, 0);
+    compare<Digits>(1, 0);
+    compare<Tiny>(1, 0);
+    compare<Exponent>(2, 0);
+}
+
+Test(static, variables) {
+    static_assert(mathex::StaticExpression<Arithmetic>::frameSize == 2, "");
+    static_assert(mathex::StaticExpression<Constant>::frameSize == 0, "");
+
+    static_assert(mathex::detail::staticVariablesValid("a, b1 c_d,_e"), "");
+    static_assert(!mathex::detail::staticVariablesValid("a, a"), "");
+    static_assert(!mathex::detail::staticVariablesValid("a, 1b"), "");
+    static_assert(!mathex::detail::staticVariablesValid("a + b"), "");
+
+    mathex::StaticExpression<Constant> constant;
+    cr_expect(eq(dbl, constant(), 7));
+
+    // Variables hide built-in functions and the conditional, as names defined in a config do
+    mathex::StaticExpression<Shadowed, Flags> shadowed;
+    cr_expect(eq(dbl, shadowed(2, 3), 6));
+}
+
+// Checks that built-in functions of static expressions have the names, arguments and results of those the interpreter has.
+Test(static, builtins) {
+    mathex::Config config(Flags);
+    double x = 0.5, y = 0.25, result;
+    config.addVariable("x", x);
+    config.addVariable("y", y);
+
+    for (size_t builtin = 0; builtin < mathex::detail::Builtins; builtin++) {
+        std::string name = mathex::detail::staticBuiltin(builtin);
+        bool binary = mathex::detail::staticArity(builtin) == 2;
+        double expected = binary ? mathex::detail::staticApply(mathex::detail::StaticKind::Builtin, builtin, x, y)
+                                 : mathex::detail::staticApply(mathex::detail::StaticKind::Builtin, builtin, x);
+
+        cr_assert(eq(int, (int)config.evaluate(name + (binary ? "(x, y)" : "(x)"), result), (int)mathex::Success), "%s", name.c_str());
+        cr_expect(same(result, expected), "%s", name.c_str());
+        cr_expect(eq(int, (int)config.evaluate(name + (binary ? "(x)" : "(x, y)"), result), (int)mathex::Error::IncorrectArgsNum), "%s", name.c_str());
+    }
+
+    cr_expect(mathex::detail::staticBuiltin(mathex::detail::Builtins) == nullptr);
+}
+
+SOURCE(Empty, "");
+SOURCE(Dangling, "x +");
+SOURCE(EmptyParentheses, "x * ()");
+SOURCE(Operands, "x y");
+SOURCE(Undefined, "x + z");
+SOURCE(Arguments, "min(x)");
+SOURCE(Branches, "if(x, y)");
+SOURCE(TooManyBranches, "if(x, y, 1, 2)");
+SOURCE(Call, "sin x");
+SOURCE(Points, "1.2.3");
+SOURCE(Assignment, "x = y");
+SOURCE(Comma, "x, y");
+SOURCE(NestedComma, "if((x, y), 1)");
+SOURCE(Disabled, "x ^ y");
+SOURCE(Separator, "1e + x");
+SOURCE(Name, "y1 + x");
+
+// Checks that expression is rejected at compile time with the error the interpreter gives.
+template <class Source, mathex::Flags flags = Flags>
+static void reject() {
+    mathex::Config config(flags);
+    double x = 1, y = 2, result;
+    config.addVariable("x", x);
+    config.addVariable("y", y);
+
+    mathex::Error error = mathex::detail::StaticParsed<Source, flags>::program.error;
+    cr_expect(ne(int, (int)error, (int)mathex::Success), "%s", Source::expression);
+    cr_expect(eq(int, (int)error, (int)config.evaluate(Source::expression, result)), "%s", Source::expression);
+}
+
+Test(static, errors) {
+    reject<Empty>();
+    reject<Dangling>();
+    reject<EmptyParentheses>();
+    reject<Operands>();
+    reject<Undefined>();
+    reject<Arguments>();
+    reject<Branches>();
+    reject<TooManyBranches>();
+    reject<Call>();
+    reject<Points>();
+    reject<Assignment>();
+    reject<Comma>();
+    reject<NestedComma>();
+    reject<Disabled, mathex::DefaultFlags>();
+    reject<Separator>();
+    reject<Name>();
+
+    // Without scientific notation, `e` is a name
+    reject<Exponent, mathex::DefaultFlags - mathex::Flags::ScientificNotation>();
+    reject<Unmatched, mathex::DefaultFlags - mathex::Flags::ImplicitParentheses>();
+    reject<Logical, mathex::DefaultFlags>();
+}
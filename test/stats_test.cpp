@@ -0,0 +1,167 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <mathex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+mathex::Config *config = nullptr;
+
+double x = 5;
+
+void suite_setup(void) {
+    config = new mathex::Config();
+    config->addVariable("x", x);
+
+    config->addFunction("f", [](double args[], int argc, double &result) -> mathex::Error {
+        if (argc != 1) {
+            return mathex::Error::IncorrectArgsNum;
+        }
+
+        result = args[0];
+        return mathex::Success;
+    });
+}
+
+void suite_teardown(void) {
+    delete config;
+    config = nullptr;
+}
+
+TestSuite(stats, .init = suite_setup, .fini = suite_teardown);
+
+static size_t histogram(const mathex::Statistics::Timing &timing) {
+    return std::accumulate(timing.histogram.begin(), timing.histogram.end(), (size_t)0);
+}
+
+Test(stats, disabled) {
+    double result;
+
+    cr_assert(config->evaluate("x + 1", result) == mathex::Success);
+    mathex::Statistics statistics = config->statistics();
+
+    cr_expect(statistics.evaluations == 0);
+    cr_expect(statistics.tokenize.count == 0);
+    cr_expect(statistics.memory > 0);
+}
+
+Test(stats, counters) {
+    double result;
+    config->enableStatistics();
+
+    cr_expect(config->evaluate("x + f(x)", result) == mathex::Success);
+    cr_expect(config->evaluate("2 * (x - 1)", result) == mathex::Success);
+    cr_expect(config->evaluate("y + 1", result) == mathex::Error::Undefined);
+    cr_expect(config->evaluate("f(1, 2)", result) == mathex::Error::IncorrectArgsNum);
+    cr_expect(config->evaluate("1 +", result) == mathex::Error::SyntaxError);
+
+    mathex::Expression expression;
+    cr_expect(config->compile("x * x", expression) == mathex::Success);
+
+    mathex::Statistics statistics = config->statistics();
+
+    cr_expect(statistics.evaluations == 5);
+    cr_expect(statistics.errors[(size_t)mathex::Error::Success] == 0);
+    cr_expect(statistics.errors[(size_t)mathex::Error::Undefined] == 1);
+    cr_expect(statistics.errors[(size_t)mathex::Error::IncorrectArgsNum] == 1);
+    cr_expect(statistics.errors[(size_t)mathex::Error::SyntaxError] == 1);
+    cr_expect(statistics.lookups == 3 + 1 + 1 + 1 + 2);
+
+    cr_expect(statistics.tokenize.count == 6);
+    cr_expect(statistics.parse.count == 6);
+    cr_expect(statistics.execute.count == 3);
+    cr_expect(histogram(statistics.tokenize) == 6);
+    cr_expect(histogram(statistics.execute) == 3);
+    cr_expect(statistics.parse.total.count() > 0);
+
+    config->resetStatistics();
+    statistics = config->statistics();
+    cr_expect(statistics.evaluations == 0);
+    cr_expect(statistics.errors[(size_t)mathex::Error::Undefined] == 0);
+    cr_expect(histogram(statistics.parse) == 0);
+
+    config->enableStatistics(false);
+    cr_expect(config->evaluate("x", result) == mathex::Success);
+    cr_expect(config->statistics().evaluations == 0);
+}
+
+Test(stats, error_codes) {
+    // Every error code returned by a function is counted, and values outside of the enumeration are not
+    mathex::Config local;
+    int code = 0;
+    double result;
+
+    local.addFunction("fail", [&code](double[], int, double &) -> mathex::Error { return (mathex::Error)code; });
+    local.enableStatistics();
+
+    for (code = 1; code <= (int)mathex::ErrorCodes; code++) {
+        cr_expect(local.evaluate("fail()", result) == (mathex::Error)code);
+    }
+
+    mathex::Statistics statistics = local.statistics();
+    cr_expect(statistics.evaluations == mathex::ErrorCodes);
+    cr_expect(statistics.errors.size() == mathex::ErrorCodes);
+    cr_expect(statistics.errors[(size_t)mathex::Error::CircularDependency] == 1);
+
+    for (size_t i = 1; i < mathex::ErrorCodes; i++) {
+        cr_expect(statistics.errors[i] == 1, "error code %zu", i);
+    }
+}
+
+Test(stats, threads) {
+    config->enableStatistics();
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([]() {
+            double result;
+
+            for (int i = 0; i < 1000; i++) {
+                config->evaluate("x * 2", result);
+            }
+        });
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    mathex::Statistics statistics = config->statistics();
+    cr_expect(statistics.evaluations == 4000);
+    cr_expect(statistics.execute.count == 4000);
+    cr_expect(histogram(statistics.execute) == 4000);
+}
+
+Test(stats, memory) {
+    size_t before = config->statistics().memory;
+    std::vector<double> values(100);
+
+    for (size_t i = 0; i < values.size(); i++) {
+        config->addVariable("variable_with_long_name_" + std::to_string(i), values[i]);
+    }
+
+    cr_expect(config->statistics().memory > before + 100 * 24);
+}
@@ -0,0 +1,238 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <criterion/criterion.h>
+#include <criterion/new/assert.h>
+#include <cstdio>
+#include <mathex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using mathex::call;
+using mathex::var;
+
+constexpr mathex::Flags Flags = mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus + mathex::Flags::Functions +
+                                mathex::Flags::Comparison + mathex::Flags::Logical + mathex::Flags::Conditional;
+
+const char *path = "term_test.bin";
+
+double x = 1.5;
+double y = -2;
+double frame[] = {4};
+
+static void define(mathex::Config &config) {
+    config.addVariable("x", x);
+    config.addVariable("y", y);
+    config.declareVariable("z");
+    config.addConstant("pi", 3.14159);
+
+    config.addFunction("sum", [](double args[], int argc, double &result) -> mathex::Error {
+        result = 0;
+
+        for (int i = 0; i < argc; i++) {
+            result += args[i];
+        }
+
+        return mathex::Success;
+    });
+
+    config.addFunction<double(double, double)>("mix", [](double a, double b) { return 0.25 * a + 0.75 * b; });
+}
+
+static std::string read() {
+    std::string contents;
+    std::FILE *file = std::fopen(path, "rb");
+    int c;
+
+    while ((c = std::fgetc(file)) != EOF) {
+        contents.push_back((char)c);
+    }
+
+    std::fclose(file);
+    return contents;
+}
+
+// Returns compiled program as it is written to a file.
+static std::string save(const mathex::Expression &expression) {
+    cr_assert(eq(int, (int)mathex::Expression::save(path, {expression}), (int)mathex::Success));
+    return read();
+}
+
+static void cleanup(void) {
+    std::remove(path);
+}
+
+TestSuite(term, .fini = cleanup);
+
+Test(term, same_program) {
+    mathex::Config config(Flags);
+    define(config);
+
+    std::vector<std::pair<mathex::Term, std::string>> cases = {
+        {var("x") * 2 + 1, "x * 2 + 1"},
+        {(var("x") + 1) * 2, "(x + 1) * 2"},
+        {var("x") - (var("y") - 3), "x - (y - 3)"},
+        {mathex::pow(var("x"), 2) % 3 / var("pi"), "((x ^ 2) % 3) / pi"},
+        {-var("x") * +var("y") + var("z"), "-x * (+y) + z"},
+        {(var("x") < var("y")) + (var("x") <= 1) + (var("x") > 1) + (var("x") >= var("z")) + (var("x") == 1.5) + (var("y") != 0),
+         "(x < y) + (x <= 1) + (x > 1) + (x >= z) + (x == 1.5) + (y != 0)"},
+        {(var("x") && var("y")) || !var("z"), "x && y || (!z)"},
+        {call("if", var("x") > 1, call("sqrt", var("x")), call("if", var("y"), 1, 2)), "if(x > 1, sqrt(x), if(y, 1, 2))"},
+        {call("sum") + call("sum", var("x"), 2, var("z")) * call("mix", var("x"), var("y")), "sum() + sum(x, 2, z) * mix(x, y)"},
+        {call("min", call("atan2", var("y"), var("x")), call("max", 1, var("pi"))), "min(atan2(y, x), max(1, pi))"},
+    };
+
+    for (const auto &test : cases) {
+        mathex::Expression built, parsed;
+        cr_assert(eq(int, (int)config.compile(test.first, built, mathex::Optimization::None), (int)mathex::Success), "%s", test.second.c_str());
+        cr_assert(eq(int, (int)config.compile(test.second, parsed, mathex::Optimization::None), (int)mathex::Success), "%s", test.second.c_str());
+        cr_expect(save(built) == save(parsed), "%s", test.second.c_str());
+
+        double built_result, parsed_result;
+        cr_assert(eq(int, (int)built.evaluate(frame, built_result), (int)mathex::Success));
+        cr_assert(eq(int, (int)parsed.evaluate(frame, parsed_result), (int)mathex::Success));
+        cr_expect(ieee_ulp_eq(dbl, built_result, parsed_result, 0), "%s", test.second.c_str());
+
+        // Optimizer rewrites both the same way
+        cr_assert(eq(int, (int)config.compile(test.first, built), (int)mathex::Success));
+        cr_assert(eq(int, (int)config.compile(test.second, parsed), (int)mathex::Success));
+        cr_expect(save(built) == save(parsed), "%s", test.second.c_str());
+    }
+}
+
+Test(term, errors) {
+    mathex::Config config(Flags);
+    mathex::Config defaults;
+    mathex::Expression expression;
+    define(config);
+    define(defaults);
+
+    cr_expect(eq(int, (int)config.compile(var("w") + 1, expression), (int)mathex::Error::Undefined));
+    cr_expect(eq(int, (int)config.compile(call("g", 1), expression), (int)mathex::Error::Undefined));
+
+    // Functions have to be called, and only functions can be called
+    cr_expect(eq(int, (int)config.compile(var("sum"), expression), (int)mathex::Error::SyntaxError));
+    cr_expect(eq(int, (int)config.compile(var("sin"), expression), (int)mathex::Error::SyntaxError));
+    cr_expect(eq(int, (int)config.compile(var("if"), expression), (int)mathex::Error::SyntaxError));
+    cr_expect(eq(int, (int)config.compile(call("x", 1), expression), (int)mathex::Error::SyntaxError));
+
+    cr_expect(eq(int, (int)config.compile(call("sin"), expression), (int)mathex::Error::IncorrectArgsNum));
+    cr_expect(eq(int, (int)config.compile(call("mix", 1), expression), (int)mathex::Error::IncorrectArgsNum));
+    cr_expect(eq(int, (int)config.compile(call("if", 1, 2), expression), (int)mathex::Error::IncorrectArgsNum));
+    cr_expect(eq(int, (int)config.compile(call("if", 1, 2, 3, 4), expression), (int)mathex::Error::IncorrectArgsNum));
+
+    // Operators and built-in functions are enabled by flags, as in text
+    cr_expect(eq(int, (int)defaults.compile(mathex::pow(var("x"), 2), expression), (int)mathex::Error::SyntaxError));
+    cr_expect(eq(int, (int)defaults.compile(var("x") < 2, expression), (int)mathex::Error::SyntaxError));
+    cr_expect(eq(int, (int)defaults.compile(!var("x"), expression), (int)mathex::Error::SyntaxError));
+    cr_expect(eq(int, (int)defaults.compile(call("sin", var("x")), expression), (int)mathex::Error::Undefined));
+    cr_expect(eq(int, (int)defaults.compile(call("if", 1, 2, 3), expression), (int)mathex::Error::Undefined));
+
+    // Failed compilation leaves expression unchanged
+    cr_assert(eq(int, (int)config.compile(var("x"), expression), (int)mathex::Success));
+    cr_expect(eq(int, (int)config.compile(var("w"), expression), (int)mathex::Error::Undefined));
+    cr_expect(eq(sz, expression.size(), 1));
+}
+
+Test(term, evaluation) {
+    mathex::Config config(Flags);
+    define(config);
+
+    mathex::Term term = call("if", var("x") > 0, mathex::pow(var("x"), 2) + var("y") * 3, 0);
+    double result;
+
+    cr_assert(eq(int, (int)config.evaluate(term, result), (int)mathex::Success));
+    cr_expect(ieee_ulp_eq(dbl, result, 1.5 * 1.5 - 6, 0));
+
+    mathex::Expression expression;
+    cr_assert(eq(int, (int)config.compile(term, expression), (int)mathex::Success));
+
+    // Batch evaluation
+    std::vector<double> xs = {-1, 0, 1, 2, 3};
+    std::vector<double> results(xs.size());
+    cr_assert(eq(int, (int)expression.evaluate({{"x", xs.data()}}, results.data(), xs.size()), (int)mathex::Success));
+
+    for (size_t i = 0; i < xs.size(); i++) {
+        cr_expect(ieee_ulp_eq(dbl, results[i], xs[i] > 0 ? xs[i] * xs[i] - 6 : 0, 0));
+    }
+
+    // Derivatives
+    double gradient[2];
+    cr_assert(eq(int, (int)expression.differentiate({"x", "y"}, result, gradient), (int)mathex::Success));
+    cr_expect(ieee_ulp_eq(dbl, gradient[0], 3, 0));
+    cr_expect(ieee_ulp_eq(dbl, gradient[1], 3, 0));
+
+    // Native code
+    expression.jit();
+    cr_assert(eq(int, (int)expression.evaluate(result), (int)mathex::Success));
+    cr_expect(ieee_ulp_eq(dbl, result, 1.5 * 1.5 - 6, 0));
+
+    // Common subexpressions of built and parsed expressions are shared
+    mathex::Expression parsed;
+    cr_assert(eq(int, (int)config.compile("x ^ 2 + y * 3", parsed), (int)mathex::Success));
+    mathex::ExpressionSet set({expression, parsed});
+
+    double both[2];
+    cr_assert(eq(int, (int)set.evaluate(both), (int)mathex::Success));
+    cr_expect(ieee_ulp_eq(dbl, both[0], both[1], 0));
+}
+
+Test(term, cache) {
+    mathex::Config config(Flags);
+    define(config);
+    config.setCacheCapacity(16);
+
+    mathex::Expression expression;
+    cr_assert(eq(int, (int)config.compile(var("x") * 2, expression), (int)mathex::Success));
+    cr_expect(eq(sz, config.cacheHits(), 0));
+
+    // Equal terms built separately are found in the cache
+    cr_assert(eq(int, (int)config.compile(var("x") * 2, expression), (int)mathex::Success));
+    cr_expect(eq(sz, config.cacheHits(), 1));
+
+    // Terms are not mistaken for one another, nor for text
+    cr_assert(eq(int, (int)config.compile(var("x") * 3, expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)config.compile(var("x") + 2, expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)config.compile(var("x") && var("y"), expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)config.compile(var("x") || var("y"), expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)config.compile(call("sum", call("sum", 1), 2), expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)config.compile(call("sum", call("sum", 1, 2)), expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)config.compile("x * 2", expression), (int)mathex::Success));
+    cr_expect(eq(sz, config.cacheHits(), 1));
+
+    double result;
+    cr_assert(eq(int, (int)config.compile(call("sum", call("sum", 1), 2), expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)expression.evaluate(result), (int)mathex::Success));
+    cr_expect(ieee_ulp_eq(dbl, result, 3, 0));
+    cr_expect(eq(sz, config.cacheHits(), 2));
+
+    // Redefining a name discards terms that use it
+    config.remove("x");
+    double w = 5;
+    config.addVariable("x", w);
+    cr_assert(eq(int, (int)config.compile(var("x") * 2, expression), (int)mathex::Success));
+    cr_assert(eq(int, (int)expression.evaluate(result), (int)mathex::Success));
+    cr_expect(ieee_ulp_eq(dbl, result, 10, 0));
+    cr_expect(eq(sz, config.cacheHits(), 2));
+}
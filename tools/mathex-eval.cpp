@@ -0,0 +1,576 @@
+/*
+  Copyright (c) 2023 Caps Lock
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+// Evaluates a formula for every row of a CSV or raw binary file.
+//
+// Columns become variables declared with `Config::declareVariable`, so a block of rows is a block of frames that is evaluated
+// in one call. Input is read and output is written one block at a time, so memory use does not depend on size of the input.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mathex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    enum class Format {
+        Csv,
+        Binary,
+    };
+
+    struct Options {
+        std::string formula;
+        std::string input = "-";
+        std::string output = "-";
+        Format format = Format::Csv;
+        Format output_format = Format::Csv;
+        bool output_format_set = false;
+        std::vector<std::string> columns;
+        bool header = true;
+        char delimiter = ',';
+        std::vector<std::string> constants;
+        size_t block = 4096;
+        int precision = 17;
+        bool quiet = false;
+    };
+
+    const char *describe(mathex::Error error) {
+        switch (error) {
+        case mathex::Error::Success:
+            return "success";
+        case mathex::Error::DivisionByZero:
+            return "division by zero";
+        case mathex::Error::SyntaxError:
+            return "syntax error";
+        case mathex::Error::Undefined:
+            return "undefined name";
+        case mathex::Error::InvalidArgs:
+            return "invalid arguments";
+        case mathex::Error::IncorrectArgsNum:
+            return "incorrect number of arguments";
+        case mathex::Error::NotDifferentiable:
+            return "not differentiable";
+        case mathex::Error::InvalidFormat:
+            return "invalid bytecode file";
+        case mathex::Error::CircularDependency:
+            return "circular dependency";
+        default:
+            return "unknown error";
+        }
+    }
+
+    // Closes the file on scope exit, unless it is one of standard streams.
+    class File {
+    public:
+        File(const std::string &path, const char *mode, FILE *standard) : file(path == "-" ? standard : std::fopen(path.c_str(), mode)), owned(path != "-") {}
+
+        File(const File &) = delete;
+        File &operator=(const File &) = delete;
+
+        ~File() {
+            if (this->owned && this->file != nullptr) {
+                std::fclose(this->file);
+            }
+        }
+
+        FILE *get() const {
+            return this->file;
+        }
+
+    private:
+        FILE *file;
+        bool owned;
+    };
+
+    // Splits input into lines, holding only a fixed size chunk of it in memory. (grown only for lines longer than the chunk)
+    class LineReader {
+    public:
+        explicit LineReader(FILE *file) : file(file), buffer(Chunk + 1) {}
+
+        // Returns next line without line terminator in [begin, end), or false at end of input.
+        bool next(const char *&begin, const char *&end) {
+            while (true) {
+                char *data = this->buffer.data();
+                char *start = data + this->begin;
+                char *stop = data + this->end;
+                char *newline = static_cast<char *>(std::memchr(start, '\n', static_cast<size_t>(stop - start)));
+
+                if (newline == nullptr && this->eof) {
+                    if (start == stop) {
+                        return false;
+                    }
+
+                    newline = stop;
+                }
+
+                if (newline != nullptr) {
+                    this->begin = static_cast<size_t>(newline - data) + (newline == stop ? 0 : 1);
+                    this->line++;
+
+                    begin = start;
+                    end = newline > start && newline[-1] == '\r' ? newline - 1 : newline;
+                    return true;
+                }
+
+                this->fill();
+            }
+        }
+
+        size_t lines() const {
+            return this->line;
+        }
+
+        size_t bytes() const {
+            return this->read;
+        }
+
+    private:
+        static constexpr size_t Chunk = 1 << 20;
+
+        // Moves unread part of the buffer to the front and reads more after it. Buffer always ends with a null character,
+        // so that `strtod` stops at the end of the last line.
+        void fill() {
+            size_t remaining = this->end - this->begin;
+            std::memmove(this->buffer.data(), this->buffer.data() + this->begin, remaining);
+            this->begin = 0;
+            this->end = remaining;
+
+            if (this->end == this->buffer.size() - 1) {
+                this->buffer.resize(this->buffer.size() * 2);
+            }
+
+            size_t read = std::fread(this->buffer.data() + this->end, 1, this->buffer.size() - 1 - this->end, this->file);
+            this->end += read;
+            this->read += read;
+            this->buffer[this->end] = '\0';
+            this->eof = read == 0;
+        }
+
+        FILE *file;
+        std::vector<char> buffer;
+        size_t begin = 0;
+        size_t end = 0;
+        size_t line = 0;
+        size_t read = 0;
+        bool eof = false;
+    };
+
+    bool space(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    // Splits a line into fields, trimming spaces and quotes around them.
+    std::vector<std::string> split(const char *begin, const char *end, char delimiter) {
+        std::vector<std::string> fields;
+
+        while (true) {
+            const char *stop = static_cast<const char *>(std::memchr(begin, delimiter, static_cast<size_t>(end - begin)));
+            const char *next = stop == nullptr ? end : stop;
+            const char *first = begin;
+            const char *last = next;
+
+            while (first < last && space(*first)) {
+                first++;
+            }
+
+            while (last > first && space(last[-1])) {
+                last--;
+            }
+
+            if (last - first >= 2 && *first == '"' && last[-1] == '"') {
+                first++;
+                last--;
+            }
+
+            fields.emplace_back(first, last);
+
+            if (stop == nullptr) {
+                return fields;
+            }
+
+            begin = stop + 1;
+        }
+    }
+
+    // Parses a line of numbers into a frame. Returns number of fields, or 0 if one of them is not a number.
+    size_t parse(const char *begin, const char *end, char delimiter, double *frame, size_t columns) {
+        size_t count = 0;
+
+        while (true) {
+            while (begin < end && space(*begin)) {
+                begin++;
+            }
+
+            // An empty field would let `strtod` skip the line break and read the next line
+            if (begin == end || *begin == delimiter) {
+                return 0;
+            }
+
+            char *stop;
+            double value = std::strtod(begin, &stop);
+
+            if (stop == begin) {
+                return 0;
+            }
+
+            while (stop < end && space(*stop)) {
+                stop++;
+            }
+
+            if (stop < end && *stop != delimiter) {
+                return 0;
+            }
+
+            if (count < columns) {
+                frame[count] = value;
+            }
+
+            count++;
+
+            if (stop == end) {
+                return count;
+            }
+
+            begin = stop + 1;
+        }
+    }
+
+    bool format(const std::string &name, Format &format) {
+        if (name == "csv") {
+            format = Format::Csv;
+        } else if (name == "binary") {
+            format = Format::Binary;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    void usage(const char *program) {
+        std::fprintf(stderr,
+                     "usage: %s [options] FORMULA [INPUT]\n"
+                     "\n"
+                     "Evaluates FORMULA for every row of INPUT (or standard input), using columns as variables.\n"
+                     "\n"
+                     "  -o, --output FILE          write results to FILE instead of standard output\n"
+                     "  --format csv|binary        format of input, binary being rows of native doubles (default csv)\n"
+                     "  --output-format csv|binary format of results (default same as input)\n"
+                     "  --columns A,B,...          names of columns, required for binary input, replaces CSV header\n"
+                     "  --no-header                first line of CSV input is data, names come from --columns\n"
+                     "  --delimiter C              separator of CSV fields (default ,)\n"
+                     "  --define NAME=VALUE        add a constant, may be repeated\n"
+                     "  --block ROWS               rows evaluated per call (default 4096)\n"
+                     "  --precision DIGITS         significant digits of CSV results (default 17)\n"
+                     "  --quiet                    do not report throughput\n",
+                     program);
+    }
+
+    // Returns 0 on success, or exit code to return.
+    int arguments(int argc, char *argv[], Options &options) {
+        std::vector<std::string> positional;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+
+            if (arg == "--no-header") {
+                options.header = false;
+                continue;
+            }
+
+            if (arg == "--quiet") {
+                options.quiet = true;
+                continue;
+            }
+
+            if (arg == "-h" || arg == "--help") {
+                usage(argv[0]);
+                return 2;
+            }
+
+            if (arg.size() < 2 || arg[0] != '-') {
+                positional.push_back(arg);
+                continue;
+            }
+
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (value == nullptr) {
+                std::fprintf(stderr, "missing value of %s\n", arg.c_str());
+                return 2;
+            }
+
+            if (arg == "-o" || arg == "--output") {
+                options.output = value;
+            } else if (arg == "--format") {
+                if (!format(value, options.format)) {
+                    std::fprintf(stderr, "unknown format %s\n", value);
+                    return 2;
+                }
+            } else if (arg == "--output-format") {
+                if (!format(value, options.output_format)) {
+                    std::fprintf(stderr, "unknown format %s\n", value);
+                    return 2;
+                }
+
+                options.output_format_set = true;
+            } else if (arg == "--columns") {
+                options.columns = split(value, value + std::strlen(value), ',');
+            } else if (arg == "--delimiter") {
+                if (std::strlen(value) != 1 || value[0] == '\n' || value[0] == '"') {
+                    std::fprintf(stderr, "delimiter has to be a single character\n");
+                    return 2;
+                }
+
+                options.delimiter = value[0];
+            } else if (arg == "--define") {
+                options.constants.push_back(value);
+            } else if (arg == "--block") {
+                options.block = std::strtoull(value, nullptr, 10);
+
+                if (options.block == 0) {
+                    std::fprintf(stderr, "block has to hold at least one row\n");
+                    return 2;
+                }
+            } else if (arg == "--precision") {
+                long precision = std::strtol(value, nullptr, 10);
+
+                if (precision < 1 || precision > 99) {
+                    std::fprintf(stderr, "precision has to be between 1 and 99 digits\n");
+                    return 2;
+                }
+
+                options.precision = static_cast<int>(precision);
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+
+            i++;
+        }
+
+        if (positional.empty() || positional.size() > 2) {
+            usage(argv[0]);
+            return 2;
+        }
+
+        options.formula = positional[0];
+
+        if (positional.size() == 2) {
+            options.input = positional[1];
+        }
+
+        if (!options.output_format_set) {
+            options.output_format = options.format;
+        }
+
+        if (options.columns.empty() && (options.format == Format::Binary || !options.header)) {
+            std::fprintf(stderr, "names of columns have to be given with --columns\n");
+            return 2;
+        }
+
+        return 0;
+    }
+
+    // Writes results of a block, formatting CSV into a buffer first, so that there is a single write per block.
+    bool write(FILE *file, const Options &options, const double *results, size_t count, std::vector<char> &text) {
+        if (options.output_format == Format::Binary) {
+            return std::fwrite(results, sizeof(double), count, file) == count;
+        }
+
+        // Longest number printed with `%.*g` is sign, digits, point and exponent
+        size_t width = static_cast<size_t>(options.precision) + 16;
+        text.resize(count * width);
+        size_t size = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            size += static_cast<size_t>(std::snprintf(text.data() + size, width, "%.*g\n", options.precision, results[i]));
+        }
+
+        return std::fwrite(text.data(), 1, size, file) == size;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    int code = arguments(argc, argv, options);
+
+    if (code != 0) {
+        return code;
+    }
+
+    File input(options.input, "rb", stdin);
+    File output(options.output, "wb", stdout);
+
+    if (input.get() == nullptr) {
+        std::fprintf(stderr, "cannot open %s\n", options.input.c_str());
+        return 1;
+    }
+
+    if (output.get() == nullptr) {
+        std::fprintf(stderr, "cannot open %s\n", options.output.c_str());
+        return 1;
+    }
+
+    // Arithmetic of a calculator, with all operators and built-in functions
+    mathex::Config config(mathex::DefaultFlags + mathex::Flags::Exponentiation + mathex::Flags::Modulus + mathex::Flags::Functions);
+    LineReader reader(input.get());
+    std::vector<std::string> columns = options.columns;
+
+    if (options.format == Format::Csv && options.header) {
+        const char *begin;
+        const char *end;
+
+        if (!reader.next(begin, end)) {
+            std::fprintf(stderr, "input has no header\n");
+            return 1;
+        }
+
+        if (columns.empty()) {
+            columns = split(begin, end, options.delimiter);
+        }
+    }
+
+    for (const std::string &constant : options.constants) {
+        size_t equals = constant.find('=');
+        char *stop = nullptr;
+        double value = equals == std::string::npos ? 0 : std::strtod(constant.c_str() + equals + 1, &stop);
+
+        if (equals == std::string::npos || stop == constant.c_str() + equals + 1 || *stop != '\0') {
+            std::fprintf(stderr, "constant has to be given as NAME=VALUE: %s\n", constant.c_str());
+            return 2;
+        }
+
+        try {
+            config.addConstant(constant.substr(0, equals), value);
+        } catch (const std::exception &) {
+            std::fprintf(stderr, "cannot define constant %s\n", constant.c_str());
+            return 2;
+        }
+    }
+
+    // A fresh config gives out slots from zero, so a row of input is already a frame
+    for (size_t i = 0; i < columns.size(); i++) {
+        try {
+            config.declareVariable(columns[i]);
+        } catch (const mathex::AlreadyDefined &) {
+            std::fprintf(stderr, "column %s is defined twice\n", columns[i].c_str());
+            return 2;
+        } catch (const std::invalid_argument &) {
+            std::fprintf(stderr, "column %s is not a valid variable name, rename it with --columns\n", columns[i].c_str());
+            return 2;
+        }
+    }
+
+    mathex::Expression expression;
+    mathex::Error error = config.compile(options.formula, expression);
+
+    if (error != mathex::Success) {
+        std::fprintf(stderr, "cannot compile formula: %s\n", describe(error));
+        return 1;
+    }
+
+    size_t stride = columns.size();
+    std::vector<double> frames(options.block * stride);
+    std::vector<double> results(options.block);
+    std::vector<char> text;
+    size_t rows = 0;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (true) {
+        size_t count = 0;
+
+        if (options.format == Format::Binary) {
+            // Reading bytes rather than rows, as a partial row would be consumed without being counted
+            size_t read = std::fread(frames.data(), 1, frames.size() * sizeof(double), input.get());
+            bytes += read;
+            count = read / (sizeof(double) * stride);
+
+            if (read % (sizeof(double) * stride) != 0) {
+                std::fprintf(stderr, "input ends in the middle of a row\n");
+                return 1;
+            }
+        } else {
+            const char *begin;
+            const char *end;
+
+            while (count < options.block && reader.next(begin, end)) {
+                if (begin == end) {
+                    continue;
+                }
+
+                size_t fields = parse(begin, end, options.delimiter, frames.data() + count * stride, stride);
+
+                if (fields != stride) {
+                    std::fprintf(stderr, "line %zu: expected %zu numbers\n", reader.lines(), stride);
+                    return 1;
+                }
+
+                count++;
+            }
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        error = expression.evaluate(frames.data(), stride, results.data(), count);
+
+        if (error != mathex::Success) {
+            std::fprintf(stderr, "rows %zu to %zu: %s\n", rows + 1, rows + count, describe(error));
+            return 1;
+        }
+
+        if (!write(output.get(), options, results.data(), count, text)) {
+            std::fprintf(stderr, "cannot write %s\n", options.output.c_str());
+            return 1;
+        }
+
+        rows += count;
+    }
+
+    if (options.format == Format::Csv) {
+        bytes = reader.bytes();
+    }
+
+    if (std::ferror(input.get()) != 0) {
+        std::fprintf(stderr, "cannot read %s\n", options.input.c_str());
+        return 1;
+    }
+
+    if (std::fflush(output.get()) != 0) {
+        std::fprintf(stderr, "cannot write %s\n", options.output.c_str());
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!options.quiet) {
+        std::fprintf(stderr, "%zu rows, %.1f MB in %.3f s, %.1f MB/s\n", rows, static_cast<double>(bytes) / 1e6, seconds, seconds > 0 ? static_cast<double>(bytes) / 1e6 / seconds : 0.0);
+    }
+
+    return 0;
+}